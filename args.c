@@ -0,0 +1,27 @@
+/*
+ * @brief command line arguments shared by the programs
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include "args.h"
+
+/* === Implementations === */
+
+long int parse_number(const char *arg, const char *name, long int min,
+    long int max, args_fail fail)
+{
+    char *endptr;
+    long int val;
+
+    errno = 0;
+    val = strtol(arg, &endptr, 10);
+    if (errno != 0 || endptr == arg || *endptr != '\0'
+        || val < min || val > max) {
+        fail(EXIT_FAILURE, "%s has to be a number in %ld-%ld", name, min,
+            max);
+    }
+    return val;
+}
@@ -0,0 +1,32 @@
+/**
+ * @brief command line arguments shared by the programs
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Errors go to the bail_out() of the calling program, so its message
+ * format and cleanup stay the same as for every other error.
+*/
+
+#ifndef MM_ARGS_H_
+#define MM_ARGS_H_
+
+/* === Type Definitions === */
+
+/* A program's bail_out(): prints the message and terminates */
+typedef void (*args_fail)(int exitcode, const char *fmt, ...);
+
+/* === Prototypes === */
+
+/**
+ * @brief Parse a number option and check its range
+ * @param arg The option argument
+ * @param name Name of the option for error messages, e.g. "-t"
+ * @param min Smallest allowed value
+ * @param max Largest allowed value
+ * @param fail Called with EXIT_FAILURE if the number is invalid
+ * @return The parsed number
+ */
+long int parse_number(const char *arg, const char *name, long int min,
+    long int max, args_fail fail);
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * @brief exhaustive check and microbenchmark of the wire codec
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Checks every one of the 65536 request words and 256 response bytes
+ * against per-slot reference loops and against the server's scoring,
+ * including the slot order, and the bulk versions against the single word
+ * ones at every alignment. Then times encoding and decoding in codes/ns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../tbucket.h"
+#include "../score.h"
+#include "../codec.h"
+#include "report.h"
+
+/* === Constants === */
+
+#define WORDS (1 << 16)
+#define REPEAT (256)
+
+/* === Implementations === */
+
+/**
+ * @brief Encode a guess slot by slot, the way the client did before
+ * but with slot 0 in the lowest bits
+ * @param code The packed guess
+ * @return The request word
+ */
+static uint16_t request_ref(uint16_t code)
+{
+    uint16_t req = 0;
+    int parity = 0;
+
+    for (int i = SLOTS - 1; i >= 0; --i) {
+        int color = (code >> (i * SHIFT_WIDTH)) & 0x7;
+
+        req = (req << SHIFT_WIDTH) | color;
+        parity ^= color ^ (color >> 1) ^ (color >> 2);
+    }
+    return req | ((parity & 0x1) << 15);
+}
+
+/**
+ * @brief Decode a response byte with branches
+ * @param resp The response byte
+ * @param white Receives the number of white pins
+ * @return Number of red pins, -1 in case of a parity error
+ */
+static int decode_ref(uint8_t resp, int *white)
+{
+    *white = (resp >> 3) & 0x7;
+    if (resp & (1 << 6)) {
+        return -1;
+    }
+    return resp & 0x7;
+}
+
+/**
+ * @brief Check the single word functions on every word
+ * @return 0 on success, -1 on the first mismatch
+ */
+static int check_words(void)
+{
+    static uint8_t table[CODES];
+    uint16_t secret, guess;
+
+    for (uint32_t code = 0; code < CODES; ++code) {
+        uint16_t req = codec_request(code);
+
+        if (req != request_ref(code) || codec_code(req) != code
+            || !codec_valid(req) || codec_valid(req ^ (1 << 15))) {
+            (void) fprintf(stderr, "mismatch for code 0x%x\n", code);
+            return -1;
+        }
+    }
+    /* the server has to read what the client sends: parity errors for
+       exactly the invalid words, all red for exactly the secret */
+    if (score_parse("wwrgb", &secret) < 0 || score_parse("bdgor", &guess) < 0
+        || (codec_request(guess) & 0x7) != 0
+        || ((codec_request(guess) >> (4 * SHIFT_WIDTH)) & 0x7) != 4) {
+        (void) fprintf(stderr, "slot order differs from score_parse()\n");
+        return -1;
+    }
+    score_table_build(secret, table);
+    for (uint32_t w = 0; w < WORDS; ++w) {
+        uint8_t resp = score_lookup(table, w);
+        int white, red = codec_decode(resp, &white);
+
+        if (codec_valid(w) == (red < 0)
+            || (red == SLOTS) != (w == codec_request(secret))) {
+            (void) fprintf(stderr, "server disagrees on word 0x%x\n", w);
+            return -1;
+        }
+    }
+    for (uint32_t resp = 0; resp < 256; ++resp) {
+        int white, white_ref;
+
+        if (codec_decode(resp, &white) != decode_ref(resp, &white_ref)
+            || white != white_ref
+            || codec_response(resp & 7, (resp >> 3) & 7, (resp >> 6) & 1,
+                resp >> 7) != resp) {
+            (void) fprintf(stderr, "mismatch for response 0x%x\n", resp);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Check the bulk functions against the single word ones, starting
+ * at every offset into a vector
+ * @param words All words
+ * @param codes Room for WORDS codes
+ * @param out Room for WORDS words
+ * @param flags Room for WORDS bytes
+ * @return 0 on success, -1 on the first mismatch
+ */
+static int check_bulk(const uint16_t *words, uint16_t *codes, uint16_t *out,
+    uint8_t *flags)
+{
+    static uint8_t resps[256 + 16];
+    static int8_t red[256 + 16];
+    static uint8_t white[256 + 16];
+
+    for (uint32_t i = 0; i < 256 + 16; ++i) {
+        resps[i] = i;
+    }
+    for (size_t off = 0; off < 16; ++off) {
+        size_t n = WORDS - off, invalid;
+
+        codec_encode_requests(words + off, out, n);
+        for (size_t i = 0; i < n; ++i) {
+            if (out[i] != codec_request(words[off + i])) {
+                (void) fprintf(stderr, "bulk encode: mismatch for 0x%x\n",
+                    words[off + i]);
+                return -1;
+            }
+        }
+        invalid = codec_decode_requests(words + off, codes, flags, n);
+        for (size_t i = 0; i < n; ++i) {
+            invalid -= !codec_valid(words[off + i]);
+            if (codes[i] != codec_code(words[off + i])
+                || flags[i] != codec_valid(words[off + i])) {
+                (void) fprintf(stderr, "bulk decode: mismatch for 0x%x\n",
+                    words[off + i]);
+                return -1;
+            }
+        }
+        if (invalid != 0) {
+            (void) fprintf(stderr, "bulk decode: wrong parity error count\n");
+            return -1;
+        }
+        codec_decode_responses(resps + off, red, white, 256);
+        for (size_t i = 0; i < 256; ++i) {
+            int w;
+
+            if (red[i] != codec_decode(resps[off + i], &w) || white[i] != w) {
+                (void) fprintf(stderr, "bulk responses: mismatch for 0x%x\n",
+                    resps[off + i]);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static uint16_t words[WORDS], codes[WORDS], out[WORDS];
+    static uint8_t flags[WORDS], resps[WORDS], white[WORDS];
+    static int8_t red[WORDS];
+    uint64_t start, t_ref, t_enc, t_bulk_enc, t_dec, t_bulk_dec;
+    uint64_t t_resp, t_bulk_resp;
+    unsigned sum_ref = 0, sum_enc = 0, sum_dec = 0, sum_resp = 0;
+
+    for (uint32_t w = 0; w < WORDS; ++w) {
+        words[w] = w;
+        resps[w] = w;
+    }
+    if (report_start("codec") < 0 || check_words() < 0
+        || check_bulk(words, codes, out, flags) < 0) {
+        return EXIT_FAILURE;
+    }
+    (void) printf("all %d request words and 256 response bytes agree\n",
+        WORDS);
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        for (int i = 0; i < WORDS; ++i) {
+            sum_ref += request_ref(words[i] + r);
+        }
+    }
+    t_ref = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        for (int i = 0; i < WORDS; ++i) {
+            sum_enc += codec_request(words[i] + r);
+        }
+    }
+    t_enc = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        codec_encode_requests(words, out, WORDS);
+    }
+    t_bulk_enc = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        for (int i = 0; i < WORDS; ++i) {
+            sum_dec += codec_valid(words[i] + r) + codec_code(words[i] + r);
+        }
+    }
+    t_dec = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        sum_dec += codec_decode_requests(words, codes, flags, WORDS);
+    }
+    t_bulk_dec = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        for (int i = 0; i < WORDS; ++i) {
+            int w;
+
+            sum_resp += codec_decode(resps[i] + r, &w) + w;
+        }
+    }
+    t_resp = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        codec_decode_responses(resps, red, white, WORDS);
+    }
+    t_bulk_resp = tb_now() - start;
+
+    if (sum_ref != sum_enc) {
+        (void) fprintf(stderr, "checksums differ\n");
+        return EXIT_FAILURE;
+    }
+    (void) printf("encode, per-slot loop: %.2f codes/ns\n",
+        (double) REPEAT * WORDS / t_ref);
+    (void) printf("encode: %.2f codes/ns, bulk %.2f codes/ns\n",
+        (double) REPEAT * WORDS / t_enc,
+        (double) REPEAT * WORDS / t_bulk_enc);
+    (void) printf("decode requests: %.2f codes/ns, bulk %.2f codes/ns "
+        "(checksum %u)\n", (double) REPEAT * WORDS / t_dec,
+        (double) REPEAT * WORDS / t_bulk_dec, sum_dec);
+    (void) printf("decode responses: %.2f codes/ns, bulk %.2f codes/ns "
+        "(checksum %u)\n", (double) REPEAT * WORDS / t_resp,
+        (double) REPEAT * WORDS / t_bulk_resp, sum_resp);
+    report("encode_per_slot", (double) REPEAT * WORDS / t_ref, "codes/ns");
+    report("encode", (double) REPEAT * WORDS / t_enc, "codes/ns");
+    report("encode_bulk", (double) REPEAT * WORDS / t_bulk_enc, "codes/ns");
+    report("decode_requests", (double) REPEAT * WORDS / t_dec, "codes/ns");
+    report("decode_requests_bulk", (double) REPEAT * WORDS / t_bulk_dec,
+        "codes/ns");
+    report("decode_responses", (double) REPEAT * WORDS / t_resp, "codes/ns");
+    report("decode_responses_bulk", (double) REPEAT * WORDS / t_bulk_resp,
+        "codes/ns");
+    report_end();
+    return EXIT_SUCCESS;
+}
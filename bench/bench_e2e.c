@@ -0,0 +1,299 @@
+/*
+ * @brief end-to-end benchmark: the server and many client games on loopback
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Starts the server with random secrets, once with epoll and once with
+ * io_uring (-u), and plays a number of complete games against it on a
+ * number of concurrent lock-step connections from one epoll loop. Every
+ * guess is a random code that is consistent with the responses so far,
+ * so games are won after about six rounds and the client side costs
+ * little next to the server. Reports rounds/s, games/s and percentiles of
+ * the round latency, from sending a request until its response arrived.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "../tbucket.h"
+#include "../game.h"
+#include "../hist.h"
+#include "report.h"
+#include "util.h"
+
+/* === Constants === */
+
+#define DEFAULT_GAMES (5000)
+#define DEFAULT_CONNS (64)
+#define MAX_CONNS (1024)
+
+/* === Type Definitions === */
+
+/* A connection playing one game after another */
+struct conn {
+    int fd;
+    uint16_t guess;
+    uint64_t sent;      /* when the pending request was sent */
+    uint32_t ncands;
+    uint16_t cands[CODES]; /* secrets consistent with the responses */
+};
+
+/* What the games of a run came to */
+struct run {
+    uint32_t started;
+    uint32_t won;
+    uint32_t lost;      /* or ended with a parity error */
+    uint64_t rounds;
+    struct hist latency;
+};
+
+/* === Global Variables === */
+
+static uint8_t scores[CODES];
+
+/* === Implementations === */
+
+/**
+ * @brief Guess a random candidate and send it
+ * @param c The connection
+ * @param x State of the random generator
+ * @return 0 on success, -1 on error
+ */
+static int send_guess(struct conn *c, uint32_t *x)
+{
+    uint16_t req;
+    uint8_t buf[2];
+
+    c->guess = c->cands[bench_xorshift32(x) % c->ncands];
+    req = codec_request(c->guess);
+    buf[0] = req & 0xff;
+    buf[1] = req >> 8;
+    c->sent = tb_now();
+    return send(c->fd, buf, sizeof(buf), MSG_NOSIGNAL) == sizeof(buf)
+        ? 0 : -1;
+}
+
+/**
+ * @brief Open a connection, register it and start its game
+ * @param epfd The epoll instance
+ * @param c The connection
+ * @param port The server's port
+ * @param x State of the random generator
+ * @return 0 on success, -1 on error
+ */
+static int start_game(int epfd, struct conn *c, int port, uint32_t *x)
+{
+    struct epoll_event ev;
+
+    if ((c->fd = bench_connect(port)) < 0) {
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < CODES; ++i) {
+        c->cands[i] = i;
+    }
+    c->ncands = CODES;
+    return send_guess(c, x);
+}
+
+/**
+ * @brief Keep the candidates that give the guess its response
+ * @param c The connection
+ * @param resp The response byte
+ */
+static void filter(struct conn *c, uint8_t resp)
+{
+    uint8_t want = resp & ((1 << PARITY_ERR_BIT) - 1);
+    uint32_t kept = 0;
+
+    /* scores carry the parity of the guess in bit 6, the response not */
+    score_batch_secrets(c->guess, c->cands, scores, c->ncands);
+    for (uint32_t i = 0; i < c->ncands; ++i) {
+        c->cands[kept] = c->cands[i];
+        kept += (scores[i] & ((1 << SCORE_PARITY_BIT) - 1)) == want;
+    }
+    c->ncands = kept;
+}
+
+/**
+ * @brief Play games on a number of connections until enough are over
+ * @param port The server's port
+ * @param conns The connections
+ * @param nconns Number of connections
+ * @param games Number of games
+ * @param r Receives the outcome
+ * @return 0 on success, -1 on error
+ */
+static int run_games(int port, struct conn *conns, int nconns, uint32_t games,
+    struct run *r)
+{
+    struct epoll_event events[MAX_CONNS];
+    uint32_t x = 2463534242u, active = 0;
+    int epfd, ret = 0;
+
+    if ((epfd = epoll_create1(0)) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < nconns && r->started < games; ++i) {
+        if (start_game(epfd, &conns[i], port, &x) < 0) {
+            return -1;
+        }
+        r->started++;
+        active++;
+    }
+    while (ret == 0 && active > 0) {
+        int n = epoll_wait(epfd, events, MAX_CONNS, 1000);
+
+        if (n <= 0) {
+            ret = n < 0 && errno == EINTR ? 0 : -1;
+            continue;
+        }
+        for (int i = 0; i < n && ret == 0; ++i) {
+            struct conn *c = events[i].data.ptr;
+            uint8_t resp;
+
+            if (recv(c->fd, &resp, 1, 0) != 1) {
+                ret = -1;
+                break;
+            }
+            hist_record(&r->latency, tb_now() - c->sent, 1);
+            r->rounds++;
+            if (!game_over(resp)) {
+                filter(c, resp);
+                ret = send_guess(c, &x);
+                continue;
+            }
+            if ((resp & PIN_MASK) == SLOTS
+                && !(resp & (1 << PARITY_ERR_BIT))) {
+                r->won++;
+            } else {
+                r->lost++;
+            }
+            (void) close(c->fd);
+            if (r->started < games) {
+                ret = start_game(epfd, c, port, &x);
+                r->started++;
+            } else {
+                active--;
+            }
+        }
+    }
+    for (int i = 0; i < nconns; ++i) {
+        (void) close(conns[i].fd);
+    }
+    (void) close(epfd);
+    return ret;
+}
+
+/**
+ * @brief Benchmark both backends of the server
+ * @param argc The argument counter
+ * @param argv [server-binary [port [games [connections]]]], defaults to
+ * ./server 12400 5000 64
+ * @return EXIT_SUCCESS, EXIT_FAILURE on errors
+ */
+int main(int argc, char *argv[])
+{
+    const char *server = argc > 1 ? argv[1] : "./server";
+    const char *port_arg = argc > 2 ? argv[2] : "12400";
+    int port = strtol(port_arg, NULL, 10);
+    long games = argc > 3 ? strtol(argv[3], NULL, 10) : DEFAULT_GAMES;
+    long nconns = argc > 4 ? strtol(argv[4], NULL, 10) : DEFAULT_CONNS;
+    struct conn *conns;
+
+    if (argc > 5 || port < 1 || port > 65535 || games < 1
+        || games > UINT32_MAX || nconns < 1 || nconns > MAX_CONNS) {
+        (void) fprintf(stderr, "Usage: %s [server-binary [port [games "
+            "[connections (1-%d)]]]]\n", argv[0], MAX_CONNS);
+        return EXIT_FAILURE;
+    }
+    if (report_start("e2e") < 0) {
+        return EXIT_FAILURE;
+    }
+    if ((conns = calloc(nconns, sizeof(*conns))) == NULL) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    report("games", games, "games");
+    report("connections", nconns, "connections");
+
+    for (int uring = 0; uring < 2; ++uring) {
+        const char *name = uring ? "io_uring" : "epoll";
+        static struct run r;
+        char metric[64];
+        uint64_t start;
+        double secs;
+        pid_t pid = fork();
+        int status;
+
+        if (pid < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+        if (pid == 0) {
+            if (uring) {
+                (void) execl(server, server, "-u", port_arg, (char *) NULL);
+            } else {
+                (void) execl(server, server, port_arg, (char *) NULL);
+            }
+            perror(server);
+            _exit(127);
+        }
+        (void) memset(&r, 0, sizeof(r));
+        start = tb_now();
+        if (run_games(port, conns, nconns, games, &r) < 0) {
+            perror("games");
+            (void) kill(pid, SIGTERM);
+            return EXIT_FAILURE;
+        }
+        secs = (tb_now() - start) / 1e9;
+        (void) kill(pid, SIGTERM);
+        (void) waitpid(pid, &status, 0);
+
+        (void) printf("%-8s %ld games on %ld conns: %.0f rounds/s, "
+            "%.0f games/s, %.2f rounds/game, %u lost\n", name, games, nconns,
+            r.rounds / secs, (r.won + r.lost) / secs,
+            (double) r.rounds / (r.won + r.lost), r.lost);
+        (void) printf("%-8s latency: p50 %.1f us, p90 %.1f us, p99 %.1f us, "
+            "p99.9 %.1f us, max %.1f us\n", name,
+            hist_percentile(&r.latency, 50) / 1e3,
+            hist_percentile(&r.latency, 90) / 1e3,
+            hist_percentile(&r.latency, 99) / 1e3,
+            hist_percentile(&r.latency, 99.9) / 1e3,
+            hist_percentile(&r.latency, 100) / 1e3);
+
+        (void) snprintf(metric, sizeof(metric), "%s_rounds_per_s", name);
+        report(metric, r.rounds / secs, "rounds/s");
+        (void) snprintf(metric, sizeof(metric), "%s_games_per_s", name);
+        report(metric, (r.won + r.lost) / secs, "games/s");
+        (void) snprintf(metric, sizeof(metric), "%s_rounds_per_game", name);
+        report(metric, (double) r.rounds / (r.won + r.lost), "rounds");
+        (void) snprintf(metric, sizeof(metric), "%s_lost", name);
+        report(metric, r.lost, "games");
+        (void) snprintf(metric, sizeof(metric), "%s_latency_p50", name);
+        report(metric, hist_percentile(&r.latency, 50) / 1e3, "us");
+        (void) snprintf(metric, sizeof(metric), "%s_latency_p90", name);
+        report(metric, hist_percentile(&r.latency, 90) / 1e3, "us");
+        (void) snprintf(metric, sizeof(metric), "%s_latency_p99", name);
+        report(metric, hist_percentile(&r.latency, 99) / 1e3, "us");
+        (void) snprintf(metric, sizeof(metric), "%s_latency_p999", name);
+        report(metric, hist_percentile(&r.latency, 99.9) / 1e3, "us");
+        (void) snprintf(metric, sizeof(metric), "%s_latency_max", name);
+        report(metric, hist_percentile(&r.latency, 100) / 1e3, "us");
+    }
+    report_end();
+    free(conns);
+    return EXIT_SUCCESS;
+}
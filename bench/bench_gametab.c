@@ -0,0 +1,200 @@
+/*
+ * @brief game table scan and scoring: structure of arrays vs records
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Fills a table of GAMES games with random secrets and rounds, most of
+ * them live, once as a gametab and once as an array of 32 byte records
+ * the way the server stored game state before. Both layouts are timed
+ * for a statistics pass (count the live games past a round) and for
+ * scoring one request of every game, and have to give the same results.
+ * Starting games is timed with random secrets and a list of secrets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../tbucket.h"
+#include "../score.h"
+#include "../game.h"
+#include "../gametab.h"
+#include "../secret.h"
+#include "util.h"
+
+/* === Constants === */
+
+#define GAMES (1 << 20)
+#define REPEAT (16)
+#define MIN_ROUND (10)
+
+/* === Type Definitions === */
+
+/* A game record with the state embedded, padded like struct game */
+struct game_rec {
+    uint64_t tat;
+    const uint8_t *table;
+    int fd;
+    uint16_t secret;
+    uint8_t round;
+    uint8_t flags;
+    uint8_t resp;
+    uint8_t io[7];
+};
+
+/* === Implementations === */
+
+/**
+ * @brief Count the live records past a round
+ * @param recs The records
+ * @param n Number of records
+ * @param min_round The round
+ * @return Number of records
+ */
+static size_t count_recs(const struct game_rec *recs, size_t n,
+    uint8_t min_round)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        count += (recs[i].flags & GT_LIVE) && recs[i].round >= min_round;
+    }
+    return count;
+}
+
+/**
+ * @brief Play one round of every live record, like gametab_play()
+ * @param recs The records
+ * @param reqs n request words
+ * @param resps n responses
+ * @param n Number of records
+ * @return Number of games that are over now
+ */
+static size_t play_recs(struct game_rec *recs, const uint16_t *reqs,
+    uint8_t *resps, size_t n)
+{
+    size_t over = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        struct game_rec *g = &recs[i];
+        uint8_t resp;
+
+        if ((g->flags & (GT_LIVE | GT_OVER)) != GT_LIVE) {
+            resps[i] = 0;
+            continue;
+        }
+        resp = score_swar(reqs[i], g->secret)
+            ^ ((reqs[i] >> REQUEST_PARITY_BIT) << SCORE_PARITY_BIT);
+        if (++g->round >= MAX_TRIES
+            && ((resp & (1 << PARITY_ERR_BIT)) || (resp & 0x7) != SLOTS)) {
+            resp |= 1 << GAME_LOST_ERR_BIT;
+        }
+        if (game_over(resp)) {
+            g->flags |= GT_OVER;
+            over++;
+        }
+        g->resp = resps[i] = resp;
+    }
+    return over;
+}
+
+/**
+ * @brief Give both layouts the same random games
+ * @param t The table
+ * @param recs The records
+ * @param x State of the generator
+ */
+static void fill(struct gametab *t, struct game_rec *recs, uint32_t *x)
+{
+    for (uint32_t i = 0; i < GAMES; ++i) {
+        uint32_t r = bench_xorshift32(x);
+
+        recs[i].secret = t->secret[i] = r & CODE_MASK;
+        recs[i].round = t->round[i] = (r >> 16) % (MAX_TRIES - 1);
+        recs[i].flags = t->flags[i] = (r >> 24) % 10 != 0 ? GT_LIVE : 0;
+        recs[i].resp = t->resp[i] = 0;
+    }
+}
+
+int main(void)
+{
+    static uint16_t reqs[GAMES];
+    static uint8_t resps_tab[GAMES], resps_rec[GAMES];
+    struct game_rec *recs;
+    struct gametab tab;
+    uint64_t start, t_count_tab = 0, t_count_rec = 0;
+    uint64_t t_play_tab = 0, t_play_rec = 0;
+    size_t count_tab = 0, count_rec = 0, over_tab = 0, over_rec = 0;
+    uint32_t x = 2463534242u;
+
+    if (gametab_init(&tab, GAMES) < 0
+        || posix_memalign((void **) &recs, 64,
+            GAMES * sizeof(*recs)) != 0) {
+        perror("allocating tables");
+        return EXIT_FAILURE;
+    }
+    for (int r = 0; r < REPEAT; ++r) {
+        fill(&tab, recs, &x);
+        for (uint32_t i = 0; i < GAMES; ++i) {
+            reqs[i] = bench_xorshift32(&x);
+        }
+
+        start = tb_now();
+        count_tab += gametab_count(&tab, GAMES, MIN_ROUND);
+        t_count_tab += tb_now() - start;
+        start = tb_now();
+        count_rec += count_recs(recs, GAMES, MIN_ROUND);
+        t_count_rec += tb_now() - start;
+
+        start = tb_now();
+        over_tab += gametab_play(&tab, reqs, resps_tab, GAMES);
+        t_play_tab += tb_now() - start;
+        start = tb_now();
+        over_rec += play_recs(recs, reqs, resps_rec, GAMES);
+        t_play_rec += tb_now() - start;
+
+        for (uint32_t i = 0; i < GAMES; ++i) {
+            if (resps_tab[i] != resps_rec[i]
+                || tab.round[i] != recs[i].round
+                || tab.flags[i] != recs[i].flags) {
+                (void) fprintf(stderr, "mismatch at game %u\n", i);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    if (count_tab != count_rec || over_tab != over_rec) {
+        (void) fprintf(stderr, "results differ\n");
+        return EXIT_FAILURE;
+    }
+
+    for (int mode = 0; mode < 2; ++mode) {
+        struct secret_file list = { .codes = reqs, .count = GAMES };
+        struct secret_gen gen;
+        uint64_t t_start;
+
+        if (mode == 0) {
+            secret_gen_random(&gen, x, 0);
+        } else {
+            secret_gen_list(&gen, &list, 0, 1);
+        }
+        start = tb_now();
+        for (int r = 0; r < REPEAT; ++r) {
+            for (uint32_t i = 0; i < GAMES; ++i) {
+                gametab_start(&tab, i, secret_next(&gen), i);
+            }
+        }
+        t_start = tb_now() - start;
+        (void) printf("start (%s secrets): %.2f ns/game\n",
+            mode == 0 ? "random" : "list",
+            (double) t_start / REPEAT / GAMES);
+    }
+    (void) printf("%d games: %.1f MiB as arrays, %.1f MiB as records\n",
+        GAMES, tab.map_bytes / 1048576.0,
+        GAMES * sizeof(*recs) / 1048576.0);
+    (void) printf("count: arrays %.3f ms, records %.3f ms\n",
+        t_count_tab / 1e6 / REPEAT, t_count_rec / 1e6 / REPEAT);
+    (void) printf("play: arrays %.3f ms, records %.3f ms\n",
+        t_play_tab / 1e6 / REPEAT, t_play_rec / 1e6 / REPEAT);
+    free(recs);
+    gametab_destroy(&tab);
+    return EXIT_SUCCESS;
+}
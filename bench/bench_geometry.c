@@ -0,0 +1,235 @@
+/*
+ * @brief check and microbenchmark of the kernels of every board geometry
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * For every geometry of geometry.h checks the specialized kernels against
+ * geometry_score_ref(): all pairs of codes for 4x6, random pairs for the
+ * others, the batch and filter kernels at odd offsets and lengths, and
+ * the request words and answers including parity errors and colors out of
+ * range. Then times the reference and the specialized kernels per
+ * geometry; for 5x8 score_swar() of score.h is timed as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../tbucket.h"
+#include "../score.h"
+#include "../game.h"
+#include "../geometry.h"
+#include "util.h"
+
+/* === Constants === */
+
+#define CODES_TIMED (1 << 20)
+#define PAIRS (1 << 22)         /* pairs checked if not all of them */
+#define REPEAT (16)
+
+/* === Implementations === */
+
+/**
+ * @brief Check the score and answer kernels on one pair
+ * @param g The geometry
+ * @param guess The guess
+ * @param secret The secret
+ * @return 0 if they agree with the reference, else -1
+ */
+static int check_pair(const struct geometry *g, uint32_t guess,
+    uint32_t secret)
+{
+    uint8_t ref = geometry_score_ref(g, guess, secret);
+    uint32_t req = g->request(guess);
+    uint16_t resp = g->answer(secret, req, 1);
+
+    if (g->score(guess, secret) != ref || resp != ref
+        || (g->answer(secret, req ^ (1u << GEO_REQUEST_PARITY_BIT), 1)
+            & (1 << GEO_INVALID_BIT)) == 0
+        || (g->answer(secret, req, MAX_TRIES) & (1 << GEO_LOST_BIT))
+            != ((ref & GEO_PIN_MASK) != g->slots) << GEO_LOST_BIT) {
+        (void) fprintf(stderr, "%s: mismatch for guess 0x%x, secret 0x%x\n",
+            g->name, guess, secret);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Check the kernels of a geometry
+ * @param g The geometry
+ * @param codes All codes of g
+ * @param scratch Room for g->count codes
+ * @param scores Room for g->count scores
+ * @return 0 on success, -1 on the first mismatch
+ */
+static int check_geometry(const struct geometry *g, const uint32_t *codes,
+    uint32_t *scratch, uint8_t *scores)
+{
+    uint64_t x = 88172645463325252ULL;
+    uint32_t mask = (1u << g->shift) - 1;
+
+    if ((uint64_t) g->count * g->count <= PAIRS) {
+        for (uint32_t i = 0; i < g->count; ++i) {
+            for (uint32_t j = 0; j < g->count; ++j) {
+                if (check_pair(g, codes[i], codes[j]) < 0) {
+                    return -1;
+                }
+            }
+        }
+    } else {
+        for (uint32_t i = 0; i < PAIRS; ++i) {
+            if (check_pair(g, codes[bench_xorshift64(&x) % g->count],
+                    codes[bench_xorshift64(&x) % g->count]) < 0) {
+                return -1;
+            }
+        }
+    }
+    /* a color out of range in any slot is an invalid request */
+    for (unsigned i = 0; g->colors <= mask && i < g->slots; ++i) {
+        uint32_t code = codes[bench_xorshift64(&x) % g->count]
+            | (mask << (i * g->shift));
+
+        if (!(g->answer(codes[0], g->request(code), 1)
+                & (1 << GEO_INVALID_BIT))) {
+            (void) fprintf(stderr, "%s: color out of range in slot %u "
+                "accepted\n", g->name, i);
+            return -1;
+        }
+    }
+    for (int r = 0; r < 8; ++r) {
+        uint32_t secret = codes[bench_xorshift64(&x) % g->count];
+        size_t off = bench_xorshift64(&x) % 16, n = g->count - off - r;
+        size_t kept, expect = 0;
+
+        g->score_batch(secret, codes + off, scores, n);
+        for (size_t i = 0; i < n; ++i) {
+            if (scores[i] != g->score(codes[off + i], secret)) {
+                (void) fprintf(stderr, "%s: batch mismatch for 0x%x\n",
+                    g->name, codes[off + i]);
+                return -1;
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            scratch[i] = codes[off + i];
+        }
+        kept = g->filter(secret, scores[n / 2], scratch, n);
+        for (size_t i = 0; i < n; ++i) {
+            if (scores[i] == scores[n / 2]) {
+                if (expect >= kept || scratch[expect] != codes[off + i]) {
+                    (void) fprintf(stderr, "%s: filter mismatch\n", g->name);
+                    return -1;
+                }
+                expect++;
+            }
+        }
+        if (expect != kept) {
+            (void) fprintf(stderr, "%s: filter kept too many\n", g->name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Time the kernels of a geometry and print the results
+ * @param g The geometry
+ * @param codes All codes of g
+ * @param timed CODES_TIMED random codes of g
+ * @param scores Room for CODES_TIMED scores
+ */
+static void time_geometry(const struct geometry *g, const uint32_t *codes,
+    const uint32_t *timed, uint8_t *scores)
+{
+    uint32_t secret = codes[g->count / 3];
+    uint64_t start, t_ref, t_score, t_batch, t_answer, t_swar = 0;
+    unsigned sum_ref = 0, sum = 0;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        for (int i = 0; i < CODES_TIMED; ++i) {
+            sum_ref += geometry_score_ref(g, timed[i], secret);
+        }
+    }
+    t_ref = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        for (int i = 0; i < CODES_TIMED; ++i) {
+            sum += g->score(timed[i], secret);
+        }
+    }
+    t_score = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        g->score_batch(secret, timed, scores, CODES_TIMED);
+    }
+    t_batch = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        for (int i = 0; i < CODES_TIMED; ++i) {
+            sum += g->answer(secret, g->request(timed[i]), 1 + (i & 15));
+        }
+    }
+    t_answer = tb_now() - start;
+
+    if (g->slots == SLOTS && g->colors == COLORS) {
+        start = tb_now();
+        for (int r = 0; r < REPEAT; ++r) {
+            for (int i = 0; i < CODES_TIMED; ++i) {
+                sum += score_swar(timed[i], secret);
+            }
+        }
+        t_swar = tb_now() - start;
+    }
+
+    (void) printf("%-5s reference %6.2f ns, kernel %5.2f ns, batch %5.2f "
+        "codes/ns, request + answer %5.2f ns", g->name,
+        (double) t_ref / REPEAT / CODES_TIMED,
+        (double) t_score / REPEAT / CODES_TIMED,
+        (double) REPEAT * CODES_TIMED / t_batch,
+        (double) t_answer / REPEAT / CODES_TIMED);
+    if (t_swar > 0) {
+        (void) printf(", score_swar %5.2f ns",
+            (double) t_swar / REPEAT / CODES_TIMED);
+    }
+    (void) printf(" (checksum %u)\n", sum_ref ^ sum);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t *timed = malloc(CODES_TIMED * sizeof(*timed));
+    uint8_t *scores = NULL;
+    uint64_t x = 2463534242ULL;
+
+    if (timed == NULL) {
+        (void) fprintf(stderr, "allocating codes\n");
+        return EXIT_FAILURE;
+    }
+    for (unsigned id = 0; id < GEO_COUNT; ++id) {
+        const struct geometry *g = geometry_get(id);
+        uint32_t *codes = malloc(g->count * sizeof(*codes));
+        uint32_t *scratch = malloc(g->count * sizeof(*scratch));
+
+        scores = realloc(scores, g->count > CODES_TIMED ? g->count
+            : CODES_TIMED);
+        if (codes == NULL || scratch == NULL || scores == NULL) {
+            (void) fprintf(stderr, "allocating codes\n");
+            return EXIT_FAILURE;
+        }
+        geometry_enumerate(g, codes);
+        if (check_geometry(g, codes, scratch, scores) < 0) {
+            return EXIT_FAILURE;
+        }
+        for (int i = 0; i < CODES_TIMED; ++i) {
+            timed[i] = geometry_code(g, bench_xorshift64(&x));
+        }
+        time_geometry(g, codes, timed, scores);
+        free(codes);
+        free(scratch);
+    }
+    free(timed);
+    free(scores);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+/*
+ * @brief round latency and throughput of the server's I/O backends
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Starts the server once with epoll and once with io_uring (-u) and plays
+ * lock-step games on an increasing number of loopback connections from a
+ * single thread. Every game guesses a code the secret does not contain,
+ * so it lasts MAX_TRIES rounds and is then replaced by a new connection.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "../tbucket.h"
+#include "../game.h"
+#include "util.h"
+
+/* === Constants === */
+
+#define SECRET "wwrgb"
+#define GUESS "ddddd"
+#define SECONDS (2)
+#define MAX_CONNS (256)
+
+/* === Type Definitions === */
+
+struct conn {
+    int fd;
+    uint64_t sent;      /* when the pending request was sent */
+};
+
+/* === Global Variables === */
+
+static const int conn_counts[] = { 1, 16, 64, 256 };
+
+static uint32_t *samples;
+static size_t nsamples;
+static size_t max_samples;
+
+/* === Implementations === */
+
+/**
+ * @brief Compare two latency samples for qsort
+ * @param a First sample
+ * @param b Second sample
+ * @return Order of the samples
+ */
+static int cmp_samples(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Send the request of a connection and remember when
+ * @param c The connection
+ * @param req The request word
+ * @return 0 on success, -1 on error
+ */
+static int send_request(struct conn *c, uint16_t req)
+{
+    uint8_t buf[2] = { req & 0xff, req >> 8 };
+
+    c->sent = tb_now();
+    return send(c->fd, buf, sizeof(buf), MSG_NOSIGNAL) == sizeof(buf) ? 0 : -1;
+}
+
+/**
+ * @brief Open a connection, register it and send its first request
+ * @param epfd The epoll instance
+ * @param c The connection
+ * @param port The server's port
+ * @param req The request word
+ * @return 0 on success, -1 on error
+ */
+static int open_conn(int epfd, struct conn *c, int port, uint16_t req)
+{
+    struct epoll_event ev;
+
+    if ((c->fd = bench_connect(port)) < 0) {
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+        return -1;
+    }
+    return send_request(c, req);
+}
+
+/**
+ * @brief Play lock-step games on a number of connections for a while
+ * @param port The server's port
+ * @param nconns Number of connections
+ * @param req The request word every round sends
+ * @return 0 on success, -1 on error
+ */
+static int run_load(int port, int nconns, uint16_t req)
+{
+    static struct conn conns[MAX_CONNS];
+    struct epoll_event events[MAX_CONNS];
+    uint64_t end;
+    int epfd, ret = 0;
+
+    if ((epfd = epoll_create1(0)) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < nconns; ++i) {
+        if (open_conn(epfd, &conns[i], port, req) < 0) {
+            return -1;
+        }
+    }
+
+    nsamples = 0;
+    end = tb_now() + SECONDS * NSEC_PER_SEC;
+    while (ret == 0 && tb_now() < end) {
+        int n = epoll_wait(epfd, events, MAX_CONNS, 100);
+
+        for (int i = 0; i < n && ret == 0; ++i) {
+            struct conn *c = events[i].data.ptr;
+            uint8_t resp;
+            uint64_t now;
+
+            if (recv(c->fd, &resp, 1, 0) != 1) {
+                ret = -1;
+                break;
+            }
+            now = tb_now();
+            if (nsamples == max_samples) {
+                max_samples = max_samples ? 2 * max_samples : 1 << 20;
+                if ((samples = realloc(samples,
+                        max_samples * sizeof(*samples))) == NULL) {
+                    ret = -1;
+                    break;
+                }
+            }
+            samples[nsamples++] = now - c->sent > UINT32_MAX
+                ? UINT32_MAX : now - c->sent;
+
+            if (game_over(resp)) {
+                (void) close(c->fd);
+                ret = open_conn(epfd, c, port, req);
+            } else {
+                ret = send_request(c, req);
+            }
+        }
+    }
+    for (int i = 0; i < nconns; ++i) {
+        (void) close(conns[i].fd);
+    }
+    (void) close(epfd);
+    return ret;
+}
+
+/**
+ * @brief Benchmark both backends
+ * @param argc The argument counter
+ * @param argv [server-binary [port]], defaults to ./server 12399
+ * @return EXIT_SUCCESS, EXIT_FAILURE on errors
+ */
+int main(int argc, char *argv[])
+{
+    const char *server = argc > 1 ? argv[1] : "./server";
+    const char *port_arg = argc > 2 ? argv[2] : "12399";
+    int port = strtol(port_arg, NULL, 10);
+    uint16_t guess;
+    double peak[2] = { 0, 0 };
+
+    if (argc > 3 || port < 1 || port > 65535
+        || score_parse(GUESS, &guess) < 0) {
+        (void) fprintf(stderr, "Usage: %s [server-binary [port]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    uint16_t req = codec_request(guess);
+
+    for (int uring = 0; uring < 2; ++uring) {
+        for (size_t k = 0; k < sizeof(conn_counts) / sizeof(conn_counts[0]);
+                ++k) {
+            pid_t pid = fork();
+            int status;
+
+            if (pid < 0) {
+                perror("fork");
+                return EXIT_FAILURE;
+            }
+            if (pid == 0) {
+                if (uring) {
+                    (void) execl(server, server, "-u", port_arg, SECRET,
+                        (char *) NULL);
+                } else {
+                    (void) execl(server, server, port_arg, SECRET,
+                        (char *) NULL);
+                }
+                perror(server);
+                _exit(127);
+            }
+            if (run_load(port, conn_counts[k], req) < 0) {
+                perror("load");
+                (void) kill(pid, SIGTERM);
+                return EXIT_FAILURE;
+            }
+            (void) kill(pid, SIGTERM);
+            (void) waitpid(pid, &status, 0);
+
+            qsort(samples, nsamples, sizeof(*samples), cmp_samples);
+            double rate = nsamples / (double) SECONDS;
+            if (rate > peak[uring]) {
+                peak[uring] = rate;
+            }
+            (void) printf("%-8s %3d conns: %8.0f rounds/s, "
+                "p50 %7.1f us, p99 %7.1f us\n",
+                uring ? "io_uring" : "epoll", conn_counts[k], rate,
+                nsamples ? samples[nsamples / 2] / 1e3 : 0.0,
+                nsamples ? samples[nsamples * 99 / 100] / 1e3 : 0.0);
+        }
+    }
+    (void) printf("peak: epoll %.0f rounds/s, io_uring %.0f rounds/s\n",
+        peak[0], peak[1]);
+    free(samples);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,309 @@
+/*
+ * @brief snapshots of the game table and restarts of the server
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Fills a table of GAMES live games and times writing it as a snapshot
+ * (see snapshot.h) directly and from a forked child, and how much slower
+ * a scoring pass over the table gets while the child writes, as that is
+ * what the server's workers pay for a snapshot. Then maps the snapshot,
+ * claims every game with its token and checks the states, and finally
+ * starts the server on the snapshot and times it from the fork until it
+ * resumed the first game, compared to a start without one. A sample of
+ * the games is resumed over the network and checked as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "../tbucket.h"
+#include "../game.h"
+#include "../gametab.h"
+#include "../snapshot.h"
+#include "util.h"
+
+/* === Constants === */
+
+#define GAMES (1 << 20)
+#define SECTION (0)
+#define KEY (0x9e3779b97f4a7c15ULL)
+#define MAX_ROUND (8)           /* rounds of the games, below MAX_TRIES */
+#define PASSES (4)              /* scoring passes timed */
+#define SAMPLES (1000)          /* games resumed over the network */
+
+/* === Implementations === */
+
+/**
+ * @brief Time scoring passes over the table
+ * @param tab The table
+ * @param reqs Requests of the games
+ * @param resps Receives the responses
+ * @return Nanoseconds per pass
+ */
+static uint64_t time_passes(struct gametab *tab, const uint16_t *reqs,
+    uint8_t *resps)
+{
+    uint64_t start = tb_now();
+
+    for (int p = 0; p < PASSES; ++p) {
+        (void) gametab_play(tab, reqs, resps, GAMES);
+        /* keep the games going: rounds low, none won or lost */
+        for (uint32_t i = 0; i < GAMES; ++i) {
+            tab->round[i] -= tab->round[i] > 1;
+            tab->flags[i] = GT_LIVE;
+        }
+    }
+    return (tb_now() - start) / PASSES;
+}
+
+/**
+ * @brief Send and receive exactly
+ * @param fd The socket
+ * @param out Bytes to send
+ * @param nout Their number
+ * @param in Receives the answer
+ * @param nin Its size
+ * @return 0 on success, -1 on error
+ */
+static int exchange(int fd, const uint8_t *out, size_t nout, uint8_t *in,
+    size_t nin)
+{
+    size_t got = 0;
+
+    if (send(fd, out, nout, MSG_NOSIGNAL) != (ssize_t) nout) {
+        return -1;
+    }
+    while (got < nin) {
+        ssize_t r = recv(fd, in + got, nin - got, 0);
+
+        if (r <= 0) {
+            return -1;
+        }
+        got += r;
+    }
+    return 0;
+}
+
+/**
+ * @brief Resume a game of the snapshot on the server
+ * @param port The server's port
+ * @param tab The table the snapshot was written from
+ * @param idx Index of the game
+ * @return 0 if the server resumed it in its state, -1 otherwise
+ */
+static int resume_game(int port, const struct gametab *tab, uint32_t idx)
+{
+    uint8_t hello[2 + GAME_TOKEN_BYTES] = {
+        RESUME_HELLO & 0xff, RESUME_HELLO >> 8
+    };
+    uint8_t resp[RESUME_RESP_BYTES];
+    struct snap_token token;
+    int fd, ret;
+
+    snapshot_token(&token, KEY, SECTION, idx, tab->conn[idx]);
+    snapshot_token_pack(&token, &hello[2]);
+    if ((fd = bench_connect(port)) < 0) {
+        return -1;
+    }
+    ret = exchange(fd, hello, sizeof(hello), resp, sizeof(resp)) == 0
+        && resp[0] == TOKEN_ACK
+        && resp[TOKEN_RESP_BYTES] == tab->round[idx]
+        && resp[TOKEN_RESP_BYTES + 1] == tab->resp[idx] ? 0 : -1;
+    (void) close(fd);
+    return ret;
+}
+
+/**
+ * @brief Start the server and time it until it resumed a game
+ * @param server The server binary
+ * @param port_arg The port
+ * @param path The snapshot, NULL to time until it accepts a connection
+ * @param tab The table the snapshot was written from
+ * @param pid Receives the server's process id
+ * @return Nanoseconds until it served, 0 on errors
+ */
+static uint64_t start_server(const char *server, const char *port_arg,
+    const char *path, const struct gametab *tab, pid_t *pid)
+{
+    int port = strtol(port_arg, NULL, 10);
+    uint64_t start = tb_now();
+    int fd;
+
+    if ((*pid = fork()) < 0) {
+        perror("fork");
+        return 0;
+    }
+    if (*pid == 0) {
+        if (path != NULL) {
+            (void) execl(server, server, "-k", path, port_arg, (char *) NULL);
+        } else {
+            (void) execl(server, server, port_arg, (char *) NULL);
+        }
+        perror(server);
+        _exit(127);
+    }
+    if (path != NULL) {
+        return resume_game(port, tab, 0) == 0 ? tb_now() - start : 0;
+    }
+    if ((fd = bench_connect(port)) < 0) {
+        return 0;
+    }
+    (void) close(fd);
+    return tb_now() - start;
+}
+
+/**
+ * @brief Stop a server
+ * @param pid Its process id
+ */
+static void stop_server(pid_t pid)
+{
+    int status;
+
+    (void) kill(pid, SIGTERM);
+    (void) waitpid(pid, &status, 0);
+}
+
+/**
+ * @brief Benchmark snapshots and restarts
+ * @param argc The argument counter
+ * @param argv [server-binary [port [snapshot-file]]], defaults to
+ * ./server 12398 /tmp/bench_resume.mms
+ * @return EXIT_SUCCESS, EXIT_FAILURE on errors
+ */
+int main(int argc, char *argv[])
+{
+    const char *server = argc > 1 ? argv[1] : "./server";
+    const char *port_arg = argc > 2 ? argv[2] : "12398";
+    const char *path = argc > 3 ? argv[3] : "/tmp/bench_resume.mms";
+    int port = strtol(port_arg, NULL, 10);
+    struct snap_table table = { .id = SECTION, .count = GAMES };
+    struct gametab tab;
+    struct snapshot snap;
+    uint16_t *reqs;
+    uint8_t *resps;
+    uint32_t x = 2463534242u;
+    uint64_t start, direct, forked, idle, during, opened, claimed;
+    uint64_t served, baseline;
+    int status, bad = 0;
+    pid_t pid;
+
+    if (argc > 4 || port < 1 || port > 65535) {
+        (void) fprintf(stderr, "Usage: %s [server-binary [port "
+            "[snapshot-file]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    reqs = malloc(GAMES * sizeof(*reqs));
+    resps = malloc(GAMES);
+    if (reqs == NULL || resps == NULL || gametab_init(&tab, GAMES) < 0) {
+        (void) fprintf(stderr, "allocating tables\n");
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < GAMES; ++i) {
+        gametab_start(&tab, i, bench_xorshift32(&x) & 0x7fff, bench_xorshift32(&x));
+        tab.round[i] = 1 + bench_xorshift32(&x) % MAX_ROUND;
+        tab.resp[i] = bench_xorshift32(&x) & 0x3f;
+        reqs[i] = codec_request(bench_xorshift32(&x) & 0x7fff);
+    }
+    table.tab = &tab;
+
+    start = tb_now();
+    if (snapshot_write(path, KEY, 0, &table, 1) < 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    direct = tb_now() - start;
+
+    /* what a worker pays: fork() and the pages it writes meanwhile */
+    idle = time_passes(&tab, reqs, resps);
+    start = tb_now();
+    if ((pid = fork()) == 0) {
+        _exit(snapshot_write(path, KEY, 0, &table, 1) < 0
+            ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    forked = tb_now() - start;
+    during = time_passes(&tab, reqs, resps);
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+        || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        (void) fprintf(stderr, "forked snapshot failed\n");
+        return EXIT_FAILURE;
+    }
+    /* the child saw the table as it was at fork(), write that one */
+    if (snapshot_write(path, KEY, 0, &table, 1) < 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    start = tb_now();
+    if (snapshot_open(&snap, path) < 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    opened = tb_now() - start;
+    start = tb_now();
+    for (uint32_t i = 0; i < GAMES; ++i) {
+        struct snap_token token;
+        struct snap_game game;
+
+        snapshot_token(&token, KEY, SECTION, i, tab.conn[i]);
+        if (snapshot_claim(&snap, &token, &game) < 0
+            || game.secret != tab.secret[i] || game.round != tab.round[i]
+            || game.resp != tab.resp[i]
+            || snapshot_claim(&snap, &token, &game) == 0) {
+            bad++;
+        }
+    }
+    claimed = tb_now() - start;
+    snapshot_close(&snap);
+
+    (void) printf("%d games, %.1f MiB snapshot\n", GAMES,
+        (GAMES * 9 + sizeof(struct snap_header)) / 1048576.0);
+    (void) printf("write: %.2f ms, fork: %.3f ms\n", direct / 1e6,
+        forked / 1e6);
+    (void) printf("scoring pass: %.2f ms idle, %.2f ms while the child "
+        "writes\n", idle / 1e6, during / 1e6);
+    (void) printf("restore: map %.3f ms, claim %.1f ns/game, %d bad\n",
+        opened / 1e6, claimed / (double) GAMES, bad);
+
+    /* the server keeps the games it was not asked for, rewrite the file
+       for every start */
+    if ((baseline = start_server(server, port_arg, NULL, NULL, &pid)) == 0) {
+        (void) fprintf(stderr, "server did not start\n");
+        stop_server(pid);
+        return EXIT_FAILURE;
+    }
+    stop_server(pid);
+    if (snapshot_write(path, KEY, 0, &table, 1) < 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    if ((served = start_server(server, port_arg, path, &tab, &pid)) == 0) {
+        (void) fprintf(stderr, "server did not resume\n");
+        stop_server(pid);
+        return EXIT_FAILURE;
+    }
+    start = tb_now();
+    for (uint32_t i = 1; i <= SAMPLES; ++i) {
+        if (resume_game(port, &tab, i * (GAMES / (SAMPLES + 1))) < 0) {
+            bad++;
+        }
+    }
+    (void) printf("restart to serving: %.1f ms with %d games, %.1f ms "
+        "without a snapshot\n", served / 1e6, GAMES, baseline / 1e6);
+    (void) printf("resume over the network: %.1f us/game, %d bad\n",
+        (tb_now() - start) / 1e3 / SAMPLES, bad);
+    stop_server(pid);
+    (void) unlink(path);
+
+    gametab_destroy(&tab);
+    free(reqs);
+    free(resps);
+    return bad > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
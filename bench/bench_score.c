@@ -0,0 +1,171 @@
+/*
+ * @brief microbenchmark of the scoring: reference loop, table, batch kernels
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../tbucket.h"
+#include "../score.h"
+#include "../codec.h"
+#include "report.h"
+#include "util.h"
+
+/* === Constants === */
+
+#define REQUESTS (1 << 20)
+#define REPEAT (16)
+#define EQUIV_ROUNDS (64)
+
+/* === Implementations === */
+
+/**
+ * @brief Check the branchless and batch kernels against score_ref()
+ * @param codes Scratch space for REQUESTS codes
+ * @param scores Scratch space for REQUESTS scores
+ * @return 0 if all scores are identical, else -1
+ */
+static int check_kernels(uint16_t *codes, uint8_t *scores)
+{
+    uint32_t x = 88172645u;
+
+    for (int r = 0; r < EQUIV_ROUNDS; ++r) {
+        uint16_t fixed = bench_xorshift32(&x);
+        /* odd lengths and offsets exercise the scalar tails */
+        size_t off = bench_xorshift32(&x) % 16;
+        size_t n = REQUESTS / EQUIV_ROUNDS - bench_xorshift32(&x) % 64;
+
+        for (size_t i = 0; i < n; ++i) {
+            codes[off + i] = bench_xorshift32(&x);
+        }
+        score_batch_guesses(fixed, codes + off, scores, n);
+        for (size_t i = 0; i < n; ++i) {
+            uint8_t ref = score_ref(codes[off + i], fixed & CODE_MASK);
+            if (scores[i] != ref
+                || score_swar(codes[off + i], fixed) != ref) {
+                (void) fprintf(stderr, "mismatch: guess 0x%x, secret 0x%x\n",
+                    codes[off + i], fixed);
+                return -1;
+            }
+        }
+        score_batch_secrets(fixed, codes + off, scores, n);
+        for (size_t i = 0; i < n; ++i) {
+            if (scores[i] != score_ref(fixed, codes[off + i] & CODE_MASK)) {
+                (void) fprintf(stderr, "mismatch: guess 0x%x, secret 0x%x\n",
+                    fixed, codes[off + i]);
+                return -1;
+            }
+        }
+        /* the codes shifted by one slot serve as the secrets */
+        score_batch_pairs(codes + off, codes + off + 1, scores, n - 1);
+        for (size_t i = 0; i + 1 < n; ++i) {
+            if (scores[i] != score_ref(codes[off + i],
+                    codes[off + i + 1] & CODE_MASK)) {
+                (void) fprintf(stderr, "mismatch: guess 0x%x, secret 0x%x\n",
+                    codes[off + i], codes[off + i + 1]);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Score a request the way compute_answer() did before the table
+ * @param secret The packed secret
+ * @param req The request word
+ * @return The response byte
+ */
+static uint8_t answer_ref(uint16_t secret, uint16_t req)
+{
+    return score_ref(req, secret)
+        ^ ((req >> REQUEST_PARITY_BIT) << SCORE_PARITY_BIT);
+}
+
+int main(int argc, char *argv[])
+{
+    static uint16_t reqs[REQUESTS + 16];
+    static uint8_t scores[REQUESTS];
+    static uint8_t table[CODES];
+    uint64_t start, t_ref, t_table, t_build, t_swar, t_batch;
+    unsigned sum_ref = 0, sum_table = 0, sum_swar = 0;
+    uint32_t x = 2463534242u;
+    const uint16_t secret = 012345;
+
+    if (report_start("score") < 0 || check_kernels(reqs, scores) < 0) {
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < REQUESTS; ++i) {
+        reqs[i] = bench_xorshift32(&x);
+    }
+
+    start = tb_now();
+    for (int i = 0; i < REPEAT; ++i) {
+        score_table_build(secret + i, table);
+    }
+    t_build = (tb_now() - start) / REPEAT;
+    score_table_build(secret, table);
+
+    /* both paths have to agree on every possible request word */
+    for (uint32_t req = 0; req <= UINT16_MAX; ++req) {
+        if (answer_ref(secret, req) != score_lookup(table, req)) {
+            (void) fprintf(stderr, "mismatch for request 0x%x\n", req);
+            return EXIT_FAILURE;
+        }
+    }
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        for (int i = 0; i < REQUESTS; ++i) {
+            sum_ref += answer_ref(secret, reqs[i]);
+        }
+    }
+    t_ref = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        for (int i = 0; i < REQUESTS; ++i) {
+            sum_table += score_lookup(table, reqs[i]);
+        }
+    }
+    t_table = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        for (int i = 0; i < REQUESTS; ++i) {
+            sum_swar += score_swar(reqs[i], secret)
+                ^ ((reqs[i] >> REQUEST_PARITY_BIT) << SCORE_PARITY_BIT);
+        }
+    }
+    t_swar = tb_now() - start;
+
+    start = tb_now();
+    for (int r = 0; r < REPEAT; ++r) {
+        score_batch_guesses(secret, reqs, scores, REQUESTS);
+    }
+    t_batch = tb_now() - start;
+
+    if (sum_ref != sum_table || sum_ref != sum_swar) {
+        (void) fprintf(stderr, "checksums differ\n");
+        return EXIT_FAILURE;
+    }
+    (void) printf("table build: %.1f us\n", t_build / 1e3);
+    (void) printf("reference: %.2f ns/answer\n",
+        (double) t_ref / REPEAT / REQUESTS);
+    (void) printf("table: %.2f ns/answer\n",
+        (double) t_table / REPEAT / REQUESTS);
+    (void) printf("swar: %.2f ns/answer\n",
+        (double) t_swar / REPEAT / REQUESTS);
+    (void) printf("batch (%s): %.2f ns/score\n",
+        __builtin_cpu_supports("avx2") ? "avx2" : "sse2",
+        (double) t_batch / REPEAT / REQUESTS);
+    report("table_build", t_build / 1e3, "us");
+    report("reference", (double) t_ref / REPEAT / REQUESTS, "ns/answer");
+    report("table", (double) t_table / REPEAT / REQUESTS, "ns/answer");
+    report("swar", (double) t_swar / REPEAT / REQUESTS, "ns/answer");
+    report("batch", (double) t_batch / REPEAT / REQUESTS, "ns/score");
+    report_end();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+/*
+ * @brief round latency and throughput over shared memory against TCP
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Starts the server with a fixed secret and a shared-memory socket and
+ * plays lock-step games on a number of client threads, each with a
+ * connection of its own, for a fixed time: over loopback TCP, over
+ * shared-memory channels that sleep on their eventfds when idle, and over
+ * channels that both sides busy-poll (server -B, client --busy-poll).
+ * Guesses are random codes other than the secret, so every game takes
+ * MAX_TRIES rounds and the client side costs next to nothing. Reports
+ * rounds/s and percentiles of the round latency, from writing a request
+ * until its response was read. Busy-polling pays off only with a core
+ * each for the server and every client thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "../tbucket.h"
+#include "../game.h"
+#include "../hist.h"
+#include "../shm.h"
+#include "report.h"
+#include "util.h"
+
+/* === Constants === */
+
+#define DEFAULT_SECS (2)
+#define DEFAULT_THREADS (1)
+#define MAX_THREADS (64)
+#define SHM_PATH "/tmp/mm-bench-shm.sock"
+
+/* === Type Definitions === */
+
+enum mode { MODE_TCP, MODE_SHM, MODE_BUSY };
+
+/* A client thread and what its games came to */
+struct player {
+    pthread_t thread;
+    enum mode mode;
+    int port;
+    uint64_t until;     /* stop playing at this tb_now() */
+    uint32_t seed;
+    int failed;
+    uint64_t rounds;
+    struct hist latency;
+};
+
+/* === Global Variables === */
+
+static uint16_t secret;
+
+/* === Implementations === */
+
+/**
+ * @brief Connect to the server, retrying while it starts up
+ * @param p The player
+ * @param c Receives the channel unless the mode is MODE_TCP
+ * @return The socket or -1
+ */
+static int connect_server(const struct player *p, struct shm_chan *c)
+{
+    int one = 1, fd;
+
+    if (p->mode == MODE_TCP) {
+        if ((fd = bench_connect(p->port)) >= 0) {
+            (void) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one,
+                sizeof(one));
+        }
+        return fd;
+    }
+    for (int tries = 0; tries < 100; ++tries) {
+        if (shm_connect(c, SHM_PATH,
+                p->mode == MODE_BUSY ? UINT32_MAX : SHM_SPIN) == 0) {
+            return c->sock;
+        }
+        (void) usleep(10000);
+    }
+    return -1;
+}
+
+/**
+ * @brief Play one round
+ * @param p The player
+ * @param fd The socket
+ * @param c The channel unless the mode is MODE_TCP
+ * @param x State of the random generator
+ * @param resp Receives the response
+ * @return 0 on success, -1 on error
+ */
+static int play_round(struct player *p, int fd, struct shm_chan *c,
+    uint32_t *x, uint8_t *resp)
+{
+    uint16_t guess, req;
+    uint8_t buf[2];
+    uint64_t sent;
+
+    do {
+        guess = bench_xorshift32(x) % CODES;
+    } while (guess == secret);
+    req = codec_request(guess);
+    buf[0] = req & 0xff;
+    buf[1] = req >> 8;
+    sent = tb_now();
+    if (p->mode != MODE_TCP) {
+        if (shm_send(c, buf, sizeof(buf)) < 0 || shm_recv(c, resp, 1) < 0) {
+            return -1;
+        }
+    } else if (send(fd, buf, sizeof(buf), MSG_NOSIGNAL) != sizeof(buf)
+        || recv(fd, resp, 1, 0) != 1) {
+        return -1;
+    }
+    hist_record(&p->latency, tb_now() - sent, 1);
+    p->rounds++;
+    return 0;
+}
+
+/**
+ * @brief Thread function: play games until the time is up
+ * @param arg The player
+ * @return NULL
+ */
+static void *run_player(void *arg)
+{
+    struct player *p = arg;
+    uint32_t x = p->seed;
+
+    while (tb_now() < p->until) {
+        struct shm_chan c;
+        uint8_t resp = 0;
+        int fd = connect_server(p, &c);
+
+        if (fd < 0) {
+            p->failed = 1;
+            return NULL;
+        }
+        while (!game_over(resp)) {
+            if (play_round(p, fd, &c, &x, &resp) < 0) {
+                p->failed = 1;
+                break;
+            }
+        }
+        if (p->mode != MODE_TCP) {
+            shm_close(&c);
+        }
+        (void) close(fd);
+        if (p->failed) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Benchmark TCP and both kinds of shared-memory channels
+ * @param argc The argument counter
+ * @param argv [server-binary [port [seconds [threads]]]], defaults to
+ * ./server 12410 2 1
+ * @return EXIT_SUCCESS, EXIT_FAILURE on errors
+ */
+int main(int argc, char *argv[])
+{
+    static const char *names[] = { "tcp", "shm", "shm_busy" };
+    static struct player players[MAX_THREADS];
+    const char *server = argc > 1 ? argv[1] : "./server";
+    const char *port_arg = argc > 2 ? argv[2] : "12410";
+    int port = strtol(port_arg, NULL, 10);
+    long secs = argc > 3 ? strtol(argv[3], NULL, 10) : DEFAULT_SECS;
+    long nthreads = argc > 4 ? strtol(argv[4], NULL, 10) : DEFAULT_THREADS;
+    /* wwrgb, as in the server's usage */
+    uint8_t colors[SLOTS] = { 7, 7, 4, 2, 0 };
+
+    if (argc > 5 || port < 1 || port > 65535 || secs < 1 || secs > 3600
+        || nthreads < 1 || nthreads > MAX_THREADS) {
+        (void) fprintf(stderr, "Usage: %s [server-binary [port [seconds "
+            "[threads (1-%d)]]]]\n", argv[0], MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+    if (report_start("shm") < 0) {
+        return EXIT_FAILURE;
+    }
+    secret = score_pack(colors);
+    report("threads", nthreads, "threads");
+
+    for (int mode = MODE_TCP; mode <= MODE_BUSY; ++mode) {
+        const char *name = names[mode];
+        struct hist latency;
+        uint64_t rounds = 0, start;
+        char metric[64];
+        double elapsed;
+        int failed = 0, status;
+        pid_t pid = fork();
+
+        if (pid < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+        if (pid == 0) {
+            if (mode == MODE_BUSY) {
+                (void) execl(server, server, "-U", SHM_PATH, "-B", "-t", "0",
+                    port_arg, "wwrgb", (char *) NULL);
+            } else {
+                (void) execl(server, server, "-U", SHM_PATH, "-t", "0",
+                    port_arg, "wwrgb", (char *) NULL);
+            }
+            perror(server);
+            _exit(127);
+        }
+        /* let the server bind before the clock starts */
+        (void) usleep(200000);
+        start = tb_now();
+        for (long i = 0; i < nthreads; ++i) {
+            struct player *p = &players[i];
+
+            (void) memset(p, 0, sizeof(*p));
+            p->mode = mode;
+            p->port = port;
+            p->until = start + secs * 1000000000ULL;
+            p->seed = 2463534242u + i;
+            if ((errno = pthread_create(&p->thread, NULL, run_player,
+                    p)) != 0) {
+                perror("pthread_create");
+                (void) kill(pid, SIGTERM);
+                return EXIT_FAILURE;
+            }
+        }
+        (void) memset(&latency, 0, sizeof(latency));
+        for (long i = 0; i < nthreads; ++i) {
+            (void) pthread_join(players[i].thread, NULL);
+            failed |= players[i].failed;
+            rounds += players[i].rounds;
+            hist_merge(&latency, &players[i].latency);
+        }
+        elapsed = (tb_now() - start) / 1e9;
+        (void) kill(pid, SIGTERM);
+        (void) waitpid(pid, &status, 0);
+        if (failed) {
+            (void) fprintf(stderr, "%s: a game failed\n", name);
+            return EXIT_FAILURE;
+        }
+
+        (void) printf("%-8s %ld threads: %.0f rounds/s\n", name, nthreads,
+            rounds / elapsed);
+        (void) printf("%-8s latency: p50 %.2f us, p90 %.2f us, p99 %.2f us, "
+            "p99.9 %.2f us, max %.1f us\n", name,
+            hist_percentile(&latency, 50) / 1e3,
+            hist_percentile(&latency, 90) / 1e3,
+            hist_percentile(&latency, 99) / 1e3,
+            hist_percentile(&latency, 99.9) / 1e3,
+            hist_percentile(&latency, 100) / 1e3);
+
+        (void) snprintf(metric, sizeof(metric), "%s_rounds_per_s", name);
+        report(metric, rounds / elapsed, "rounds/s");
+        (void) snprintf(metric, sizeof(metric), "%s_latency_p50", name);
+        report(metric, hist_percentile(&latency, 50) / 1e3, "us");
+        (void) snprintf(metric, sizeof(metric), "%s_latency_p99", name);
+        report(metric, hist_percentile(&latency, 99) / 1e3, "us");
+        (void) snprintf(metric, sizeof(metric), "%s_latency_max", name);
+        report(metric, hist_percentile(&latency, 100) / 1e3, "us");
+    }
+    report_end();
+    return EXIT_SUCCESS;
+}
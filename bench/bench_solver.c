@@ -0,0 +1,82 @@
+/*
+ * @brief speedup of the solver's parallel guess selection
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "../tbucket.h"
+#include "../solver.h"
+
+/* === Constants === */
+
+#define REPEAT (3)
+
+/* === Implementations === */
+
+/**
+ * @brief Time the selection of the second guess with 1 to N threads
+ * @param argc The argument counter
+ * @param argv [max-threads], defaults to the number of online CPUs
+ * @return EXIT_SUCCESS, EXIT_FAILURE if the results differ
+ */
+int main(int argc, char *argv[])
+{
+    static struct solver s;
+    static struct solver_scratch scratch;
+    long int max = argc > 1 ? strtol(argv[1], NULL, 10)
+        : sysconf(_SC_NPROCESSORS_ONLN);
+    const uint16_t secret = 012345;
+    double base = 0;
+    int expected = -1;
+
+    if (max < 1 || max > POOL_MAX_THREADS) {
+        (void) fprintf(stderr, "Usage: %s [max-threads]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (int strategy = STRATEGY_MINIMAX; strategy < STRATEGIES; ++strategy) {
+        base = 0;
+        expected = -1;
+        for (long int t = 1; t <= max; ++t) {
+            struct pool pool;
+            uint64_t start, ns;
+            uint16_t first, guess = 0;
+            uint8_t score;
+
+            if (t > 1 && pool_init(&pool, t) < 0) {
+                (void) fprintf(stderr, "pool_init failed\n");
+                return EXIT_FAILURE;
+            }
+            solver_init(&s, strategy, t > 1 ? &pool : NULL, NULL, &scratch);
+            first = solver_guess(&s);
+            score = score_ref(first, secret);
+            solver_feedback(&s, first, score & 0x7, (score >> 3) & 0x7);
+
+            start = tb_now();
+            for (int r = 0; r < REPEAT; ++r) {
+                guess = solver_best(&s);
+            }
+            ns = (tb_now() - start) / REPEAT;
+            if (t > 1) {
+                pool_destroy(&pool);
+            }
+
+            if (expected < 0) {
+                expected = guess;
+                base = ns;
+            } else if (guess != expected) {
+                (void) fprintf(stderr, "%ld threads picked 0x%x instead of "
+                    "0x%x\n", t, guess, expected);
+                return EXIT_FAILURE;
+            }
+            (void) printf("%s, %u candidates, %ld threads: %.1f ms, "
+                "speedup %.2f\n", strategy == STRATEGY_MINIMAX ? "minimax"
+                : strategy == STRATEGY_PARTS ? "parts" : "entropy",
+                s.ncands, t, ns / 1e6, base / ns);
+        }
+    }
+    return EXIT_SUCCESS;
+}
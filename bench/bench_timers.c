@@ -0,0 +1,226 @@
+/*
+ * @brief check and microbenchmark of the timing wheel with 1M timers
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Arms TIMERS timers with random deadlines up to SPAN ticks ahead of a
+ * start tick just before the 32 bit tick wraps. Checks that stepping
+ * tick by tick expires every timer exactly at its deadline, and that
+ * with timers moved and cancelled and time jumping ahead by random steps
+ * nothing expires early, twice or after it was cancelled. Then times
+ * arming, moving and cancelling, expiring all timers, and a pass over
+ * ticks on which nothing is due, against a sweep over an array of
+ * deadlines as the server would need without the wheel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../tbucket.h"
+#include "../timewheel.h"
+#include "util.h"
+
+/* === Constants === */
+
+#define TIMERS (1 << 20)
+#define SPAN (60000)            /* a minute of millisecond ticks */
+#define START (UINT32_MAX - SPAN / 2)
+#define BATCH (4096)
+#define SWEEPS (64)
+#define NOT_ARMED (0x80000000u) /* never a deadline around START */
+
+/* === Implementations === */
+
+/**
+ * @brief Step tick by tick and check that every timer expires at its
+ * deadline
+ * @param tw The wheel, with all timers armed
+ * @param deadline The deadline of every timer
+ * @param out Room for BATCH timers
+ * @return 0 on success, -1 on the first error
+ */
+static int check_steps(struct timewheel *tw, const uint32_t *deadline,
+    uint32_t *out)
+{
+    uint32_t expired = 0;
+
+    for (uint32_t t = START; t != START + SPAN + 1; ++t) {
+        size_t n;
+
+        while ((n = tw_expire(tw, t, out, BATCH)) > 0) {
+            for (size_t i = 0; i < n; ++i) {
+                if (deadline[out[i]] != t || tw_armed(tw, out[i])) {
+                    (void) fprintf(stderr, "timer %u with deadline %u "
+                        "expired at %u\n", out[i], deadline[out[i]], t);
+                    return -1;
+                }
+            }
+            expired += n;
+        }
+    }
+    if (expired != TIMERS || tw->armed != 0) {
+        (void) fprintf(stderr, "%u of %u timers expired\n", expired, TIMERS);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Move and cancel timers, jump ahead and check what expires
+ * @param tw The wheel, no timer is armed and tw->now is START
+ * @param deadline Room for the deadline of every timer
+ * @param out Room for BATCH timers
+ * @return 0 on success, -1 on the first error
+ */
+static int check_jumps(struct timewheel *tw, uint32_t *deadline,
+    uint32_t *out)
+{
+    uint64_t x = 2463534242ULL;
+    uint32_t t = START, last = START - 1, expected = 0, expired = 0;
+
+    for (uint32_t i = 0; i < TIMERS; ++i) {
+        deadline[i] = START + bench_xorshift64(&x) % SPAN;
+        tw_arm(tw, i, deadline[i]);
+    }
+    for (uint32_t i = 0; i < TIMERS; ++i) {
+        switch (bench_xorshift64(&x) % 4) {
+        case 0:
+            tw_cancel(tw, i);
+            deadline[i] = NOT_ARMED;
+            break;
+        case 1:
+            deadline[i] = START + bench_xorshift64(&x) % SPAN;
+            tw_arm(tw, i, deadline[i]);
+            /* fall through */
+        default:
+            expected++;
+        }
+    }
+    while ((int32_t) (START + SPAN - last) > 0) {
+        size_t n;
+
+        t += 1 + bench_xorshift64(&x) % 1000;
+        while ((n = tw_expire(tw, t, out, BATCH)) > 0) {
+            for (size_t i = 0; i < n; ++i) {
+                uint32_t d = deadline[out[i]];
+
+                /* due by now, not by the last call, and only once */
+                if (d == NOT_ARMED || (int32_t) (d - t) > 0
+                    || (int32_t) (d - last) <= 0) {
+                    (void) fprintf(stderr, "timer %u with deadline %u "
+                        "expired between %u and %u\n", out[i], d, last, t);
+                    return -1;
+                }
+                deadline[out[i]] = NOT_ARMED;
+            }
+            expired += n;
+        }
+        last = t;
+    }
+    if (expired != expected || tw->armed != 0) {
+        (void) fprintf(stderr, "%u of %u timers expired\n", expired,
+            expected);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t *deadline = malloc(TIMERS * sizeof(*deadline));
+    uint32_t *moved = malloc(TIMERS * sizeof(*moved));
+    uint32_t *out = malloc(BATCH * sizeof(*out));
+    uint64_t x = 88172645463325252ULL, start, t_arm, t_move, t_cancel;
+    uint64_t t_expire, t_idle, t_sweep;
+    struct timewheel tw;
+    uint32_t due = 0;
+
+    if (deadline == NULL || moved == NULL || out == NULL
+        || tw_init(&tw, TIMERS, START) < 0) {
+        (void) fprintf(stderr, "allocating timers\n");
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < TIMERS; ++i) {
+        deadline[i] = START + bench_xorshift64(&x) % SPAN;
+        moved[i] = START + bench_xorshift64(&x) % SPAN;
+    }
+
+    start = tb_now();
+    for (uint32_t i = 0; i < TIMERS; ++i) {
+        tw_arm(&tw, i, deadline[i]);
+    }
+    t_arm = tb_now() - start;
+    if (check_steps(&tw, deadline, out) < 0) {
+        return EXIT_FAILURE;
+    }
+    tw_destroy(&tw);
+    if (tw_init(&tw, TIMERS, START) < 0 || check_jumps(&tw, moved, out) < 0) {
+        return EXIT_FAILURE;
+    }
+    tw_destroy(&tw);
+    (void) printf("%u timers expire at their deadlines\n", TIMERS);
+
+    /* the same again for the times, deadlines moved to random ticks */
+    for (uint32_t i = 0; i < TIMERS; ++i) {
+        moved[i] = START + bench_xorshift64(&x) % SPAN;
+    }
+    if (tw_init(&tw, TIMERS, START) < 0) {
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < TIMERS; ++i) {
+        tw_arm(&tw, i, deadline[i]);
+    }
+    start = tb_now();
+    for (uint32_t i = 0; i < TIMERS; ++i) {
+        tw_arm(&tw, i, moved[i]);
+    }
+    t_move = tb_now() - start;
+
+    start = tb_now();
+    for (uint32_t t = START; t != START + SPAN + 1; ++t) {
+        while (tw_expire(&tw, t, out, BATCH) > 0) {
+        }
+    }
+    t_expire = tb_now() - start;
+
+    for (uint32_t i = 0; i < TIMERS; ++i) {
+        tw_arm(&tw, i, START + SPAN + 1 + SPAN + deadline[i] - START);
+    }
+    /* a tick on which nothing is due: what a busy event loop pays */
+    start = tb_now();
+    for (uint32_t t = START + SPAN + 1; t != START + 2 * SPAN + 1; ++t) {
+        due += tw_expire(&tw, t, out, BATCH);
+    }
+    t_idle = tb_now() - start;
+
+    start = tb_now();
+    for (uint32_t i = 0; i < TIMERS; ++i) {
+        tw_cancel(&tw, i);
+    }
+    t_cancel = tb_now() - start;
+
+    /* without a wheel every pass looks at every deadline */
+    start = tb_now();
+    for (uint32_t s = 0; s < SWEEPS; ++s) {
+        for (uint32_t i = 0; i < TIMERS; ++i) {
+            due += (int32_t) (deadline[i] - (START + s)) <= 0;
+        }
+    }
+    t_sweep = tb_now() - start;
+
+    (void) printf("arm %.1f ns, move %.1f ns, cancel %.1f ns per timer\n",
+        (double) t_arm / TIMERS, (double) t_move / TIMERS,
+        (double) t_cancel / TIMERS);
+    (void) printf("expire %.1f ns per timer, %.1f ns per tick with "
+        "nothing due and %u armed\n", (double) t_expire / TIMERS,
+        (double) t_idle / SPAN, TIMERS);
+    (void) printf("sweep over %u deadlines %.1f us per pass, wheel "
+        "%.1f bytes per timer (checksum %u)\n", TIMERS,
+        t_sweep / 1e3 / SWEEPS, (double) tw.map_bytes / TIMERS, due);
+    tw_destroy(&tw);
+    free(deadline);
+    free(moved);
+    free(out);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/*
+ * @brief machine readable results of the benchmarks
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "report.h"
+
+/* === Constants === */
+
+#define FORMAT_NONE (0)
+#define FORMAT_JSON (1)
+#define FORMAT_CSV (2)
+
+/* === Global Variables === */
+
+static int format = FORMAT_NONE;
+static FILE *out = NULL;
+static const char *bench_name = "";
+static const char *rev = "unknown";
+static char started[32];
+
+/* === Implementations === */
+
+int report_start(const char *bench)
+{
+    const char *fmt = getenv("BENCH_FORMAT");
+    const char *path = getenv("BENCH_OUT");
+    time_t now = time(NULL);
+
+    bench_name = bench;
+    if (fmt == NULL || *fmt == '\0') {
+        return 0;
+    }
+    if (strcmp(fmt, "json") == 0) {
+        format = FORMAT_JSON;
+    } else if (strcmp(fmt, "csv") == 0) {
+        format = FORMAT_CSV;
+    } else {
+        (void) fprintf(stderr, "BENCH_FORMAT has to be json or csv\n");
+        return -1;
+    }
+    if (getenv("BENCH_REV") != NULL) {
+        rev = getenv("BENCH_REV");
+    }
+    (void) strftime(started, sizeof(started), "%Y-%m-%dT%H:%M:%SZ",
+        gmtime(&now));
+    if (path == NULL || *path == '\0') {
+        out = stdout;
+    } else if ((out = fopen(path, "a")) == NULL) {
+        perror(path);
+        format = FORMAT_NONE;
+        return -1;
+    }
+    if (format == FORMAT_CSV && (out == stdout || ftell(out) == 0)) {
+        (void) fprintf(out, "rev,time,bench,metric,value,unit\n");
+    }
+    return 0;
+}
+
+void report(const char *metric, double value, const char *unit)
+{
+    /* names and units are constants of the benchmarks, nothing to quote */
+    if (format == FORMAT_JSON) {
+        (void) fprintf(out, "{\"rev\":\"%s\",\"time\":\"%s\",\"bench\":\"%s\","
+            "\"metric\":\"%s\",\"value\":%.9g,\"unit\":\"%s\"}\n",
+            rev, started, bench_name, metric, value, unit);
+    } else if (format == FORMAT_CSV) {
+        (void) fprintf(out, "%s,%s,%s,%s,%.9g,%s\n", rev, started,
+            bench_name, metric, value, unit);
+    }
+}
+
+void report_end(void)
+{
+    if (out != NULL && out != stdout) {
+        (void) fclose(out);
+    } else if (out != NULL) {
+        (void) fflush(out);
+    }
+    out = NULL;
+    format = FORMAT_NONE;
+}
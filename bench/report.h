@@ -0,0 +1,46 @@
+/**
+ * @brief machine readable results of the benchmarks
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Benchmarks print their results for people and pass every number to
+ * report() as well. If BENCH_FORMAT is json or csv in the environment,
+ * the numbers are also appended to the file BENCH_OUT (default: standard
+ * output), one record per number: a JSON object per line
+ *
+ *   {"rev":"<rev>","time":"<start>","bench":"<bench>","metric":"<name>",
+ *    "value":<value>,"unit":"<unit>"}
+ *
+ * or a CSV row rev,time,bench,metric,value,unit, with a header if the file
+ * is new. BENCH_REV tags the records, e.g. with git describe as *make
+ * bench* does, so results of two revisions on the same machine can be
+ * joined on bench and metric.
+*/
+
+#ifndef MM_BENCH_REPORT_H_
+#define MM_BENCH_REPORT_H_
+
+/* === Prototypes === */
+
+/**
+ * @brief Start reporting the results of a benchmark
+ * @param bench Name of the benchmark
+ * @return 0 on success, -1 if BENCH_FORMAT is unknown or BENCH_OUT cannot
+ * be opened
+ */
+int report_start(const char *bench);
+
+/**
+ * @brief Report a result, nothing happens unless BENCH_FORMAT is set
+ * @param metric Name of the number, letters, digits and underscores
+ * @param value The number
+ * @param unit Its unit, e.g. ns or rounds/s
+ */
+void report(const char *metric, double value, const char *unit);
+
+/**
+ * @brief Flush and close the output
+ */
+void report_end(void);
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * @brief helpers shared by the benchmarks
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "util.h"
+
+/* === Constants === */
+
+#define CONNECT_TRIES (10000)
+#define CONNECT_RETRY_US (1000)
+
+/* === Implementations === */
+
+int bench_connect(int port)
+{
+    struct sockaddr_in addr;
+
+    (void) memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int tries = 0; tries < CONNECT_TRIES; ++tries) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+            return fd;
+        }
+        (void) close(fd);
+        (void) usleep(CONNECT_RETRY_US);
+    }
+    return -1;
+}
@@ -0,0 +1,52 @@
+/**
+ * @brief helpers shared by the benchmarks
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Pseudo random numbers for inputs and connections to a server that was
+ * just started. Times come from tb_now() (see tbucket.h), the clock of
+ * the server and the client.
+*/
+
+#ifndef MM_BENCH_UTIL_H_
+#define MM_BENCH_UTIL_H_
+
+#include <stdint.h>
+
+/* === Prototypes === */
+
+/**
+ * @brief Connect to a server on the loopback interface, retrying for up
+ * to ten seconds while it starts up
+ * @param port The server's port
+ * @return The socket or -1
+ */
+int bench_connect(int port);
+
+/**
+ * @brief Next number of a 32 bit xorshift generator
+ * @param x State of the generator, not 0
+ * @return A pseudo random number
+ */
+static inline uint32_t bench_xorshift32(uint32_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+/**
+ * @brief Next number of a 64 bit xorshift generator
+ * @param x State of the generator, not 0
+ * @return A pseudo random number
+ */
+static inline uint64_t bench_xorshift64(uint64_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+    return *x;
+}
+
+#endif
@@ -35,6 +35,20 @@
 #include <errno.h>
 #include <limits.h>
 #include <time.h>
+#include <poll.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/tcp.h>
+#include "tbucket.h"
+#include "logger.h"
+#include "solver.h"
+#include "secret.h"
+#include "game.h"
+#include "geometry.h"
+#include "hist.h"
+#include "shm.h"
+#include "args.h"
 #include "client.h"
 
 /* === Macros === */
@@ -59,6 +73,11 @@ static int sockfd = -1;
 /* File descriptor for connection socket */
 static int connfd = -1;
 
+/* Channel to the server if it is played over shared memory (--shm), its
+   socket is sockfd then */
+static struct shm_chan shm_chan = { .seg = NULL, .sock = -1, .wake_fd = -1,
+    .peer_fd = -1 };
+
 /* This variable is set upon receipt of a signal */
 volatile sig_atomic_t quit = 0;
 
@@ -68,6 +87,9 @@ static uint8_t *read_from_server(int fd, uint8_t *buffer, size_t n)
 {
     /* loop, as packet can arrive in several partial reads */
     size_t bytes_recv = 0;
+    if (shm_chan.seg != NULL && fd == shm_chan.sock) {
+        return shm_recv(&shm_chan, buffer, n) < 0 ? NULL : buffer;
+    }
     do {
         ssize_t r;
         r = recv(fd, buffer + bytes_recv, n - bytes_recv, 0);
@@ -83,10 +105,13 @@ static uint8_t *read_from_server(int fd, uint8_t *buffer, size_t n)
     return buffer;
 }
 
-static uint16_t *send_to_server(int fd, uint16_t *buffer, size_t n)
+static uint8_t *send_to_server(int fd, uint8_t *buffer, size_t n)
 {
     /* loop, as packet can send in several partial writes */
     size_t bytes_sent = 0;
+    if (shm_chan.seg != NULL && fd == shm_chan.sock) {
+        return shm_send(&shm_chan, buffer, n) < 0 ? NULL : buffer;
+    }
     do {
         ssize_t r;
         r = send(fd, buffer + bytes_sent, n - bytes_sent, 0);
@@ -102,22 +127,6 @@ static uint16_t *send_to_server(int fd, uint16_t *buffer, size_t n)
     return buffer;
 }
 
-static int compute_answer(uint8_t req)
-{
-    int red = req & 0x7;
-    req >>= 0x3;
-    int white = req & 0x7;
-    req >>= 0x3;
-    int parity_fault = req & 0x1;
-    req >>= 0x1;
-    int game_lost = req & 0x1;
-    fprintf(stderr, "Red: %d White: %d Parity fault: %d, game lost: %d\n", red, white, parity_fault, game_lost);
-    if(game_lost == 1) {
-        quit = 1;
-    }
-    return -1;
-}
-
 static void bail_out(int exitcode, const char *fmt, ...)
 {
     va_list ap;
@@ -141,12 +150,11 @@ static void free_resources(void)
 {
     /* clean up resources */
     DEBUG("Shutting down server\n");
+    log_stop();
     if(connfd >= 0) {
         (void) close(connfd);
     }
-    if(sockfd >= 0) {
-        (void) close(sockfd);
-    }
+    close_server();
 }
 
 static void signal_handler(int sig)
@@ -154,29 +162,780 @@ static void signal_handler(int sig)
     quit = 1;
 }
 
-static void gen_message(uint16_t *buffer) {
-    int colors[SLOTS] = {
-        rand() % COLORS,
-        rand() % COLORS,
-        rand() % COLORS,
-        rand() % COLORS,
-        rand() % COLORS
-    };
+static int pace(int fd, const struct tb_rate *rate, uint64_t *tat)
+{
+    uint64_t wait;
+
+    while ((wait = tb_take(rate, tat, tb_now())) != 0) {
+        /* wait on the socket instead of sleeping so a hangup ends the wait */
+        struct pollfd pfd = { .fd = fd, .events = 0 };
+        int r = poll(&pfd, 1, (wait + 999999) / 1000000);
+        if (r < 0) {
+            return -1;
+        }
+        if (r > 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int connect_server(const struct opts *options)
+{
+    struct sockaddr_in serv_addr;
+    int fd;
+
+    if (options->shm_path != NULL) {
+        if (shm_connect(&shm_chan, options->shm_path,
+                options->busy_poll ? UINT32_MAX : SHM_SPIN) < 0) {
+            bail_out(EXIT_FAILURE, "connecting to %s", options->shm_path);
+        }
+        sockfd = shm_chan.sock;
+        return sockfd;
+    }
+    if((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        bail_out(EXIT_FAILURE, "creating socket");
+    }
+    sockfd = fd;
+
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(options->portno);
+    serv_addr.sin_addr.s_addr = options->hname.s_addr;
+
+    if(connect(fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        bail_out(EXIT_FAILURE, "connecting to server");
+    }
+    return fd;
+}
+
+static void close_server(void)
+{
+    shm_close(&shm_chan);
+    if (sockfd >= 0) {
+        (void) close(sockfd);
+        sockfd = -1;
+    }
+}
+
+static void record_game(struct results *res, const struct solver *solver,
+    int ret, int rounds)
+{
+    res->guesses += rounds;
+    res->guess_ns += solver->guess_ns;
+    if (ret == EXIT_SUCCESS) {
+        res->won++;
+        res->won_rounds += rounds;
+    }
+}
+
+static int play_game(const struct opts *options, struct solver *solver,
+    int *rounds)
+{
+    static uint16_t buffer;
+    static uint8_t buffer_answer;
+    uint16_t requests[MAX_TRIES + 1];
+    uint8_t token[GAME_TOKEN_BYTES];
+    struct tb_rate rate;
+    uint64_t tat = 0;
+    int round;
+    int resumable = 0;
+    int ret = EXIT_SUCCESS;
+
+    sockfd = connect_server(options);
+    if (options->resume_secs > 0) {
+        uint8_t hello[2] = { TOKEN_HELLO & 0xff, TOKEN_HELLO >> 8 };
+        uint8_t ack;
+
+        resumable = send_to_server(sockfd, hello, WRITE_BYTES) != NULL
+            && read_from_server(sockfd, &ack, READ_BYTES) != NULL
+            && ack == TOKEN_ACK
+            && read_from_server(sockfd, token, GAME_TOKEN_BYTES) != NULL;
+        if (!resumable) {
+            /* the server took the hello for a bad request and hung up */
+            LOG(LVL_WARN, "Server does not resume games, playing without");
+            close_server();
+            sockfd = connect_server(options);
+        }
+    }
+
+    /* connection established */
+    solver_init(solver, options->strategy, solver->pool, solver->matrix,
+        solver->scratch);
+    tb_init(&rate, options->rate, 1);
+
+    for (round = 1; !quit; round++) {
+        if (pace(sockfd, &rate, &tat) < 0) {
+            if (quit) break; /* caught signal */
+            bail_out(EXIT_FAILURE, "pace");
+        }
+        uint16_t guess = solver_guess(solver);
+        int red, white;
+        int played = 0;
+
+        if (guess == SOLVER_NO_GUESS) {
+            (void) fprintf(stderr, "No code fits the responses of the "
+                "server\n");
+            ret = EXIT_INCONSISTENT;
+            break;
+        }
+
+        buffer = codec_request(guess);
+        if (round <= MAX_TRIES) {
+            requests[round] = buffer;
+        }
+        while (!played) {
+            uint8_t out[WRITE_BYTES];
+
+            codec_put_request(buffer, out);
+            played = send_to_server(sockfd, out, WRITE_BYTES) != NULL
+                && read_from_server(sockfd, &buffer_answer, READ_BYTES) != NULL;
+            if (!played && (quit || !resumable
+                    || (played = resume(options, token, requests, round,
+                        &buffer_answer)) < 0)) {
+                break;
+            }
+        }
+        if (played <= 0) {
+            if (quit) break; /* caught signal */
+            bail_out(EXIT_FAILURE, resumable ? "resuming the game"
+                : "playing round %d", round);
+        }
+        red = codec_decode(buffer_answer, &white);
+        LOG(LVL_DEBUG, "Round %lld: request 0x%llx, response 0x%llx",
+            round, buffer, buffer_answer);
+
+        /* stop the game if its over, or an error occured */
+        if (red < 0) {
+            (void) fprintf(stderr, "Parity error\n");
+            ret = EXIT_PARITY_ERROR;
+        }
+        if (buffer_answer & (1 << GAME_LOST_ERR_BIT)) {
+            (void) fprintf(stderr, "Game lost\n");
+            ret = ret == EXIT_PARITY_ERROR ? EXIT_MULTIPLE_ERRORS : EXIT_GAME_LOST;
+        }
+        if (ret != EXIT_SUCCESS || red == SLOTS) {
+            break;
+        }
+        solver_feedback(solver, guess, red, white);
+    }
+    *rounds = round > MAX_TRIES ? MAX_TRIES : round;
 
-    int parity_calc = 0;
-    for(int i = 0; i < SLOTS; i++) {
-        *buffer |= colors[i] & 0x7;
+    close_server();
+    return ret;
+}
 
-        parity_calc ^= colors[i] ^ (colors[i] >> 1) ^ (colors[i] >> 2);
-        
-        if((i+1) < SLOTS)
-            *buffer = *buffer << 3;
+static int play_geometry(const struct opts *options, struct results *res)
+{
+    const struct geometry *g = options->geometry;
+    uint32_t *codes = malloc(g->count * sizeof(*codes));
+    struct tb_rate rate;
+    struct secret_gen gen;
+    int ret = EXIT_SUCCESS;
 
-        //fprintf(stderr, "%d\n", colors[i]);
+    if (codes == NULL) {
+        bail_out(EXIT_FAILURE, "allocating the codes of %s", g->name);
     }
+    /* only for its xoshiro state, the codes are those of g */
+    secret_gen_random(&gen, options->seed, 0);
+    tb_init(&rate, options->rate, 1);
+    for (long int game = 0; game < options->games && !quit; ++game) {
+        uint8_t hello[GEO_HELLO_BYTES] = {
+            GEO_HELLO & 0xff, GEO_HELLO >> 8, g->id
+        };
+        uint8_t ack;
+        uint64_t tat = 0, start;
+        size_t n = g->count;
+        int round;
+
+        ret = EXIT_SUCCESS;
+        sockfd = connect_server(options);
+        if (send_to_server(sockfd, hello, sizeof(hello)) == NULL
+            || read_from_server(sockfd, &ack, READ_BYTES) == NULL
+            || ack != GEO_ACK) {
+            bail_out(EXIT_FAILURE, "server does not play %s", g->name);
+        }
+        start = tb_now();
+        geometry_enumerate(g, codes);
+        res->guess_ns += tb_now() - start;
+
+        for (round = 1; !quit; round++) {
+            uint32_t guess = codes[(secret_xoshiro(gen.s) >> 32) * n >> 32];
+            uint32_t req = g->request(guess);
+            uint8_t out[GEO_REQ_BYTES] = {
+                req & 0xff, (req >> 8) & 0xff, (req >> 16) & 0xff, req >> 24
+            };
+            uint8_t in[GEO_RESP_BYTES];
+            uint16_t resp;
+
+            if (pace(sockfd, &rate, &tat) < 0) {
+                if (quit) break; /* caught signal */
+                bail_out(EXIT_FAILURE, "pace");
+            }
+            if (send_to_server(sockfd, out, sizeof(out)) == NULL
+                || read_from_server(sockfd, in, sizeof(in)) == NULL) {
+                if (quit) break; /* caught signal */
+                bail_out(EXIT_FAILURE, "playing round %d", round);
+            }
+            resp = in[0] | (in[1] << 8);
+            LOG(LVL_DEBUG, "Round %lld: request 0x%llx, response 0x%llx",
+                round, req, resp);
+
+            /* stop the game if its over, or an error occured */
+            if (resp & (1 << GEO_INVALID_BIT)) {
+                (void) fprintf(stderr, "Parity error\n");
+                ret = EXIT_PARITY_ERROR;
+            }
+            if (resp & (1 << GEO_LOST_BIT)) {
+                (void) fprintf(stderr, "Game lost\n");
+                ret = ret == EXIT_PARITY_ERROR ? EXIT_MULTIPLE_ERRORS
+                    : EXIT_GAME_LOST;
+            }
+            if (ret != EXIT_SUCCESS || (resp & GEO_PIN_MASK) == g->slots) {
+                break;
+            }
+            start = tb_now();
+            n = g->filter(guess, resp & 0xff, codes, n);
+            res->guess_ns += tb_now() - start;
+        }
+        close_server();
+        if (!quit) {
+            round = round > MAX_TRIES ? MAX_TRIES : round;
+            res->guesses += round;
+            if (ret == EXIT_SUCCESS) {
+                res->won++;
+                res->won_rounds += round;
+            }
+        }
+    }
+    free(codes);
+    return ret;
+}
+
+static int resume(const struct opts *options, uint8_t *token,
+    const uint16_t *requests, int round, uint8_t *answer)
+{
+    uint64_t deadline = tb_now() + options->resume_secs * 1000000000ULL;
+    uint8_t hello[WRITE_BYTES + GAME_TOKEN_BYTES];
+    uint8_t resp[RESUME_RESP_BYTES];
+    struct sockaddr_in serv_addr;
+
+    LOG(LVL_INFO, "Lost the server in round %lld, resuming", round);
+    (void) close(sockfd);
+    sockfd = -1;
+    (void) memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(options->portno);
+    serv_addr.sin_addr.s_addr = options->hname.s_addr;
+
+    /* the server may still be restarting */
+    for (int tries = 0; !quit && tb_now() < deadline; ++tries) {
+        int server_round, r;
+
+        if (tries > 0) {
+            (void) poll(NULL, 0, RESUME_RETRY_MS);
+        }
+        if (sockfd >= 0) {
+            (void) close(sockfd);
+        }
+        if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+            return -1;
+        }
+        if (connect(sockfd, (struct sockaddr *) &serv_addr,
+                sizeof(serv_addr)) < 0) {
+            continue;
+        }
+        codec_put_request(RESUME_HELLO, hello);
+        (void) memcpy(&hello[WRITE_BYTES], token, GAME_TOKEN_BYTES);
+        if (send_to_server(sockfd, hello, sizeof(hello)) == NULL
+            || read_from_server(sockfd, resp, READ_BYTES) == NULL) {
+            continue;
+        }
+        if (resp[0] != TOKEN_ACK) {
+            LOG(LVL_WARN, "Server does not know the game any more");
+            errno = 0;
+            return -1;
+        }
+        if (read_from_server(sockfd, &resp[READ_BYTES],
+                RESUME_RESP_BYTES - READ_BYTES) == NULL) {
+            continue;
+        }
+        (void) memcpy(token, &resp[READ_BYTES], GAME_TOKEN_BYTES);
+        server_round = resp[TOKEN_RESP_BYTES];
+        LOG(LVL_INFO, "Resumed the game after round %lld", server_round);
+        if (server_round == round) {
+            *answer = resp[TOKEN_RESP_BYTES + 1];
+            return 1;
+        }
+        if (server_round > round) {
+            errno = EPROTO;
+            return -1;
+        }
+        /* the server's snapshot is older than the last rounds, the
+           secret is the same so they get the same responses again */
+        for (r = server_round + 1; r < round; ++r) {
+            uint8_t out[WRITE_BYTES];
 
-    *buffer = *buffer | (parity_calc << 15);
-    //fprintf(stderr, "%d ", parity_calc & 0x1);
+            codec_put_request(requests[r], out);
+            if (send_to_server(sockfd, out, WRITE_BYTES) == NULL
+                || read_from_server(sockfd, answer, READ_BYTES) == NULL) {
+                break;
+            }
+        }
+        if (r == round) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int play_mux(const struct opts *options, struct solver *solvers,
+    struct results *res)
+{
+    static uint8_t out[MUX_MAX_GAMES * MUX_REQ_BYTES];
+    static uint8_t in[MUX_MAX_GAMES * MUX_RESP_BYTES];
+    uint8_t hello[2] = { MUX_HELLO & 0xff, MUX_HELLO >> 8 };
+    uint8_t ack;
+    uint16_t guesses[MUX_MAX_GAMES];
+    int rounds[MUX_MAX_GAMES];      /* -1 for ids without a game */
+    struct tb_rate rate;
+    uint64_t tat = 0;
+    long int started = 0;
+    int ids, live;
+    int ret = EXIT_SUCCESS;
+
+    sockfd = connect_server(options);
+    if (send_to_server(sockfd, hello, sizeof(hello)) == NULL
+        || read_from_server(sockfd, &ack, sizeof(ack)) == NULL
+        || ack != MUX_ACK) {
+        close_server();
+        return -1;
+    }
+    tb_init(&rate, options->rate, 1);
+
+    for (ids = 0; ids < options->pipeline && started < options->games; ++ids) {
+        solver_init(&solvers[ids], options->strategy, solvers[ids].pool,
+            solvers[ids].matrix, solvers[ids].scratch);
+        rounds[ids] = 0;
+        started++;
+    }
+
+    /* every batch carries the next request of every game in progress */
+    for (live = ids; live > 0 && !quit; ) {
+        size_t len = 0;
+
+        for (int i = 0; i < ids && !quit; ++i) {
+            uint16_t req;
+
+            if (rounds[i] < 0) {
+                continue;
+            }
+            if (pace(sockfd, &rate, &tat) < 0) {
+                if (quit) break; /* caught signal */
+                bail_out(EXIT_FAILURE, "pace");
+            }
+            guesses[i] = solver_guess(&solvers[i]);
+            if (guesses[i] == SOLVER_NO_GUESS) {
+                errno = 0;
+                bail_out(EXIT_INCONSISTENT, "No code fits the responses "
+                    "of the server in game %d", i);
+            }
+            rounds[i]++;
+            req = codec_request(guesses[i]);
+            out[len++] = i & 0xff;
+            out[len++] = i >> 8;
+            codec_put_request(req, &out[len]);
+            len += WRITE_BYTES;
+        }
+        if (quit) {
+            break;
+        }
+        if (send_to_server(sockfd, out, len) == NULL) {
+            if (quit) break; /* caught signal */
+            bail_out(EXIT_FAILURE, "send_to_server");
+        }
+        len = len / MUX_REQ_BYTES * MUX_RESP_BYTES;
+        if (read_from_server(sockfd, in, len) == NULL) {
+            if (quit) break; /* caught signal */
+            bail_out(EXIT_FAILURE, "read_from_server");
+        }
+
+        for (size_t f = 0; f < len; f += MUX_RESP_BYTES) {
+            int id = in[f] | (in[f + 1] << 8);
+            uint8_t resp = in[f + 2];
+            int red, white, status = EXIT_SUCCESS;
+
+            if (id >= ids || rounds[id] < 0) {
+                errno = 0;
+                bail_out(EXIT_FAILURE, "Invalid game id %d from server", id);
+            }
+            red = codec_decode(resp, &white);
+            LOG(LVL_DEBUG, "Game %lld, round %lld: guess 0x%llx, "
+                "response 0x%llx", id, rounds[id], guesses[id], resp);
+
+            if (red < 0) {
+                (void) fprintf(stderr, "Parity error\n");
+                status = EXIT_PARITY_ERROR;
+            }
+            if (resp & (1 << GAME_LOST_ERR_BIT)) {
+                (void) fprintf(stderr, "Game lost\n");
+                status = status == EXIT_PARITY_ERROR
+                    ? EXIT_MULTIPLE_ERRORS : EXIT_GAME_LOST;
+            }
+            if (status == EXIT_SUCCESS && red != SLOTS) {
+                solver_feedback(&solvers[id], guesses[id], red, white);
+                continue;
+            }
+
+            /* game over, start the next one under the same id */
+            record_game(res, &solvers[id], status, rounds[id]);
+            if (status != EXIT_SUCCESS) {
+                ret = status;
+            }
+            if (started < options->games) {
+                solver_init(&solvers[id], options->strategy, solvers[id].pool,
+                    solvers[id].matrix, solvers[id].scratch);
+                rounds[id] = 0;
+                started++;
+            } else {
+                rounds[id] = -1;
+                live--;
+            }
+        }
+    }
+
+    close_server();
+    return ret;
+}
+
+static void heap_up(struct load *l, uint32_t pos)
+{
+    uint32_t idx = l->heap[pos];
+    uint64_t due = l->conns[idx].due;
+
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / 2;
+
+        if (l->conns[l->heap[parent]].due <= due) {
+            break;
+        }
+        l->heap[pos] = l->heap[parent];
+        l->conns[l->heap[pos]].heap_pos = pos;
+        pos = parent;
+    }
+    l->heap[pos] = idx;
+    l->conns[idx].heap_pos = pos;
+}
+
+static void heap_down(struct load *l, uint32_t pos)
+{
+    uint32_t idx = l->heap[pos];
+    uint64_t due = l->conns[idx].due;
+
+    for (;;) {
+        uint32_t child = 2 * pos + 1;
+
+        if (child >= l->nheap) {
+            break;
+        }
+        if (child + 1 < l->nheap
+            && l->conns[l->heap[child + 1]].due < l->conns[l->heap[child]].due) {
+            child++;
+        }
+        if (due <= l->conns[l->heap[child]].due) {
+            break;
+        }
+        l->heap[pos] = l->heap[child];
+        l->conns[l->heap[pos]].heap_pos = pos;
+        pos = child;
+    }
+    l->heap[pos] = idx;
+    l->conns[idx].heap_pos = pos;
+}
+
+static void load_schedule(struct load *l, struct load_conn *c, uint64_t due)
+{
+    c->due = due;
+    if (c->heap_pos != UINT32_MAX) {
+        /* rescheduled, e.g. the server closed an idle connection */
+        heap_up(l, c->heap_pos);
+        heap_down(l, c->heap_pos);
+        return;
+    }
+    l->heap[l->nheap] = c - l->conns;
+    heap_up(l, l->nheap++);
+}
+
+static struct load_conn *load_next(struct load *l)
+{
+    struct load_conn *c = &l->conns[l->heap[0]];
+
+    c->heap_pos = UINT32_MAX;
+    if (--l->nheap > 0) {
+        l->heap[0] = l->heap[l->nheap];
+        heap_down(l, 0);
+    }
+    return c;
+}
+
+static void load_connect(struct load *l, struct load_conn *c, uint64_t now)
+{
+    struct sockaddr_in addr;
+    struct epoll_event ev;
+    int one = 1;
+
+    (void) memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(l->options->portno);
+    addr.sin_addr.s_addr = l->options->hname.s_addr;
+    /* a blocking connect would stall every other connection, e.g. while
+       the server's listen backlog is full */
+    if ((c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0
+        || (connect(c->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+            && errno != EINPROGRESS)) {
+        LOG(LVL_INFO, "Connecting failed: errno %lld", errno);
+        load_close(l, c, 1, now);
+        return;
+    }
+    /* requests are two bytes, Nagle would only delay them */
+    (void) setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    ev.events = EPOLLOUT;
+    ev.data.ptr = c;
+    if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+        load_close(l, c, 1, now);
+        return;
+    }
+    c->connecting = 1;
+}
+
+static void load_connected(struct load *l, struct load_conn *c, uint64_t now)
+{
+    struct epoll_event ev;
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+        err = errno;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (err != 0 || epoll_ctl(l->epfd, EPOLL_CTL_MOD, c->fd, &ev) < 0) {
+        LOG(LVL_INFO, "Connecting failed: errno %lld", err != 0 ? err : errno);
+        load_close(l, c, 1, now);
+        return;
+    }
+    c->connecting = 0;
+    c->round = 0;
+    if (c->solver != NULL) {
+        solver_init(c->solver, l->options->strategy, c->solver->pool,
+            c->solver->matrix, c->solver->scratch);
+    }
+    if (l->interval == 0 || c->due <= now) {
+        load_send(l, c, now);
+    } else {
+        load_schedule(l, c, c->due);
+    }
+}
+
+static void load_close(struct load *l, struct load_conn *c, int failed,
+    uint64_t now)
+{
+    if (c->fd >= 0) {
+        (void) close(c->fd); /* also leaves the epoll set */
+    }
+    c->fd = -1;
+    c->waiting = 0;
+    c->connecting = 0;
+    if (failed) {
+        l->conn_errors++;
+        load_schedule(l, c, now + LOAD_RETRY_NS);
+    } else {
+        /* the next game starts with the next request that is due */
+        load_schedule(l, c, l->interval == 0 ? now : c->due + l->interval);
+    }
+}
+
+static void load_send(struct load *l, struct load_conn *c, uint64_t now)
+{
+    uint8_t req[2];
+    uint16_t word;
+
+    if (c->solver != NULL) {
+        if ((c->guess = solver_guess(c->solver)) == SOLVER_NO_GUESS) {
+            LOG(LVL_WARN, "Connection %lld: no code fits the responses",
+                c - l->conns);
+            load_close(l, c, 1, now);
+            return;
+        }
+    } else {
+        l->seed ^= l->seed << 13;
+        l->seed ^= l->seed >> 7;
+        l->seed ^= l->seed << 17;
+        c->guess = l->seed & CODE_MASK;
+    }
+    word = codec_request(c->guess);
+    codec_put_request(word, req);
+    if (send(c->fd, req, sizeof(req), MSG_NOSIGNAL) != sizeof(req)) {
+        load_close(l, c, 1, now);
+        return;
+    }
+    /* open loop: latency counts from when the request was due, so a slow
+       response also delays the requests behind it in the statistics
+       (coordinated omission) */
+    c->sent = l->interval != 0 ? c->due : now;
+    c->waiting = 1;
+    c->round++;
+}
+
+static void load_receive(struct load *l, struct load_conn *c)
+{
+    uint8_t resp;
+    int red, white;
+    uint64_t now;
+
+    if (recv(c->fd, &resp, sizeof(resp), 0) != sizeof(resp) || !c->waiting) {
+        load_close(l, c, 1, tb_now());
+        return;
+    }
+    now = tb_now();
+    c->waiting = 0;
+    red = codec_decode(resp, &white);
+    if (c->sent >= l->measure_from) {
+        l->rounds++;
+        hist_record(&l->latency, now - c->sent, 1);
+        if (red < 0) {
+            l->parity_errors++;
+        } else if (resp & (1 << GAME_LOST_ERR_BIT)) {
+            l->lost++;
+        } else if (red == SLOTS) {
+            l->won++;
+        }
+    }
+    if (game_over(resp)) {
+        load_close(l, c, 0, now);
+        return;
+    }
+    if (c->solver != NULL) {
+        solver_feedback(c->solver, c->guess, red, white);
+    }
+    if (l->interval == 0) {
+        load_send(l, c, now);
+    } else if (c->due + l->interval <= now) {
+        c->due += l->interval; /* late, send right away */
+        load_send(l, c, now);
+    } else {
+        load_schedule(l, c, c->due + l->interval);
+    }
+}
+
+static int run_load(const struct opts *options, struct solver *solvers)
+{
+    static struct load l;
+    struct epoll_event events[LOAD_EVENTS];
+    struct rlimit lim;
+    uint64_t start, ramp_ns, end, now;
+    uint32_t opened = 0;
+    double secs;
+
+    /* every connection takes a file descriptor */
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0
+        && lim.rlim_cur < (rlim_t) options->load + 64) {
+        lim.rlim_cur = lim.rlim_max;
+        (void) setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    l.options = options;
+    l.nconns = options->load;
+    l.seed = options->seed;
+    l.interval = options->rate > 0 ? options->load * 1000000000ULL
+        / options->rate : 0;
+    if ((l.epfd = epoll_create1(0)) < 0
+        || (l.conns = calloc(l.nconns, sizeof(*l.conns))) == NULL
+        || (l.heap = malloc(l.nconns * sizeof(*l.heap))) == NULL) {
+        bail_out(EXIT_FAILURE, "setting up the load generator");
+    }
+    for (uint32_t i = 0; i < l.nconns; ++i) {
+        l.conns[i].fd = -1;
+        l.conns[i].heap_pos = UINT32_MAX;
+        l.conns[i].solver = solvers != NULL ? &solvers[i] : NULL;
+    }
+
+    start = tb_now();
+    ramp_ns = options->ramp_ms * 1000000ULL;
+    l.measure_from = start + ramp_ns;
+    end = l.measure_from + options->duration * 1000000000ULL;
+    while (!quit && (now = tb_now()) < end) {
+        uint64_t next = end;
+        int n;
+
+        /* connection i opens at start + i * ramp / load */
+        while (opened < l.nconns
+            && start + opened * ramp_ns / l.nconns <= now) {
+            struct load_conn *c = &l.conns[opened++];
+
+            c->due = now;
+            load_connect(&l, c, now);
+        }
+        /* a batch at a time, so responses are not starved when sending
+           falls behind, e.g. because the solvers are slow */
+        for (int i = 0; i < LOAD_EVENTS && l.nheap > 0
+                && l.conns[l.heap[0]].due <= now && tb_now() < end; ++i) {
+            struct load_conn *c = load_next(&l);
+
+            if (c->fd < 0) {
+                load_connect(&l, c, now);
+            } else {
+                load_send(&l, c, now);
+            }
+        }
+
+        if (opened < l.nconns && start + opened * ramp_ns / l.nconns < next) {
+            next = start + opened * ramp_ns / l.nconns;
+        }
+        if (l.nheap > 0 && l.conns[l.heap[0]].due < next) {
+            next = l.conns[l.heap[0]].due;
+        }
+        /* round down: waking late would show up as latency */
+        n = epoll_wait(l.epfd, events, LOAD_EVENTS,
+            next > now ? (next - now) / 1000000 : 0);
+        for (int i = 0; i < n; ++i) {
+            struct load_conn *c = events[i].data.ptr;
+
+            if (c->connecting) {
+                load_connected(&l, c, tb_now());
+            } else {
+                load_receive(&l, c);
+            }
+        }
+    }
+    secs = (tb_now() - l.measure_from) / 1e9;
+
+    (void) printf("%u connections, %s, %.1f s after a %.1f s ramp\n",
+        l.nconns, l.interval != 0 ? "open loop" : "closed loop", secs,
+        ramp_ns / 1e9);
+    (void) printf("%llu rounds, %.0f rounds/s", (unsigned long long) l.rounds,
+        secs > 0 ? l.rounds / secs : 0.0);
+    if (options->rate > 0) {
+        (void) printf(" (target %ld rounds/s)", options->rate);
+    }
+    (void) printf("\n%llu games won, %llu lost, %llu parity errors, "
+        "%llu connection errors\n", (unsigned long long) l.won,
+        (unsigned long long) l.lost, (unsigned long long) l.parity_errors,
+        (unsigned long long) l.conn_errors);
+    (void) printf("latency: p50 %.1f us, p99 %.1f us, p999 %.1f us, "
+        "max %.1f us\n", hist_percentile(&l.latency, 50) / 1e3,
+        hist_percentile(&l.latency, 99) / 1e3,
+        hist_percentile(&l.latency, 99.9) / 1e3,
+        hist_percentile(&l.latency, 100) / 1e3);
+
+    for (uint32_t i = 0; i < l.nconns; ++i) {
+        if (l.conns[i].fd >= 0) {
+            (void) close(l.conns[i].fd);
+        }
+    }
+    (void) close(l.epfd);
+    free(l.conns);
+    free(l.heap);
+    return l.rounds > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 /**
@@ -191,10 +950,13 @@ int main(int argc, char *argv[])
 {
 
     struct opts options;
-    int round;
+    int round = 0;
     int ret;
 
     parse_args(argc, argv, &options);
+    if(log_start(options.log_level) < 0) {
+        bail_out(EXIT_FAILURE, "starting logger");
+    }
 
     /* setup signal handlers */
     const int signals[] = {SIGINT, SIGTERM};
@@ -211,45 +973,84 @@ int main(int argc, char *argv[])
         }
     }
 
-    if((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        bail_out(EXIT_FAILURE, "creating socket");
-    }
+    static struct pool pool;
+    static struct matrix matrix;
+    /* all solvers run on this thread, one at a time */
+    static struct solver_scratch scratch;
+    struct solver *solvers = NULL;
+    long int nsolvers;
+    struct results res = { 0 };
+    uint64_t start, ns;
 
-    struct sockaddr_in serv_addr;
-
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(options.portno);
-    serv_addr.sin_addr.s_addr = options.hname.s_addr;
-
-    if(connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-        bail_out(EXIT_FAILURE, "connecting to server");
+    /* the load generator needs a solver per connection unless it guesses
+       at random */
+    nsolvers = options.load == 0 ? options.pipeline
+        : options.strategy != STRATEGY_RANDOM ? options.load : 0;
+    if (nsolvers > 0
+        && (solvers = calloc(nsolvers, sizeof(*solvers))) == NULL) {
+        bail_out(EXIT_FAILURE, "allocating solvers");
+    }
+    if (options.threads > 1 && pool_init(&pool, options.threads) < 0) {
+        bail_out(EXIT_FAILURE, "starting solver threads");
+    }
+    if (options.matrix != NULL
+        && matrix_open(&matrix, options.matrix) < 0) {
+        bail_out(EXIT_FAILURE, "opening %s", options.matrix);
+    }
+    for (long int i = 0; i < nsolvers; ++i) {
+        solver_seed(&solvers[i], options.seed, i);
+        solvers[i].pool = options.threads > 1 ? &pool : NULL;
+        solvers[i].matrix = options.matrix != NULL ? &matrix : NULL;
+        solvers[i].scratch = &scratch;
     }
 
-    /* connection established */
-    ret = EXIT_SUCCESS;
-    
-    /** TODO **/
-    static uint16_t buffer;
-    static uint8_t buffer_answer;
-
-    srand(time(NULL));
-
-    for (round = 1; !quit; round++) {
-        buffer = 0;
-        gen_message(&buffer);
-        if (send_to_server(sockfd, &buffer, WRITE_BYTES) == NULL) {
-            if (quit) break; /* caught signal */
-            bail_out(EXIT_FAILURE, "send_to_server");
+    if (options.load > 0) {
+        ret = run_load(&options, solvers);
+        if (options.threads > 1) {
+            pool_destroy(&pool);
         }
-        if (read_from_server(sockfd, &buffer_answer, READ_BYTES) == NULL) {
-            if (quit) break; /* caught signal */
-            bail_out(EXIT_FAILURE, "read_from_server");
+        free(solvers);
+        matrix_close(&matrix);
+        free_resources();
+        return ret;
+    }
+    start = tb_now();
+    ret = options.geometry != NULL ? play_geometry(&options, &res)
+        : options.pipeline > 1 ? play_mux(&options, solvers, &res) : -1;
+    if (ret < 0) {
+        if (options.pipeline > 1) {
+            LOG(LVL_WARN, "Server does not multiplex, playing games one by one");
+        }
+        ret = EXIT_SUCCESS;
+        for (long int game = 0; game < options.games && !quit; ++game) {
+            ret = play_game(&options, &solvers[0], &round);
+            if (!quit) {
+                record_game(&res, &solvers[0], ret, round);
+            }
+            if (ret == EXIT_INCONSISTENT) {
+                break; /* the server cannot be trusted */
+            }
         }
-        //fprintf(stderr, "Runde %d: ", round);
-        compute_answer(buffer_answer);
+    }
+    ns = tb_now() - start;
 
-        sleep(1);
+    if (options.games == 1 && res.won == 1) {
+        (void) printf("Runden: %ld\n", res.won_rounds);
+    }
+    if (options.games > 1) {
+        (void) printf("%ld of %ld games won, %.2f rounds on average\n",
+            res.won, options.games,
+            res.won > 0 ? (double) res.won_rounds / res.won : 0.0);
+    }
+    if (res.guesses > 0) {
+        (void) printf("%.3f ms per guess, %.0f rounds/s\n",
+            res.guess_ns / 1e6 / res.guesses, res.guesses / (ns / 1e9));
+    }
+    if (options.threads > 1) {
+        pool_destroy(&pool);
     }
+    free(solvers);
+    matrix_close(&matrix);
 
     /* we are done */
     free_resources();
@@ -258,6 +1059,19 @@ int main(int argc, char *argv[])
 
 static void parse_args(int argc, char **argv, struct opts *options)
 {
+    enum { OPT_LOAD = 256, OPT_RAMP, OPT_DURATION, OPT_RESUME, OPT_SHM,
+        OPT_BUSY_POLL };
+    static const struct option long_options[] = {
+        { "load", required_argument, NULL, OPT_LOAD },
+        { "ramp", required_argument, NULL, OPT_RAMP },
+        { "duration", required_argument, NULL, OPT_DURATION },
+        { "resume", required_argument, NULL, OPT_RESUME },
+        { "shm", required_argument, NULL, OPT_SHM },
+        { "busy-poll", no_argument, NULL, OPT_BUSY_POLL },
+        { NULL, 0, NULL, 0 }
+    };
+    int strategy_set = 0;
+    int c;
     char *port_arg;
     char *hname_arg;
     char *endptr;
@@ -266,12 +1080,114 @@ static void parse_args(int argc, char **argv, struct opts *options)
     if(argc > 0) {
         progname = argv[0];
     }
-    if (argc != 3) {
+    options->rate = 0;
+    options->log_level = LVL_WARN;
+    options->strategy = STRATEGY_MINIMAX;
+    options->games = 1;
+    options->threads = 1;
+    options->matrix = NULL;
+    options->pipeline = 1;
+    options->load = 0;
+    options->ramp_ms = 0;
+    options->duration = 10;
+    options->resume_secs = 0;
+    options->geometry = NULL;
+    options->shm_path = NULL;
+    options->busy_poll = 0;
+    options->seed = (uint64_t) time(NULL) << 16 ^ getpid();
+    while ((c = getopt_long(argc, argv, "g:m:n:p:r:s:t:v", long_options,
+            NULL)) != -1) {
+        switch (c) {
+        case OPT_LOAD:
+            options->load = parse_number(optarg, "--load", 1, LOAD_MAX_CONNS,
+                bail_out);
+            break;
+        case OPT_RAMP:
+            options->ramp_ms = parse_number(optarg, "--ramp", 0,
+                INT_MAX / 1000, bail_out);
+            break;
+        case OPT_DURATION:
+            options->duration = parse_number(optarg, "--duration", 1,
+                INT_MAX / 1000, bail_out);
+            break;
+        case OPT_RESUME:
+            options->resume_secs = parse_number(optarg, "--resume", 1,
+                INT_MAX / 1000, bail_out);
+            break;
+        case OPT_SHM:
+            options->shm_path = optarg;
+            break;
+        case OPT_BUSY_POLL:
+            options->busy_poll = 1;
+            break;
+        case 'g':
+            if ((options->geometry = geometry_find(optarg)) == NULL) {
+                bail_out(EXIT_FAILURE, "-g has to be one of 4x6, 5x8, 6x10 "
+                    "or 8x8");
+            }
+            break;
+        case 'p':
+            options->pipeline = parse_number(optarg, "-p", 1, MUX_MAX_GAMES,
+                bail_out);
+            break;
+        case 'r':
+            options->rate = parse_number(optarg, "-r", 1, INT_MAX, bail_out);
+            break;
+        case 'm':
+            options->matrix = optarg;
+            break;
+        case 'n':
+            options->games = parse_number(optarg, "-n", 1, INT_MAX, bail_out);
+            break;
+        case 's':
+            strategy_set = 1;
+            if ((options->strategy = solver_strategy(optarg)) < 0) {
+                bail_out(EXIT_FAILURE, "-s has to be one of random, minimax, "
+                    "parts or entropy");
+            }
+            break;
+        case 't':
+            options->threads = parse_number(optarg, "-t", 1,
+                POOL_MAX_THREADS, bail_out);
+            break;
+        case 'v':
+            if (options->log_level < LVL_DEBUG) {
+                options->log_level++;
+            }
+            break;
+        default:
+            goto usage;
+        }
+    }
+    if (argc - optind != (options->shm_path != NULL ? 0 : 2)
+        || (options->busy_poll && options->shm_path == NULL)) {
+usage:
         bail_out(EXIT_FAILURE,
-            "Usage: %s <server-hostname> <server-port>", progname);
+            "Usage: %s [-v] [-g geometry] [-m matrix-file] [-n games] "
+            "[-p games] [-r rounds/s] [-s strategy] [-t threads] "
+            "[--load connections [--ramp ms] [--duration seconds]] "
+            "[--resume seconds] {<server-hostname> <server-port> | "
+            "--shm shm-socket [--busy-poll]}",
+            progname);
+    }
+    if (options->shm_path != NULL && (options->load > 0
+            || options->resume_secs > 0)) {
+        bail_out(EXIT_FAILURE, "--shm cannot be combined with --load or "
+            "--resume");
+    }
+    if (options->geometry != NULL && (options->pipeline > 1
+            || options->load > 0 || options->resume_secs > 0)) {
+        bail_out(EXIT_FAILURE, "-g cannot be combined with -p, --load or "
+            "--resume");
+    }
+    if (options->load > 0 && !strategy_set) {
+        options->strategy = STRATEGY_RANDOM; /* the solver would be the load */
+    }
+    if (options->shm_path != NULL) {
+        return;
     }
-    port_arg = argv[2];
-    hname_arg = argv[1];
+    port_arg = argv[optind + 1];
+    hname_arg = argv[optind];
 
     errno = 0;
     options->portno = strtol(port_arg, &endptr, 10);
@@ -9,28 +9,83 @@
 
 /* === Constants === */
 
-#define MAX_TRIES (35)
-#define SLOTS (5)
-#define COLORS (8)
-
 #define READ_BYTES (1)
 #define WRITE_BYTES (2)
 #define BUFFER_BYTES (2)
-#define SHIFT_WIDTH (3)
-#define PARITY_ERR_BIT (6)
-#define GAME_LOST_ERR_BIT (7)
 
 #define EXIT_PARITY_ERROR (2)
 #define EXIT_GAME_LOST (3)
 #define EXIT_MULTIPLE_ERRORS (4)
+#define EXIT_INCONSISTENT (5)   /* no code fits the server's responses */
 
 #define BACKLOG (5)
 
+#define LOAD_EVENTS (256)
+#define LOAD_MAX_CONNS (1000000)
+#define LOAD_RETRY_NS (100000000ULL)    /* wait before reconnecting */
+#define RESUME_RETRY_MS (100)           /* wait before reconnecting */
+
  /* === Type Definitions === */
 
 struct opts {
     long int portno;
     struct in_addr hname;
+    long int rate;      /* rounds/s, 0 for unlimited */
+    int log_level;      /* see logger.h */
+    int strategy;       /* see solver.h */
+    long int games;     /* number of games to play one after another */
+    long int threads;   /* threads of the solver */
+    const char *matrix; /* score matrix file, see matrix.h */
+    long int pipeline;  /* games multiplexed on one connection, see game.h */
+    long int load;      /* connections of the load generator, 0 if off */
+    long int ramp_ms;   /* open the connections over this time */
+    long int duration;  /* seconds of load after the ramp */
+    long int resume_secs;   /* try to resume a game this long, 0 if off */
+    const struct geometry *geometry;    /* NULL for the usual 5x8 games */
+    const char *shm_path;   /* play over shared memory, see shm.h */
+    int busy_poll;      /* poll the channel instead of sleeping */
+    uint64_t seed;      /* of all random guesses */
+};
+
+/* Outcome of the games played so far */
+struct results {
+    long int won;
+    long int won_rounds;    /* rounds of the games won */
+    uint64_t guesses;
+    uint64_t guess_ns;      /* time the solvers spent selecting guesses */
+};
+
+/* A connection of the load generator, it plays one game after another */
+struct load_conn {
+    int fd;             /* -1 while not connected */
+    int round;
+    uint16_t guess;
+    uint8_t waiting;    /* a request is in flight */
+    uint8_t connecting; /* waiting for EPOLLOUT of a nonblocking connect */
+    uint32_t heap_pos;  /* position in the schedule, UINT32_MAX if none */
+    uint64_t due;       /* when the next request is to be sent */
+    uint64_t sent;      /* when the request in flight should have been sent */
+    struct solver *solver;  /* NULL for random guesses */
+};
+
+/* State of the load generator */
+struct load {
+    const struct opts *options;
+    int epfd;
+    struct load_conn *conns;
+    uint32_t nconns;
+    uint32_t *heap;     /* min-heap of connections by due */
+    uint32_t nheap;
+    uint64_t interval;  /* ns between two requests of a connection, 0 for
+                           closed loop */
+    uint64_t measure_from;  /* samples before the end of the ramp are dropped */
+    uint64_t seed;      /* xorshift state of random guesses */
+    uint64_t rounds;
+    uint64_t won;
+    uint64_t lost;
+    uint64_t parity_errors;
+    uint64_t conn_errors;
+    struct hist latency;
 };
 
 /* === Prototypes === */
@@ -65,16 +120,163 @@ static uint8_t *read_from_server(int sockfd_con, uint8_t *buffer, size_t n);
  * @param n Size to write
  * @return Pointer to buffer on success, else NULL
  */
-static uint16_t *send_to_server(int sockfd_con, uint16_t *buffer, size_t n);
+static uint8_t *send_to_server(int sockfd_con, uint8_t *buffer, size_t n);
+
+/**
+ * @brief Wait until the rate limit allows the next round
+ * @param fd Socket whose hangup ends the wait early
+ * @param rate The configured rate
+ * @param tat The state of the token bucket
+ * @return 0 if the round may be played, -1 on error or hangup
+ */
+static int pace(int fd, const struct tb_rate *rate, uint64_t *tat);
+
+/**
+ * @brief Connect to the server
+ * @param options The parsed command line options
+ * @return The connected socket; terminates the program on errors
+ */
+static int connect_server(const struct opts *options);
+
+/**
+ * @brief Close the connection to the server and its channel, if any
+ */
+static void close_server(void);
+
+/**
+ * @brief Record the outcome of a game
+ * @param res The results to update
+ * @param solver The solver that played the game
+ * @param ret Status of the game, see play_game()
+ * @param rounds Number of rounds played
+ */
+static void record_game(struct results *res, const struct solver *solver,
+    int ret, int rounds);
+
+/**
+ * @brief Connect to the server and play one game
+ * @param options The parsed command line options
+ * @param solver The solver that selects the guesses
+ * @param rounds Receives the number of rounds played
+ * @return EXIT_SUCCESS if the game was won, EXIT_PARITY_ERROR,
+ * EXIT_GAME_LOST, EXIT_MULTIPLE_ERRORS or EXIT_INCONSISTENT otherwise
+ */
+static int play_game(const struct opts *options, struct solver *solver,
+    int *rounds);
+
+/**
+ * @brief Connect to the server again and resume the game, see game.h;
+ * rounds the server lost are played again
+ * @param options The parsed command line options
+ * @param token The game's token, receives the new one
+ * @param requests The requests sent so far, by round
+ * @param round The round whose response is missing
+ * @param answer Receives its response if the server played it
+ * @return 1 if the response is in answer, 0 if the round has to be sent
+ * again on sockfd, -1 if the game cannot be resumed
+ */
+static int resume(const struct opts *options, uint8_t *token,
+    const uint16_t *requests, int round, uint8_t *answer);
+
+/**
+ * @brief Play games multiplexed on one connection, see game.h
+ * @param options The parsed command line options, pipeline solvers are used
+ * @param solvers One solver per multiplexed game
+ * @param res Receives the outcome of every game
+ * @return EXIT_SUCCESS if all games were won, the status of the last game
+ * that was not (see play_game()), or -1 if the server does not multiplex
+ */
+static int play_mux(const struct opts *options, struct solver *solvers,
+    struct results *res);
+
+/**
+ * @brief Play games of another geometry one after another, see geometry.h;
+ * every guess is a random code consistent with the responses so far
+ * @param options The parsed command line options
+ * @param res Receives the outcome of every game
+ * @return EXIT_SUCCESS if all games were won, else the status of the last
+ * game that was not (see play_game())
+ */
+static int play_geometry(const struct opts *options, struct results *res);
+
+/**
+ * @brief Drive many connections from one epoll loop and report the load
+ * @param options The parsed command line options
+ * @param solvers One solver per connection, NULL for random guesses
+ * @return EXIT_SUCCESS, EXIT_FAILURE if no round could be played
+ */
+static int run_load(const struct opts *options, struct solver *solvers);
+
+/**
+ * @brief Start to open the connection of a load connection; its game
+ * starts once the connection is established
+ * @param l The load generator
+ * @param c The connection
+ * @param now The current time
+ */
+static void load_connect(struct load *l, struct load_conn *c, uint64_t now);
+
+/**
+ * @brief Finish a nonblocking connect and start the game of the connection
+ * @param l The load generator
+ * @param c The connection, writable or failed according to epoll
+ * @param now The current time
+ */
+static void load_connected(struct load *l, struct load_conn *c, uint64_t now);
+
+/**
+ * @brief Close a load connection, reconnect it later if it failed
+ * @param l The load generator
+ * @param c The connection
+ * @param failed Set if the connection broke
+ * @param now The current time
+ */
+static void load_close(struct load *l, struct load_conn *c, int failed,
+    uint64_t now);
+
+/**
+ * @brief Send the next request of a load connection
+ * @param l The load generator
+ * @param c The connection
+ * @param now The current time
+ */
+static void load_send(struct load *l, struct load_conn *c, uint64_t now);
+
+/**
+ * @brief Read and record the response of a load connection
+ * @param l The load generator
+ * @param c The connection
+ */
+static void load_receive(struct load *l, struct load_conn *c);
+
+/**
+ * @brief Schedule the next request of a load connection
+ * @param l The load generator
+ * @param c The connection
+ * @param due When it is to be sent
+ */
+static void load_schedule(struct load *l, struct load_conn *c, uint64_t due);
+
+/**
+ * @brief Take the connection that is due first off the schedule
+ * @param l The load generator
+ * @return The connection
+ */
+static struct load_conn *load_next(struct load *l);
+
+/**
+ * @brief Move a scheduled connection towards the root until in order
+ * @param l The load generator
+ * @param pos Its position in the heap
+ */
+static void heap_up(struct load *l, uint32_t pos);
 
 /**
- * @brief Compute answer to request
- * @param req Client's guess
- * @param resp Buffer that will be sent to the client
- * @param secret The server's secret
- * @return Number of correct matches on success; -1 in case of a parity error
+ * @brief Move a scheduled connection towards the leaves until in order
+ * @param l The load generator
+ * @param pos Its position in the heap
  */
-static int compute_answer(uint8_t req);
+static void heap_down(struct load *l, uint32_t pos);
 
 /**
  * @brief terminate program on program error
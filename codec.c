@@ -0,0 +1,156 @@
+/*
+ * @brief wire format of requests and responses
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdint.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+#include "codec.h"
+
+/* === Implementations === */
+
+#ifdef __SSE2__
+
+/* 8 words per vector, see the single word versions in codec.h */
+
+/**
+ * @brief Fold the parity of 16 bit lanes into their lowest bit
+ * @param x The lanes
+ * @return The parities, one bit per lane
+ */
+static inline __m128i parity_sse2(__m128i x)
+{
+    x = _mm_xor_si128(x, _mm_srli_epi16(x, 8));
+    x = _mm_xor_si128(x, _mm_srli_epi16(x, 4));
+    x = _mm_xor_si128(x, _mm_srli_epi16(x, 2));
+    x = _mm_xor_si128(x, _mm_srli_epi16(x, 1));
+    return _mm_and_si128(x, _mm_set1_epi16(1));
+}
+
+/**
+ * @brief Encode requests, as many as fit into whole vectors
+ * @param codes The packed guesses
+ * @param reqs The request words
+ * @param n Number of guesses
+ * @return Number of guesses encoded
+ */
+static size_t encode_sse2(const uint16_t *codes, uint16_t *reqs, size_t n)
+{
+    const __m128i mask = _mm_set1_epi16(CODE_MASK);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m128i x = _mm_and_si128(
+            _mm_loadu_si128((const __m128i *) &codes[i]), mask);
+
+        _mm_storeu_si128((__m128i *) &reqs[i], _mm_or_si128(x,
+            _mm_slli_epi16(parity_sse2(x), REQUEST_PARITY_BIT)));
+    }
+    return i;
+}
+
+/**
+ * @brief Decode requests, as many as fit into whole vectors
+ * @param reqs The request words
+ * @param codes The packed guesses
+ * @param valid The parity flags
+ * @param n Number of requests
+ * @param invalid Incremented by the number of parity errors
+ * @return Number of requests decoded
+ */
+static size_t decode_sse2(const uint16_t *reqs, uint16_t *codes,
+    uint8_t *valid, size_t n, size_t *invalid)
+{
+    const __m128i mask = _mm_set1_epi16(CODE_MASK);
+    const __m128i one = _mm_set1_epi16(1);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *) &reqs[i]);
+        __m128i ok = _mm_xor_si128(parity_sse2(x), one);
+
+        _mm_storeu_si128((__m128i *) &codes[i], _mm_and_si128(x, mask));
+        _mm_storel_epi64((__m128i *) &valid[i], _mm_packus_epi16(ok, ok));
+        /* a set bit 0 per valid lane, the sign bits give a bit per byte */
+        *invalid += 8 - __builtin_popcount(_mm_movemask_epi8(
+            _mm_slli_epi16(ok, 7)) & 0x5555);
+    }
+    return i;
+}
+
+/**
+ * @brief Decode responses, as many as fit into whole vectors
+ * @param resps The response bytes
+ * @param red The red pin counts
+ * @param white The white pin counts
+ * @param n Number of responses
+ * @return Number of responses decoded
+ */
+static size_t responses_sse2(const uint8_t *resps, int8_t *red,
+    uint8_t *white, size_t n)
+{
+    const __m128i pins = _mm_set1_epi8(PIN_MASK);
+    const __m128i one = _mm_set1_epi8(1);
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) &resps[i]);
+        /* 16 bit shifts, the masks drop what crossed a byte */
+        __m128i err = _mm_and_si128(_mm_srli_epi16(x, PARITY_ERR_BIT), one);
+
+        _mm_storeu_si128((__m128i *) &red[i], _mm_or_si128(
+            _mm_and_si128(x, pins), _mm_sub_epi8(_mm_setzero_si128(), err)));
+        _mm_storeu_si128((__m128i *) &white[i],
+            _mm_and_si128(_mm_srli_epi16(x, SHIFT_WIDTH), pins));
+    }
+    return i;
+}
+
+#endif
+
+void codec_encode_requests(const uint16_t *codes, uint16_t *reqs, size_t n)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    i = encode_sse2(codes, reqs, n);
+#endif
+    for (; i < n; ++i) {
+        reqs[i] = codec_request(codes[i]);
+    }
+}
+
+size_t codec_decode_requests(const uint16_t *reqs, uint16_t *codes,
+    uint8_t *valid, size_t n)
+{
+    size_t i = 0, invalid = 0;
+
+#ifdef __SSE2__
+    i = decode_sse2(reqs, codes, valid, n, &invalid);
+#endif
+    for (; i < n; ++i) {
+        codes[i] = codec_code(reqs[i]);
+        valid[i] = codec_valid(reqs[i]);
+        invalid += !valid[i];
+    }
+    return invalid;
+}
+
+void codec_decode_responses(const uint8_t *resps, int8_t *red,
+    uint8_t *white, size_t n)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    i = responses_sse2(resps, red, white, n);
+#endif
+    for (; i < n; ++i) {
+        int w;
+
+        red[i] = codec_decode(resps[i], &w);
+        white[i] = w;
+    }
+}
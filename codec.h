@@ -0,0 +1,145 @@
+/**
+ * @brief wire format of requests and responses
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * A request word is a packed code as in score.h, slot i in bits 3i..3i+2,
+ * with the parity of the 15 code bits in bit 15, so every valid request
+ * has an even number of bits set. The server scores the lower 15 bits as
+ * they are; clients used to send slot 0 in the highest bits instead, so
+ * their guesses were scored with the slots reversed.
+ *
+ * A response byte has the red pins in bits 0-2, the white pins in bits
+ * 3-5, a parity error in bit 6 and game lost in bit 7.
+ *
+ * Words are converted without branches: parity is a xor fold, decoding
+ * turns the parity error into -1 with a mask. The bulk versions convert
+ * whole arrays, with SSE2 if available, and give the same results as the
+ * single word ones.
+*/
+
+#ifndef MM_CODEC_H_
+#define MM_CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "score.h"
+
+/* === Constants === */
+
+#define PARITY_ERR_BIT (6)
+#define GAME_LOST_ERR_BIT (7)
+#define PIN_MASK (0x7)          /* red or white pins after shifting */
+#define REQUEST_PARITY_BIT (15)
+
+/* === Prototypes === */
+
+/**
+ * @brief Get the parity of a code
+ * @param code The code, bits above CODE_BITS are ignored
+ * @return 1 if an odd number of bits is set, else 0
+ */
+static inline unsigned codec_parity(uint16_t code)
+{
+    return __builtin_parity(code & CODE_MASK);
+}
+
+/**
+ * @brief Encode a guess as request word
+ * @param code The packed guess
+ * @return The request word
+ */
+static inline uint16_t codec_request(uint16_t code)
+{
+    code &= CODE_MASK;
+    return code | (uint16_t) (codec_parity(code) << REQUEST_PARITY_BIT);
+}
+
+/**
+ * @brief Write a request word in wire order, little endian
+ * @param req The request word
+ * @param out Receives the two bytes
+ */
+static inline void codec_put_request(uint16_t req, uint8_t *out)
+{
+    out[0] = req & 0xff;
+    out[1] = req >> 8;
+}
+
+/**
+ * @brief Get the guess of a request word
+ * @param req The request word
+ * @return The packed guess
+ */
+static inline uint16_t codec_code(uint16_t req)
+{
+    return req & CODE_MASK;
+}
+
+/**
+ * @brief Check the parity of a request word
+ * @param req The request word
+ * @return 1 if the parity bit matches the code, else 0
+ */
+static inline int codec_valid(uint16_t req)
+{
+    return !__builtin_parity(req);
+}
+
+/**
+ * @brief Encode a response byte
+ * @param red Red pins
+ * @param white White pins
+ * @param parity_err 1 if the request had a parity error
+ * @param lost 1 if the game is lost
+ * @return The response byte
+ */
+static inline uint8_t codec_response(unsigned red, unsigned white,
+    unsigned parity_err, unsigned lost)
+{
+    return red | (white << SHIFT_WIDTH) | (parity_err << PARITY_ERR_BIT)
+        | (lost << GAME_LOST_ERR_BIT);
+}
+
+/**
+ * @brief Decode a response byte
+ * @param resp The response byte
+ * @param white Receives the number of white pins
+ * @return Number of red pins, -1 in case of a parity error
+ */
+static inline int codec_decode(uint8_t resp, int *white)
+{
+    *white = (resp >> SHIFT_WIDTH) & PIN_MASK;
+    return (resp & PIN_MASK) | -((resp >> PARITY_ERR_BIT) & 1);
+}
+
+/**
+ * @brief Encode many guesses as request words, like codec_request()
+ * @param codes The packed guesses
+ * @param reqs n request words
+ * @param n Number of guesses
+ */
+void codec_encode_requests(const uint16_t *codes, uint16_t *reqs, size_t n);
+
+/**
+ * @brief Decode many request words, like codec_code() and codec_valid()
+ * @param reqs The request words
+ * @param codes n packed guesses
+ * @param valid n flags, 1 if the parity matches
+ * @param n Number of requests
+ * @return Number of requests with a parity error
+ */
+size_t codec_decode_requests(const uint16_t *reqs, uint16_t *codes,
+    uint8_t *valid, size_t n);
+
+/**
+ * @brief Decode many response bytes, like codec_decode()
+ * @param resps The response bytes
+ * @param red n red pin counts, -1 for a parity error
+ * @param white n white pin counts
+ * @param n Number of responses
+ */
+void codec_decode_responses(const uint8_t *resps, int8_t *red,
+    uint8_t *white, size_t n);
+
+#endif
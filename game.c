@@ -0,0 +1,48 @@
+/*
+ * @brief game logic shared by server, client and simulator
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdint.h>
+#include "game.h"
+
+/* === Implementations === */
+
+/**
+ * @brief Mark a response as lost if the last round did not win
+ * @param resp The response byte
+ * @param round The round of the request
+ * @return The response byte
+ */
+static inline uint8_t check_lost(uint8_t resp, int round)
+{
+    if (round >= MAX_TRIES
+        && ((resp & (1 << PARITY_ERR_BIT)) || (resp & PIN_MASK) != SLOTS)) {
+        resp |= 1 << GAME_LOST_ERR_BIT;
+    }
+    return resp;
+}
+
+uint8_t game_answer(const uint8_t *table, uint16_t req, int round)
+{
+    return check_lost(score_lookup(table, req), round);
+}
+
+uint8_t game_answer_code(uint16_t secret, uint16_t req, int round)
+{
+    /* the score holds the expected parity, as in score_lookup() */
+    return check_lost(score_swar(req, secret)
+        ^ ((req >> REQUEST_PARITY_BIT) << SCORE_PARITY_BIT), round);
+}
+
+void game_answer_pairs(const uint16_t *secrets, const uint16_t *reqs,
+    const uint8_t *rounds, uint8_t *resps, size_t n)
+{
+    score_batch_pairs(reqs, secrets, resps, n);
+    for (size_t i = 0; i < n; ++i) {
+        resps[i] = check_lost(resps[i]
+            ^ ((reqs[i] >> REQUEST_PARITY_BIT) << SCORE_PARITY_BIT),
+            rounds[i]);
+    }
+}
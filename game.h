@@ -0,0 +1,101 @@
+/**
+ * @brief game logic shared by server, client and simulator
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * These functions answer requests the way the server does, codec.h
+ * defines the request words and response bytes. Everything that plays
+ * games, over TCP or in-process, goes through them.
+ *
+ * Multiplexed mode: a client that sends MUX_HELLO as its first request and
+ * gets MUX_ACK back may play up to MUX_MAX_GAMES games at once on the
+ * connection. Every request frame is a little endian game id followed by
+ * the request word, every response frame is the game id followed by the
+ * response byte. A game starts with the first request of an unused id and
+ * ends with the response that is game_over(), after which the id may start
+ * the next game. Requests may be sent without waiting for responses.
+ * MUX_HELLO has a bad parity, so servers without multiplexing answer it
+ * with a parity error and close the connection.
+ *
+ * Resumable games: a lock-step client that sends TOKEN_HELLO as its first
+ * request gets TOKEN_ACK and a token of GAME_TOKEN_BYTES back and plays
+ * on as usual. After losing the connection, e.g. because the server was
+ * restarted, it connects again and sends RESUME_HELLO followed by the
+ * token. If the server kept the game (see snapshot.h) it answers
+ * TOKEN_ACK, a new token, the number of rounds it played and the response
+ * of the last one, and the game goes on with the next round. Rounds the
+ * client played after the server's snapshot are simply played again, the
+ * secret did not change. Otherwise the answer is RESUME_UNKNOWN and the
+ * connection is closed. Both words have a bad parity as well.
+ *
+ * Games on other boards than 5x8 start with GEO_HELLO, see geometry.h.
+*/
+
+#ifndef MM_GAME_H_
+#define MM_GAME_H_
+
+#include <stdint.h>
+#include "score.h"
+#include "codec.h"
+
+/* === Constants === */
+
+#define MAX_TRIES (35)
+
+#define MUX_HELLO (0x7fff)
+#define MUX_ACK (0xff)          /* 7 red pins: no valid response */
+#define MUX_MAX_GAMES (256)
+#define MUX_REQ_BYTES (4)
+#define MUX_RESP_BYTES (3)
+
+#define TOKEN_HELLO (0xfffe)
+#define RESUME_HELLO (0xfffd)
+#define TOKEN_ACK (0xff)
+#define RESUME_UNKNOWN (0xc0)   /* parity error and game lost */
+#define GAME_TOKEN_BYTES (16)
+#define TOKEN_RESP_BYTES (1 + GAME_TOKEN_BYTES)
+#define RESUME_RESP_BYTES (TOKEN_RESP_BYTES + 2)
+
+/* === Prototypes === */
+
+/**
+ * @brief Answer a request
+ * @param table Score table of the secret, see score_table_acquire()
+ * @param req The request word
+ * @param round The round of the request, starting at 1
+ * @return The response byte: red, white, parity error and game lost bits
+ */
+uint8_t game_answer(const uint8_t *table, uint16_t req, int round);
+
+/**
+ * @brief Answer a request without a score table
+ * @param secret The packed secret
+ * @param req The request word
+ * @param round The round of the request, starting at 1
+ * @return The response byte, the same as game_answer()
+ */
+uint8_t game_answer_code(uint16_t secret, uint16_t req, int round);
+
+/**
+ * @brief Answer many requests, each against its own secret
+ * @param secrets The packed secrets
+ * @param reqs The request words
+ * @param rounds The rounds of the requests
+ * @param resps n response bytes, the same as game_answer_code()
+ * @param n Number of requests
+ */
+void game_answer_pairs(const uint16_t *secrets, const uint16_t *reqs,
+    const uint8_t *rounds, uint8_t *resps, size_t n);
+
+/**
+ * @brief Check whether a response ends the game
+ * @param resp The response byte
+ * @return Nonzero if the game was won, lost or had a parity error
+ */
+static inline int game_over(uint8_t resp)
+{
+    return (resp & PIN_MASK) == SLOTS
+        || (resp & ((1 << PARITY_ERR_BIT) | (1 << GAME_LOST_ERR_BIT)));
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * @brief structure-of-arrays table of per-game state
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "score.h"
+#include "game.h"
+#include "gametab.h"
+
+/* === Constants === */
+
+#define ARRAY_ALIGN (64)
+
+/* === Implementations === */
+
+int gametab_init(struct gametab *t, uint32_t capacity)
+{
+    /* bytes of a uint8_t array, rounded so every array starts a cache line */
+    size_t bytes8 = ((size_t) capacity + ARRAY_ALIGN - 1)
+        & ~(size_t) (ARRAY_ALIGN - 1);
+    uint8_t *mem;
+
+    (void) memset(t, 0, sizeof(*t));
+    t->map_bytes = 9 * bytes8; /* connections take four, secrets two */
+    if (t->map_bytes == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    mem = mmap(NULL, t->map_bytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        return -1;
+    }
+    t->mem = mem;
+    t->conn = (uint32_t *) mem;
+    t->secret = (uint16_t *) (mem + 4 * bytes8);
+    t->round = mem + 6 * bytes8;
+    t->flags = t->round + bytes8;
+    t->resp = t->flags + bytes8;
+    t->capacity = capacity;
+    return 0;
+}
+
+void gametab_destroy(struct gametab *t)
+{
+    if (t->mem != NULL) {
+        (void) munmap(t->mem, t->map_bytes);
+    }
+    (void) memset(t, 0, sizeof(*t));
+}
+
+size_t gametab_count(const struct gametab *t, uint32_t n, uint8_t min_round)
+{
+    const uint64_t high = 0x8080808080808080ULL;
+    const uint64_t low = 0x0101010101010101ULL;
+    size_t count = 0;
+    uint32_t i;
+
+    /* eight games per step: rounds stay below 128, so setting the top bit
+       of every byte and subtracting min_round keeps it iff the byte is at
+       least min_round, without borrowing into the next byte; GT_LIVE is
+       bit 0 and moves to the top bit */
+    for (i = 0; min_round < 128 && i + 8 <= n; i += 8) {
+        uint64_t rounds, flags;
+
+        (void) memcpy(&rounds, &t->round[i], sizeof(rounds));
+        (void) memcpy(&flags, &t->flags[i], sizeof(flags));
+        count += __builtin_popcountll(((rounds | high) - min_round * low)
+            & ((flags & low) << 7));
+    }
+    for (; i < n; ++i) {
+        count += (t->flags[i] & GT_LIVE) && t->round[i] >= min_round;
+    }
+    return count;
+}
+
+size_t gametab_play(struct gametab *t, const uint16_t *reqs, uint8_t *resps,
+    uint32_t n)
+{
+    size_t over = 0;
+
+    score_batch_pairs(reqs, t->secret, resps, n);
+    for (uint32_t i = 0; i < n; ++i) {
+        uint8_t resp;
+
+        if ((t->flags[i] & (GT_LIVE | GT_OVER)) != GT_LIVE) {
+            resps[i] = 0;
+            continue;
+        }
+        /* the same as game_answer() with a table of the secret */
+        resp = resps[i]
+            ^ ((reqs[i] >> REQUEST_PARITY_BIT) << SCORE_PARITY_BIT);
+        if (++t->round[i] >= MAX_TRIES
+            && ((resp & (1 << PARITY_ERR_BIT)) || (resp & PIN_MASK) != SLOTS)) {
+            resp |= 1 << GAME_LOST_ERR_BIT;
+        }
+        if (game_over(resp)) {
+            t->flags[i] |= GT_OVER;
+            over++;
+        }
+        t->resp[i] = resps[i] = resp;
+    }
+    return over;
+}
@@ -0,0 +1,105 @@
+/**
+ * @brief structure-of-arrays table of per-game state
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * The state a game needs between two rounds fits into five bytes: the
+ * packed 15 bit secret, the round counter, a few flags and the last
+ * response. The number of its connection, which names the game in the
+ * replay log (see replay.h), takes four more. Instead of one record per
+ * game the table keeps one dense array per field, so that a pass over all
+ * games (statistics, sweeps for idle games, scoring a batch of requests)
+ * only loads the fields it looks at: 64 games per cache line of rounds or
+ * flags, 32 per line of secrets. Games are named by their index, the
+ * caller allocates indices. All arrays live in one mapping that is only
+ * backed as it is used.
+*/
+
+#ifndef MM_GAMETAB_H_
+#define MM_GAMETAB_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* === Constants === */
+
+#define GT_LIVE (1 << 0)        /* a game is played at this index */
+#define GT_OVER (1 << 1)        /* won or lost, the connection is closed */
+
+/* === Type Definitions === */
+
+struct gametab {
+    uint32_t *conn;     /* number of the connection in its worker */
+    uint16_t *secret;   /* packed codes, see score.h */
+    uint8_t *round;     /* rounds played */
+    uint8_t *flags;     /* GT_* */
+    uint8_t *resp;      /* last response sent, see game.h */
+    uint32_t capacity;
+    void *mem;
+    size_t map_bytes;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Reserve the arrays of a table, all games are free
+ * @param t The table
+ * @param capacity Number of games
+ * @return 0 on success, -1 with errno set on error
+ */
+int gametab_init(struct gametab *t, uint32_t capacity);
+
+/**
+ * @brief Release the arrays of a table
+ * @param t The table
+ */
+void gametab_destroy(struct gametab *t);
+
+/**
+ * @brief Start a game at an index
+ * @param t The table
+ * @param idx The index
+ * @param secret The packed secret
+ * @param conn Number of the connection
+ */
+static inline void gametab_start(struct gametab *t, uint32_t idx,
+    uint16_t secret, uint32_t conn)
+{
+    t->conn[idx] = conn;
+    t->secret[idx] = secret;
+    t->round[idx] = 0;
+    t->flags[idx] = GT_LIVE;
+    t->resp[idx] = 0;
+}
+
+/**
+ * @brief Free the index of a game
+ * @param t The table
+ * @param idx The index
+ */
+static inline void gametab_end(struct gametab *t, uint32_t idx)
+{
+    t->flags[idx] = 0;
+}
+
+/**
+ * @brief Count the live games that have played at least some rounds
+ * @param t The table
+ * @param n Only look at the indices below n
+ * @param min_round The rounds
+ * @return Number of games
+ */
+size_t gametab_count(const struct gametab *t, uint32_t n, uint8_t min_round);
+
+/**
+ * @brief Play one round of every live game below an index
+ * @param t The table
+ * @param reqs n request words, see game.h; ignored for free indices
+ * @param resps n responses, 0 for free indices
+ * @param n Number of games
+ * @return Number of games that are over now
+ */
+size_t gametab_play(struct gametab *t, const uint16_t *reqs, uint8_t *resps,
+    uint32_t n);
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * @brief board geometries other than five slots of eight colors
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <string.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+#include "game.h"
+#include "geometry.h"
+
+/* === Kernels === */
+
+/* one instance of geometry_kernels.h per entry of GEOMETRIES; each
+   checks its GEO_* macros against these constants of its entry */
+
+#define GEO_CONSTANTS(id, name, slots, colors, shift, count) \
+    enum { slots_g ## name = slots, colors_g ## name = colors, \
+        shift_g ## name = shift };
+
+GEOMETRIES(GEO_CONSTANTS)
+
+#define GEO_NAME g4x6
+#define GEO_SLOTS 4
+#define GEO_COLORS 6
+#define GEO_SHIFT 3
+#include "geometry_kernels.h"
+#undef GEO_NAME
+#undef GEO_SLOTS
+#undef GEO_COLORS
+#undef GEO_SHIFT
+
+#define GEO_NAME g5x8
+#define GEO_SLOTS 5
+#define GEO_COLORS 8
+#define GEO_SHIFT 3
+#include "geometry_kernels.h"
+#undef GEO_NAME
+#undef GEO_SLOTS
+#undef GEO_COLORS
+#undef GEO_SHIFT
+
+#define GEO_NAME g6x10
+#define GEO_SLOTS 6
+#define GEO_COLORS 10
+#define GEO_SHIFT 4
+#include "geometry_kernels.h"
+#undef GEO_NAME
+#undef GEO_SLOTS
+#undef GEO_COLORS
+#undef GEO_SHIFT
+
+#define GEO_NAME g8x8
+#define GEO_SLOTS 8
+#define GEO_COLORS 8
+#define GEO_SHIFT 3
+#include "geometry_kernels.h"
+#undef GEO_NAME
+#undef GEO_SLOTS
+#undef GEO_COLORS
+#undef GEO_SHIFT
+
+/* === Global Variables === */
+
+#define GEO_ENTRY(id, name, slots, colors, shift, count) \
+    [id] = { #name, id, slots, colors, shift, count, \
+        score_g ## name, score_batch_g ## name, filter_g ## name, \
+        request_g ## name, answer_g ## name },
+
+static const struct geometry geometries[GEO_COUNT] = {
+    GEOMETRIES(GEO_ENTRY)
+};
+
+/* === Implementations === */
+
+const struct geometry *geometry_get(unsigned id)
+{
+    return id < GEO_COUNT ? &geometries[id] : NULL;
+}
+
+const struct geometry *geometry_find(const char *name)
+{
+    for (unsigned id = 0; id < GEO_COUNT; ++id) {
+        if (strcmp(geometries[id].name, name) == 0) {
+            return &geometries[id];
+        }
+    }
+    return NULL;
+}
+
+uint32_t geometry_code(const struct geometry *g, uint64_t r)
+{
+    uint32_t code = 0;
+
+    /* the top 32 bits scaled to the number of codes, then the digits */
+    r = ((r >> 32) * g->count) >> 32;
+    for (unsigned i = 0; i < g->slots; ++i) {
+        code |= (uint32_t) (r % g->colors) << (i * g->shift);
+        r /= g->colors;
+    }
+    return code;
+}
+
+void geometry_enumerate(const struct geometry *g, uint32_t *codes)
+{
+    uint8_t digits[GEO_MAX_SLOTS] = { 0 };
+    uint32_t code = 0;
+
+    /* count in base colors, with every digit in its own slot */
+    for (uint32_t n = 0; n < g->count; ++n) {
+        unsigned i = 0;
+
+        codes[n] = code;
+        while (i < g->slots && ++digits[i] == g->colors) {
+            code &= ~(((1u << g->shift) - 1) << (i * g->shift));
+            digits[i++] = 0;
+        }
+        if (i < g->slots) {
+            code += 1u << (i * g->shift);
+        }
+    }
+}
+
+uint8_t geometry_score_ref(const struct geometry *g, uint32_t guess,
+    uint32_t secret)
+{
+    unsigned mask = (1u << g->shift) - 1;
+    int colors_left[16] = { 0 };
+    int red = 0, white = 0;
+
+    for (unsigned j = 0; j < g->slots; ++j) {
+        unsigned gc = (guess >> (j * g->shift)) & mask;
+        unsigned sc = (secret >> (j * g->shift)) & mask;
+
+        if (gc == sc) {
+            red++;
+        } else {
+            colors_left[sc]++;
+        }
+    }
+    for (unsigned j = 0; j < g->slots; ++j) {
+        unsigned gc = (guess >> (j * g->shift)) & mask;
+        unsigned sc = (secret >> (j * g->shift)) & mask;
+
+        if (gc != sc && colors_left[gc] > 0) {
+            white++;
+            colors_left[gc]--;
+        }
+    }
+    return red | (white << GEO_WHITE_SHIFT);
+}
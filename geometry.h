@@ -0,0 +1,134 @@
+/**
+ * @brief board geometries other than five slots of eight colors
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * A geometry is a number of slots and colors. Codes are packed like in
+ * score.h, slot i in bits w*i..w*i+w-1 with w the smallest width that
+ * holds every color, but into 32 bits. A score has the red pins in bits
+ * 0-3 and the white pins in bits 4-7.
+ *
+ * Every geometry in GEOMETRIES gets its own kernels: geometry.c includes
+ * geometry_kernels.h once per entry, so slots, colors and widths are
+ * constants and the loops over them are unrolled. A game picks its
+ * geometry once and then calls through the descriptor, nothing is
+ * generic at runtime. 5x8 is the geometry of score.h and of games that
+ * do not ask for one, those keep using score.h and codec.h directly.
+ *
+ * Wire format: a client that sends GEO_HELLO as its first request,
+ * followed by a byte with the geometry's id, gets GEO_ACK back, or
+ * GEO_UNKNOWN if the server does not know the id. Requests are then
+ * little endian 32 bit words, the code with the parity of its bits in
+ * bit 31; responses are little endian 16 bit words, the score with an
+ * invalid request (parity error or a color out of range) in bit 8 and
+ * game lost in bit 9. GEO_HELLO has a bad parity, so servers without
+ * geometries answer it with a parity error and close the connection.
+*/
+
+#ifndef MM_GEOMETRY_H_
+#define MM_GEOMETRY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* === Constants === */
+
+/* id, name, slots, colors, bits per slot, number of codes */
+#define GEOMETRIES(X) \
+    X(0, 4x6, 4, 6, 3, 1296) \
+    X(1, 5x8, 5, 8, 3, 32768) \
+    X(2, 6x10, 6, 10, 4, 1000000) \
+    X(3, 8x8, 8, 8, 3, 16777216)
+
+#define GEO_COUNT (4)
+#define GEO_MAX_SLOTS (8)
+
+#define GEO_HELLO (0xfffb)
+#define GEO_HELLO_BYTES (3)
+#define GEO_ACK (0xff)
+#define GEO_UNKNOWN (0xc0)      /* parity error and game lost */
+#define GEO_REQ_BYTES (4)
+#define GEO_RESP_BYTES (2)
+
+#define GEO_REQUEST_PARITY_BIT (31)
+#define GEO_WHITE_SHIFT (4)
+#define GEO_PIN_MASK (0xf)
+#define GEO_INVALID_BIT (8)
+#define GEO_LOST_BIT (9)
+
+/* === Type Definitions === */
+
+/* A geometry and its kernels */
+struct geometry {
+    const char *name;
+    unsigned id;
+    unsigned slots;
+    unsigned colors;
+    unsigned shift;         /* bits per slot */
+    uint32_t count;         /* codes with every slot below colors */
+
+    /* the kernels, see geometry_kernels.h */
+    uint8_t (*score)(uint32_t guess, uint32_t secret);
+    void (*score_batch)(uint32_t secret, const uint32_t *guesses,
+        uint8_t *scores, size_t n);
+    size_t (*filter)(uint32_t guess, uint8_t score, uint32_t *codes,
+        size_t n);
+    uint32_t (*request)(uint32_t code);
+    uint16_t (*answer)(uint32_t secret, uint32_t req, int round);
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Get a geometry
+ * @param id Its id
+ * @return The geometry or NULL if there is none with this id
+ */
+const struct geometry *geometry_get(unsigned id);
+
+/**
+ * @brief Find a geometry by name
+ * @param name Slots and colors, e.g. "6x10"
+ * @return The geometry or NULL if there is none with this name
+ */
+const struct geometry *geometry_find(const char *name);
+
+/**
+ * @brief Turn random bits into a code
+ * @param g The geometry
+ * @param r 64 random bits
+ * @return A packed code, uniform over all codes of g if r is uniform
+ */
+uint32_t geometry_code(const struct geometry *g, uint64_t r);
+
+/**
+ * @brief List all codes in order
+ * @param g The geometry
+ * @param codes g->count packed codes
+ */
+void geometry_enumerate(const struct geometry *g, uint32_t *codes);
+
+/**
+ * @brief Score a guess, straightforward reference implementation for any
+ * geometry
+ * @param g The geometry
+ * @param guess The packed guess
+ * @param secret The packed secret
+ * @return The score, same as g->score()
+ */
+uint8_t geometry_score_ref(const struct geometry *g, uint32_t guess,
+    uint32_t secret);
+
+/**
+ * @brief Check whether a response ends the game
+ * @param g The geometry of the game
+ * @param resp The response word
+ * @return Nonzero if the game was won, lost or the request was invalid
+ */
+static inline int geometry_over(const struct geometry *g, uint16_t resp)
+{
+    return (resp & GEO_PIN_MASK) == g->slots
+        || (resp & ((1 << GEO_INVALID_BIT) | (1 << GEO_LOST_BIT)));
+}
+
+#endif
@@ -0,0 +1,302 @@
+/**
+ * @brief kernels of one board geometry, see geometry.h
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Only included by geometry.c, once per geometry, with GEO_SLOTS,
+ * GEO_COLORS, GEO_SHIFT and GEO_NAME defined; the functions are named
+ * after GEO_NAME. They work like score_swar() and codec.h, with the
+ * widths as constants: fields are found with shifts by constants, the
+ * loops over slots and colors are unrolled and colors beyond the last one
+ * cost nothing if every value of a field is a color.
+ *
+ * No include guard, the macros are undefined at the end.
+*/
+
+#define GEO_CAT2(a, b) a ## _ ## b
+#define GEO_CAT(a, b) GEO_CAT2(a, b)
+#define GEO_FN(f) GEO_CAT(f, GEO_NAME)
+
+#define GEO_CODE_BITS (GEO_SLOTS * GEO_SHIFT)
+#define GEO_CODE_MASK ((1u << GEO_CODE_BITS) - 1)
+#define GEO_FIELD_MASK ((1u << GEO_SHIFT) - 1)
+/* lowest bit of every slot */
+#define GEO_LSB (GEO_CODE_MASK / GEO_FIELD_MASK)
+/* the lower half of the slots, for counting in two steps */
+#define GEO_HALF (GEO_SLOTS / 2)
+#define GEO_LSB_LOW ((1u << (GEO_HALF * GEO_SHIFT)) / GEO_FIELD_MASK)
+/* per color counts, a guard bit above the count of up to 8 slots */
+#define GEO_HIST_BITS (6)
+#define GEO_HIST_LSB (((1ULL << (GEO_HIST_BITS * GEO_COLORS)) - 1) \
+    / ((1u << GEO_HIST_BITS) - 1))
+#define GEO_HIST_GUARD (GEO_HIST_LSB << (GEO_HIST_BITS - 1))
+
+/* the block that includes this has to match its entry in GEOMETRIES */
+__extension__ _Static_assert(GEO_SLOTS == GEO_FN(slots)
+    && GEO_COLORS == GEO_FN(colors) && GEO_SHIFT == GEO_FN(shift),
+    "GEO_SLOTS, GEO_COLORS or GEO_SHIFT differ from GEOMETRIES");
+
+/**
+ * @brief Count the slots whose lowest bit is set
+ * @param fields A code masked with GEO_LSB
+ * @return Number of bits set
+ */
+static inline unsigned GEO_FN(count)(uint32_t fields)
+{
+#if GEO_SLOTS < (1 << GEO_SHIFT)
+    /* the multiplication sums up all bits in the highest slot */
+    return ((fields * GEO_LSB) >> (GEO_CODE_BITS - GEO_SHIFT))
+        & GEO_FIELD_MASK;
+#else
+    /* the sum does not fit into a slot, add up two halves */
+    return ((((fields & GEO_LSB_LOW) * GEO_LSB_LOW)
+        >> ((GEO_HALF - 1) * GEO_SHIFT)) & GEO_FIELD_MASK)
+        + ((((fields >> (GEO_HALF * GEO_SHIFT)) * GEO_LSB)
+        >> ((GEO_SLOTS - GEO_HALF - 1) * GEO_SHIFT)) & GEO_FIELD_MASK);
+#endif
+}
+
+/**
+ * @brief Mark the slots of a value that are not zero
+ * @param x The value
+ * @return The lowest bit of every slot that is not zero
+ */
+static inline uint32_t GEO_FN(nonzero)(uint32_t x)
+{
+    uint32_t nz = x;
+
+#pragma GCC unroll 8
+    for (unsigned k = 1; k < GEO_SHIFT; ++k) {
+        nz |= x >> k;
+    }
+    return nz & GEO_LSB;
+}
+
+/**
+ * @brief Count the slots of a code for every color
+ * @param code The code
+ * @return GEO_HIST_BITS bits per color, the count of color c in bits
+ * GEO_HIST_BITS*c and up
+ */
+static inline uint64_t GEO_FN(hist)(uint32_t code)
+{
+    uint64_t h = 0;
+
+#pragma GCC unroll 16
+    for (unsigned i = 0; i < GEO_SLOTS; ++i) {
+        /* colors out of range are invalid requests anyway, the mask only
+           keeps the shift defined */
+        h += 1ULL << ((((code >> (i * GEO_SHIFT)) & GEO_FIELD_MASK)
+            * GEO_HIST_BITS) & 63);
+    }
+    return h;
+}
+
+/**
+ * @brief Score a guess against a secret whose colors are counted
+ * @param guess The guess
+ * @param secret The secret
+ * @param secret_hist Its counts, see hist()
+ * @return The score
+ */
+static inline uint8_t GEO_FN(score_counted)(uint32_t guess, uint32_t secret,
+    uint64_t secret_hist)
+{
+    uint64_t g = GEO_FN(hist)(guess), ge, mask;
+    unsigned red = GEO_SLOTS - GEO_FN(count)(GEO_FN(nonzero)(
+        (guess ^ secret) & GEO_CODE_MASK));
+    unsigned common;
+
+    /* the guard bit of a lane survives g + guard - s iff g >= s, so the
+       mask selects the minimum of both counts per color */
+    ge = (((g | GEO_HIST_GUARD) - secret_hist) & GEO_HIST_GUARD)
+        >> (GEO_HIST_BITS - 1);
+    mask = (ge << (GEO_HIST_BITS - 1)) - ge;
+    common = ((((secret_hist & mask) | (g & ~mask)) * GEO_HIST_LSB)
+        >> (GEO_HIST_BITS * (GEO_COLORS - 1))) & ((1u << GEO_HIST_BITS) - 1);
+    return red | ((common - red) << GEO_WHITE_SHIFT);
+}
+
+static uint8_t GEO_FN(score)(uint32_t guess, uint32_t secret)
+{
+    return GEO_FN(score_counted)(guess, secret, GEO_FN(hist)(secret));
+}
+
+#ifdef __SSE2__
+
+/* 8 codes per vector, the same steps as the scalar version */
+
+__attribute__((target("avx2")))
+static inline __m256i GEO_FN(count_avx2)(__m256i fields)
+{
+    const __m256i mask = _mm256_set1_epi32(GEO_FIELD_MASK);
+#if GEO_SLOTS < (1 << GEO_SHIFT)
+    return _mm256_and_si256(_mm256_srli_epi32(_mm256_mullo_epi32(fields,
+        _mm256_set1_epi32(GEO_LSB)), GEO_CODE_BITS - GEO_SHIFT), mask);
+#else
+    const __m256i low = _mm256_set1_epi32(GEO_LSB_LOW);
+    __m256i lo = _mm256_mullo_epi32(_mm256_and_si256(fields, low), low);
+    __m256i hi = _mm256_mullo_epi32(
+        _mm256_srli_epi32(fields, GEO_HALF * GEO_SHIFT),
+        _mm256_set1_epi32(GEO_LSB));
+
+    return _mm256_add_epi32(
+        _mm256_and_si256(_mm256_srli_epi32(lo, (GEO_HALF - 1) * GEO_SHIFT),
+            mask),
+        _mm256_and_si256(_mm256_srli_epi32(hi,
+            (GEO_SLOTS - GEO_HALF - 1) * GEO_SHIFT), mask));
+#endif
+}
+
+__attribute__((target("avx2")))
+static inline __m256i GEO_FN(nonzero_avx2)(__m256i x)
+{
+    __m256i nz = x;
+
+#pragma GCC unroll 8
+    for (unsigned k = 1; k < GEO_SHIFT; ++k) {
+        nz = _mm256_or_si256(nz, _mm256_srli_epi32(x, k));
+    }
+    return _mm256_and_si256(nz, _mm256_set1_epi32(GEO_LSB));
+}
+
+/**
+ * @brief Score 8 guesses against a secret whose colors are counted
+ * @param guesses The guesses
+ * @param secret The secret
+ * @param counts Its counts, broadcast
+ * @return 8 scores in 32 bit lanes
+ */
+__attribute__((target("avx2")))
+static inline __m256i GEO_FN(score_avx2)(__m256i guesses, uint32_t secret,
+    const __m256i *counts)
+{
+    const __m256i lsb = _mm256_set1_epi32(GEO_LSB);
+    __m256i red, common = _mm256_setzero_si256();
+
+    guesses = _mm256_and_si256(guesses, _mm256_set1_epi32(GEO_CODE_MASK));
+    red = _mm256_sub_epi32(_mm256_set1_epi32(GEO_SLOTS),
+        GEO_FN(count_avx2)(GEO_FN(nonzero_avx2)(
+            _mm256_xor_si256(guesses, _mm256_set1_epi32(secret)))));
+#pragma GCC unroll 16
+    for (unsigned c = 0; c < GEO_COLORS; ++c) {
+        __m256i nz = GEO_FN(nonzero_avx2)(
+            _mm256_xor_si256(guesses, _mm256_set1_epi32(c * GEO_LSB)));
+        __m256i n = GEO_FN(count_avx2)(_mm256_andnot_si256(nz, lsb));
+
+        common = _mm256_add_epi32(common, _mm256_min_epu32(n, counts[c]));
+    }
+    return _mm256_or_si256(red, _mm256_slli_epi32(
+        _mm256_sub_epi32(common, red), GEO_WHITE_SHIFT));
+}
+
+/**
+ * @brief Batch kernel with 8 guesses per step
+ * @return Number of guesses scored, the rest is left to the caller
+ */
+__attribute__((target("avx2")))
+static size_t GEO_FN(batch_avx2)(uint32_t secret, const uint32_t *guesses,
+    uint8_t *scores, size_t n)
+{
+    const __m256i pack = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1);
+    uint64_t h = GEO_FN(hist)(secret);
+    __m256i bc[GEO_COLORS];
+    size_t i;
+
+    for (unsigned c = 0; c < GEO_COLORS; ++c) {
+        bc[c] = _mm256_set1_epi32((h >> (c * GEO_HIST_BITS))
+            & ((1u << GEO_HIST_BITS) - 1));
+    }
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i r = _mm256_shuffle_epi8(GEO_FN(score_avx2)(
+            _mm256_loadu_si256((const __m256i *) &guesses[i]), secret, bc),
+            pack);
+
+        /* the low 4 bytes of both halves hold the scores */
+        _mm_storel_epi64((__m128i *) &scores[i], _mm_unpacklo_epi32(
+            _mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1)));
+    }
+    return i;
+}
+
+#endif
+
+static void GEO_FN(score_batch)(uint32_t secret, const uint32_t *guesses,
+    uint8_t *scores, size_t n)
+{
+    uint64_t h;
+    size_t i = 0;
+
+    secret &= GEO_CODE_MASK;
+#ifdef __SSE2__
+    if (__builtin_cpu_supports("avx2")) {
+        i = GEO_FN(batch_avx2)(secret, guesses, scores, n);
+    }
+#endif
+    h = GEO_FN(hist)(secret);
+    for (; i < n; ++i) {
+        scores[i] = GEO_FN(score_counted)(guesses[i] & GEO_CODE_MASK, secret,
+            h);
+    }
+}
+
+static size_t GEO_FN(filter)(uint32_t guess, uint8_t score, uint32_t *codes,
+    size_t n)
+{
+    uint8_t scores[256];
+    size_t kept = 0;
+
+    /* scores are symmetric, so every code can be scored as the secret of
+       the guess in one batch */
+    for (size_t base = 0; base < n; base += sizeof(scores)) {
+        size_t len = n - base < sizeof(scores) ? n - base : sizeof(scores);
+
+        GEO_FN(score_batch)(guess, &codes[base], scores, len);
+        for (size_t i = 0; i < len; ++i) {
+            codes[kept] = codes[base + i];
+            kept += scores[i] == score;
+        }
+    }
+    return kept;
+}
+
+static uint32_t GEO_FN(request)(uint32_t code)
+{
+    code &= GEO_CODE_MASK;
+    return code | ((uint32_t) __builtin_parity(code)
+        << GEO_REQUEST_PARITY_BIT);
+}
+
+static uint16_t GEO_FN(answer)(uint32_t secret, uint32_t req, int round)
+{
+    uint32_t code = req & GEO_CODE_MASK;
+    unsigned invalid = __builtin_parity(req)
+        | ((req & ~(GEO_CODE_MASK | (1u << GEO_REQUEST_PARITY_BIT))) != 0);
+    uint16_t resp;
+
+    /* a constant false per slot if every value of a field is a color */
+#pragma GCC unroll 16
+    for (unsigned i = 0; i < GEO_SLOTS; ++i) {
+        invalid |= ((code >> (i * GEO_SHIFT)) & GEO_FIELD_MASK) >= GEO_COLORS;
+    }
+    resp = GEO_FN(score)(code, secret) | (invalid << GEO_INVALID_BIT);
+    if (round >= MAX_TRIES && (invalid || (resp & GEO_PIN_MASK) != GEO_SLOTS)) {
+        resp |= 1 << GEO_LOST_BIT;
+    }
+    return resp;
+}
+
+#undef GEO_CAT2
+#undef GEO_CAT
+#undef GEO_FN
+#undef GEO_CODE_BITS
+#undef GEO_CODE_MASK
+#undef GEO_FIELD_MASK
+#undef GEO_LSB
+#undef GEO_HALF
+#undef GEO_LSB_LOW
+#undef GEO_HIST_BITS
+#undef GEO_HIST_LSB
+#undef GEO_HIST_GUARD
@@ -0,0 +1,71 @@
+/*
+ * @brief log-linear latency histograms in the style of HdrHistogram
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdint.h>
+#include "hist.h"
+
+/* === Implementations === */
+
+/**
+ * @brief Get the highest value of a bucket
+ * @param b The bucket
+ * @return The value
+ */
+static uint64_t bucket_max(unsigned int b)
+{
+    unsigned int shift;
+
+    if (b < (1 << HIST_SUB_BITS)) {
+        return b;
+    }
+    shift = (b >> HIST_SUB_BITS) - 1;
+    return ((uint64_t) ((b & ((1 << HIST_SUB_BITS) - 1))
+        | (1 << HIST_SUB_BITS)) << shift) + ((uint64_t) 1 << shift) - 1;
+}
+
+void hist_merge(struct hist *dst, const struct hist *src)
+{
+    for (unsigned int b = 0; b < HIST_BUCKETS; ++b) {
+        dst->counts[b] += __atomic_load_n(&src->counts[b], __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t hist_count(const struct hist *h)
+{
+    uint64_t n = 0;
+
+    for (unsigned int b = 0; b < HIST_BUCKETS; ++b) {
+        n += h->counts[b];
+    }
+    return n;
+}
+
+uint64_t hist_percentile(const struct hist *h, double p)
+{
+    uint64_t total = hist_count(h), seen = 0, rank;
+
+    if (total == 0) {
+        return 0;
+    }
+    /* the smallest value that at least p percent do not exceed */
+    rank = p / 100 * total;
+    if (rank < p / 100 * total) {
+        rank++;
+    }
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > total) {
+        rank = total;
+    }
+    for (unsigned int b = 0; b < HIST_BUCKETS; ++b) {
+        seen += h->counts[b];
+        if (seen >= rank) {
+            return bucket_max(b);
+        }
+    }
+    return bucket_max(HIST_BUCKETS - 1);
+}
@@ -0,0 +1,90 @@
+/**
+ * @brief log-linear latency histograms in the style of HdrHistogram
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Values below 2^HIST_SUB_BITS get a bucket each, larger ones are
+ * bucketed by their highest set bit and the HIST_SUB_BITS bits below it,
+ * so every bucket is at most 1/32 (3%) of its value wide. Values up to
+ * 2^HIST_MAX_BITS (18 minutes in nanoseconds) are kept, larger ones
+ * count as the largest bucket. A histogram has one writer, which
+ * records without locks or read-modify-write instructions; other threads
+ * may read it at any time with hist_merge() and see every count either
+ * before or after an update.
+*/
+
+#ifndef MM_HIST_H_
+#define MM_HIST_H_
+
+#include <stdint.h>
+
+/* === Constants === */
+
+#define HIST_SUB_BITS (5)
+#define HIST_MAX_BITS (40)
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+/* === Type Definitions === */
+
+struct hist {
+    uint64_t counts[HIST_BUCKETS];
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Get the bucket of a value
+ * @param v The value
+ * @return Index into counts
+ */
+static inline unsigned int hist_bucket(uint64_t v)
+{
+    unsigned int e;
+
+    if (v < (1 << HIST_SUB_BITS)) {
+        return v;
+    }
+    if (v >> HIST_MAX_BITS) {
+        return HIST_BUCKETS - 1;
+    }
+    e = 63 - __builtin_clzll(v);
+    return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+        + ((v >> (e - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+}
+
+/**
+ * @brief Record a value, only from the thread owning the histogram
+ * @param h The histogram
+ * @param v The value
+ * @param n How many times it occurred
+ */
+static inline void hist_record(struct hist *h, uint64_t v, uint64_t n)
+{
+    uint64_t *c = &h->counts[hist_bucket(v)];
+
+    __atomic_store_n(c, *c + n, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Add the counts of a histogram to another one
+ * @param dst The sum
+ * @param src The histogram, may be updated meanwhile
+ */
+void hist_merge(struct hist *dst, const struct hist *src);
+
+/**
+ * @brief Count the recorded values
+ * @param h The histogram
+ * @return Number of values
+ */
+uint64_t hist_count(const struct hist *h);
+
+/**
+ * @brief Get a percentile of the recorded values
+ * @param h The histogram
+ * @param p The percentile, 0 to 100
+ * @return The highest value of the bucket holding it, 0 if it is empty
+ */
+uint64_t hist_percentile(const struct hist *h, double p);
+
+#endif
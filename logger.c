@@ -0,0 +1,166 @@
+/*
+ * @brief asynchronous logger for the hot paths of client and server
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include "logger.h"
+
+/* === Type Definitions === */
+
+/* One slot of the ring; seq tells producers and consumer who owns it */
+struct log_record {
+    uint64_t seq;
+    uint64_t stamp;
+    const char *fmt;
+    long long args[LOG_MAX_ARGS];
+    int level;
+} __attribute__((aligned(64)));
+
+/* === Global Variables === */
+
+int log_level = -1;
+
+static struct log_record ring[LOG_RING_SIZE];
+
+/* next slot for producers, on its own cache line */
+static uint64_t head __attribute__((aligned(64)));
+
+/* next slot for the consumer, only touched by the background thread */
+static uint64_t tail __attribute__((aligned(64)));
+
+static uint64_t dropped;
+static volatile int stopping = 0;
+static int running = 0;
+static pthread_t thread;
+
+static const char *level_names[] = { "error", "warn", "info", "debug" };
+
+/* === Implementations === */
+
+void log_push(int level, const char *fmt,
+    long long a, long long b, long long c, long long d)
+{
+    struct log_record *rec;
+    uint64_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    struct timespec ts;
+
+    /* bounded MPMC queue after D. Vyukov, used with a single consumer */
+    for (;;) {
+        uint64_t seq;
+        int64_t dif;
+
+        rec = &ring[pos & (LOG_RING_SIZE - 1)];
+        seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        dif = (int64_t) (seq - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&head, &pos, pos + 1, 1,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            /* full: never block the caller */
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+    }
+
+    (void) clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    rec->stamp = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->fmt = fmt;
+    rec->level = level;
+    rec->args[0] = a;
+    rec->args[1] = b;
+    rec->args[2] = c;
+    rec->args[3] = d;
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Format all records that are ready
+ * @return Number of records written
+ */
+static int drain(void)
+{
+    int n = 0;
+
+    for (;;) {
+        struct log_record *rec = &ring[tail & (LOG_RING_SIZE - 1)];
+        FILE *out;
+
+        if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+            break;
+        }
+        out = rec->level <= LVL_WARN ? stderr : stdout;
+        (void) fprintf(out, "[%llu.%06llu] %s: ",
+            (unsigned long long) (rec->stamp / 1000000000ULL),
+            (unsigned long long) (rec->stamp % 1000000000ULL / 1000),
+            level_names[rec->level]);
+        (void) fprintf(out, rec->fmt,
+            rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+        (void) fputc('\n', out);
+        /* hand the slot back to the producers of the next lap */
+        __atomic_store_n(&rec->seq, tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        tail++;
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Background thread, drains the ring until the logger is stopped
+ * @param arg unused
+ * @return NULL
+ */
+static void *run_logger(void *arg)
+{
+    const struct timespec idle = { 0, 1000000 };
+
+    while (!stopping) {
+        if (drain() == 0) {
+            (void) fflush(stdout);
+            (void) fflush(stderr);
+            (void) nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+int log_start(int level)
+{
+    for (uint64_t i = 0; i < LOG_RING_SIZE; ++i) {
+        ring[i].seq = i;
+    }
+    head = tail = dropped = 0;
+    stopping = 0;
+    log_level = level;
+    if (pthread_create(&thread, NULL, run_logger, NULL) != 0) {
+        log_level = -1;
+        return -1;
+    }
+    running = 1;
+    return 0;
+}
+
+void log_stop(void)
+{
+    if (!running) {
+        return;
+    }
+    stopping = 1;
+    (void) pthread_join(thread, NULL);
+    running = 0;
+    (void) drain();
+    if (dropped > 0) {
+        (void) fprintf(stderr, "logger: %llu records dropped\n",
+            (unsigned long long) dropped);
+    }
+    (void) fflush(stdout);
+    (void) fflush(stderr);
+}
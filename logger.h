@@ -0,0 +1,73 @@
+/**
+ * @brief asynchronous logger for the hot paths of client and server
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * LOG() stores a fixed size binary record (level, timestamp, format string
+ * and up to LOG_MAX_ARGS integer arguments) in a lock-free multi-producer
+ * ring. A background thread drains the ring and does the formatting, so a
+ * call costs one comparison when the level is disabled and a few atomic
+ * operations when it is enabled. If the ring is full the record is dropped
+ * instead of blocking the caller.
+ *
+ * All arguments are passed as long long, so the format string has to use
+ * %lld, %llx, etc. for every conversion. The format string must outlive
+ * the logger (use string literals).
+*/
+
+#ifndef MM_LOGGER_H_
+#define MM_LOGGER_H_
+
+#include <stdint.h>
+
+/* === Constants === */
+
+#define LVL_ERROR (0)
+#define LVL_WARN (1)
+#define LVL_INFO (2)
+#define LVL_DEBUG (3)
+
+#define LOG_MAX_ARGS (4)
+#define LOG_RING_SIZE (8192) /* records, has to be a power of two */
+
+/* === Macros === */
+
+/* Log a message if level is enabled, arguments are converted to long long */
+#define LOG(level, ...) do { \
+    if ((level) <= log_level) { \
+        log_push((level), LOG_FMT_(__VA_ARGS__, 0, 0, 0, 0, 0)); \
+    } \
+} while(0)
+
+/* Helpers that split __VA_ARGS__ into the format and exactly four args */
+#define LOG_FMT_(fmt, a, b, c, d, ...) \
+    (fmt), (long long)(a), (long long)(b), (long long)(c), (long long)(d)
+
+/* === Global Variables === */
+
+/* Highest level that is logged, records above it cost one comparison */
+extern int log_level;
+
+/* === Prototypes === */
+
+/**
+ * @brief Start the background thread that formats the records
+ * @param level Highest level to log
+ * @return 0 on success, -1 if the thread could not be started
+ */
+int log_start(int level);
+
+/**
+ * @brief Store a record in the ring, use LOG() instead
+ * @param level Level of the record
+ * @param fmt printf format string with %lld conversions only
+ */
+void log_push(int level, const char *fmt,
+    long long a, long long b, long long c, long long d);
+
+/**
+ * @brief Write all pending records and stop the background thread
+ */
+void log_stop(void);
+
+#endif
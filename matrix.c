@@ -0,0 +1,136 @@
+/*
+ * @brief packed on-disk matrix of score classes, shared via mmap
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix.h"
+
+/* === Implementations === */
+
+int matrix_build(const char *path, const uint16_t *guesses, uint32_t n)
+{
+    static struct matrix_header h;
+    static uint16_t secrets[CODES];
+    static uint16_t rows[CODES];
+    static uint8_t scores[CODES];
+    uint8_t *row;
+    FILE *f;
+    int ret = 0;
+
+    if (n > CODES || (row = calloc(1, MATRIX_ROW_BYTES)) == NULL) {
+        errno = n > CODES ? EINVAL : ENOMEM;
+        return -1;
+    }
+    (void) memset(&h, 0, sizeof(h));
+    (void) memcpy(h.magic, MATRIX_MAGIC, sizeof(h.magic));
+    h.slots = SLOTS;
+    h.colors = COLORS;
+    h.row_bytes = MATRIX_ROW_BYTES;
+    h.rows_offset = (sizeof(h) + 4095) / 4096 * 4096;
+    (void) memset(h.row_of, 0xff, sizeof(h.row_of));
+    for (uint32_t i = 0; i < n; ++i) {
+        uint16_t g = guesses[i] & CODE_MASK;
+        if (h.row_of[g] == MATRIX_NO_ROW) {
+            rows[h.nrows] = g;
+            h.row_of[g] = h.nrows++;
+        }
+    }
+    for (uint32_t i = 0; i < CODES; ++i) {
+        secrets[i] = i;
+    }
+
+    if ((f = fopen(path, "wb")) == NULL) {
+        free(row);
+        return -1;
+    }
+    if (fwrite(&h, sizeof(h), 1, f) != 1
+        || fseek(f, h.rows_offset, SEEK_SET) < 0) {
+        ret = -1;
+    }
+    for (uint32_t i = 0; i < h.nrows && ret == 0; ++i) {
+        uint16_t *words = (uint16_t *) row;
+
+        score_batch_secrets(rows[i], secrets, scores, CODES);
+        (void) memset(row, 0, MATRIX_ROW_BYTES);
+        for (uint32_t s = 0; s < CODES; ++s) {
+            int cls = (scores[s] & 0x7) * (SLOTS + 1)
+                + ((scores[s] >> SHIFT_WIDTH) & 0x7);
+            words[s / 3] |= cls << (5 * (s % 3));
+        }
+        if (fwrite(row, MATRIX_ROW_BYTES, 1, f) != 1) {
+            ret = -1;
+        }
+    }
+    free(row);
+    if (fclose(f) != 0) {
+        ret = -1;
+    }
+    return ret < 0 ? -1 : (int) h.nrows;
+}
+
+int matrix_open(struct matrix *m, const char *path)
+{
+    const struct matrix_header *h;
+    struct stat st;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0) {
+        (void) close(fd);
+        return -1;
+    }
+    m->size = st.st_size;
+    if (m->size < sizeof(*h)) {
+        (void) close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    m->base = mmap(NULL, m->size, PROT_READ, MAP_SHARED, fd, 0);
+    (void) close(fd);
+    if (m->base == MAP_FAILED) {
+        return -1;
+    }
+
+    h = m->base;
+    if (memcmp(h->magic, MATRIX_MAGIC, sizeof(h->magic)) != 0
+        || h->slots != SLOTS || h->colors != COLORS
+        || h->row_bytes != MATRIX_ROW_BYTES
+        || h->rows_offset < sizeof(*h) || h->rows_offset > m->size
+        || (uint64_t) h->nrows * MATRIX_ROW_BYTES
+            > m->size - h->rows_offset) {
+        (void) munmap(m->base, m->size);
+        errno = EINVAL;
+        return -1;
+    }
+    /* matrix_row() trusts row_of, a corrupt entry would read past the map */
+    for (uint32_t g = 0; g < CODES; ++g) {
+        if (h->row_of[g] != MATRIX_NO_ROW && h->row_of[g] >= h->nrows) {
+            (void) munmap(m->base, m->size);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    m->header = h;
+    m->rows = (const uint8_t *) m->base + h->rows_offset;
+    return 0;
+}
+
+void matrix_close(struct matrix *m)
+{
+    if (m->base != NULL) {
+        (void) munmap(m->base, m->size);
+        m->base = NULL;
+    }
+}
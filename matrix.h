@@ -0,0 +1,106 @@
+/**
+ * @brief packed on-disk matrix of score classes, shared via mmap
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * A row holds the score class (red * (SLOTS + 1) + white, at most 30) of
+ * one guess against all 32768 secrets. Classes take 5 bits and three of
+ * them are packed into a 16 bit word, so a row is 21.3 KiB and the full
+ * matrix 683 MiB instead of 1 GiB. (21 classes do not fit into 4 bits,
+ * which rules out 16 KiB rows.) A file may hold only a subset of the rows.
+ *
+ * Files are mapped read-only with MAP_SHARED, so all processes using the
+ * same file share one copy in the page cache and opening it costs a few
+ * system calls instead of computing the scores.
+*/
+
+#ifndef MM_MATRIX_H_
+#define MM_MATRIX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "score.h"
+
+/* === Constants === */
+
+#define MATRIX_MAGIC "MMSCORE1"
+#define MATRIX_NO_ROW (0xffff)
+#define MATRIX_ROW_WORDS ((CODES + 2) / 3)
+/* rows start on a cache line */
+#define MATRIX_ROW_BYTES ((MATRIX_ROW_WORDS * 2 + 63) / 64 * 64)
+
+/* === Type Definitions === */
+
+/* File header, followed by the row index and the rows */
+struct matrix_header {
+    char magic[8];
+    uint32_t slots;
+    uint32_t colors;
+    uint32_t nrows;
+    uint32_t row_bytes;
+    uint64_t rows_offset;           /* file offset of the first row */
+    uint16_t row_of[CODES];         /* row of every guess or MATRIX_NO_ROW */
+};
+
+struct matrix {
+    void *base;
+    size_t size;
+    const struct matrix_header *header;
+    const uint8_t *rows;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Compute the rows of some guesses and write them to a file
+ * @param path The file to create
+ * @param guesses The packed guesses whose rows are stored
+ * @param n Number of guesses
+ * @return Number of rows written, a guess listed twice has one; -1 on
+ * error (errno is set)
+ */
+int matrix_build(const char *path, const uint16_t *guesses, uint32_t n);
+
+/**
+ * @brief Map a matrix file
+ * @param m Receives the mapping
+ * @param path The file
+ * @return 0 on success, -1 on error (errno is set, EINVAL for a bad file)
+ */
+int matrix_open(struct matrix *m, const char *path);
+
+/**
+ * @brief Unmap a matrix file
+ * @param m The mapping
+ */
+void matrix_close(struct matrix *m);
+
+/**
+ * @brief Get the row of a guess
+ * @param m The matrix
+ * @param guess The packed guess
+ * @return The row or NULL if the file does not contain it
+ */
+static inline const uint16_t *matrix_row(const struct matrix *m,
+    uint16_t guess)
+{
+    uint16_t row = m->header->row_of[guess & CODE_MASK];
+
+    if (row == MATRIX_NO_ROW) {
+        return NULL;
+    }
+    return (const uint16_t *) (m->rows + (size_t) row * MATRIX_ROW_BYTES);
+}
+
+/**
+ * @brief Look up a score class in a row
+ * @param row A row returned by matrix_row()
+ * @param secret The packed secret
+ * @return red * (SLOTS + 1) + white
+ */
+static inline int matrix_class(const uint16_t *row, uint16_t secret)
+{
+    return (row[secret / 3] >> (5 * (secret % 3))) & 0x1f;
+}
+
+#endif
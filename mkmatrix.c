@@ -0,0 +1,137 @@
+/*
+ * @brief generator for score matrix files, see matrix.h
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * mkmatrix [-g guess-file] <matrix-file>
+ *
+ * Without -g the file holds the rows of all 32768 guesses, otherwise only
+ * those of the codes listed in guess-file (one code per line, written as
+ * color letters like the server's secret).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <errno.h>
+#include "tbucket.h"
+#include "matrix.h"
+
+/* === Global Variables === */
+
+/* Name of the program */
+static const char *progname = "mkmatrix"; /* default name */
+
+/* === Implementations === */
+
+/**
+ * @brief terminate program on program error
+ * @param exitcode exit code
+ * @param fmt format string
+ */
+static void bail_out(int exitcode, const char *fmt, ...)
+{
+    va_list ap;
+
+    (void) fprintf(stderr, "%s: ", progname);
+    if (fmt != NULL) {
+        va_start(ap, fmt);
+        (void) vfprintf(stderr, fmt, ap);
+        va_end(ap);
+    }
+    if (errno != 0) {
+        (void) fprintf(stderr, ": %s", strerror(errno));
+    }
+    (void) fprintf(stderr, "\n");
+    exit(exitcode);
+}
+
+/**
+ * @brief Read the guesses of a guess file
+ * @param path The file
+ * @param guesses Receives up to CODES guesses
+ * @return Number of guesses
+ */
+static uint32_t read_guesses(const char *path, uint16_t *guesses)
+{
+    char line[64];
+    uint32_t n = 0;
+    FILE *f;
+
+    if ((f = fopen(path, "r")) == NULL) {
+        bail_out(EXIT_FAILURE, "opening %s", path);
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            continue;
+        }
+        if (n == CODES) {
+            errno = 0;
+            bail_out(EXIT_FAILURE, "%s has more than %d codes", path, CODES);
+        }
+        if (score_parse(line, &guesses[n]) < 0) {
+            errno = 0;
+            bail_out(EXIT_FAILURE, "Bad code '%s' in %s", line, path);
+        }
+        n++;
+    }
+    (void) fclose(f);
+    return n;
+}
+
+/**
+ * @brief Program entry point
+ * @param argc The argument counter
+ * @param argv The argument vector
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE in case of an error
+ */
+int main(int argc, char *argv[])
+{
+    static uint16_t guesses[CODES];
+    const char *guess_file = NULL;
+    uint32_t n = CODES;
+    uint64_t start;
+    int rows;
+    int c;
+
+    if (argc > 0) {
+        progname = argv[0];
+    }
+    while ((c = getopt(argc, argv, "g:")) != -1) {
+        switch (c) {
+        case 'g':
+            guess_file = optarg;
+            break;
+        default:
+            goto usage;
+        }
+    }
+    if (argc - optind != 1) {
+usage:
+        errno = 0;
+        bail_out(EXIT_FAILURE, "Usage: %s [-g guess-file] <matrix-file>",
+            progname);
+    }
+
+    if (guess_file != NULL) {
+        n = read_guesses(guess_file, guesses);
+    } else {
+        for (uint32_t i = 0; i < CODES; ++i) {
+            guesses[i] = i;
+        }
+    }
+
+    start = tb_now();
+    errno = 0;
+    if ((rows = matrix_build(argv[optind], guesses, n)) < 0) {
+        bail_out(EXIT_FAILURE, "writing %s", argv[optind]);
+    }
+    (void) printf("%d rows, %.1f MiB, %.2f s\n", rows,
+        (double) rows * MATRIX_ROW_BYTES / (1 << 20),
+        (tb_now() - start) / 1e9);
+    return EXIT_SUCCESS;
+}
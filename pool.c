@@ -0,0 +1,159 @@
+/*
+ * @brief thread pool with work stealing for parallel loops
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+#include "pool.h"
+
+/* === Implementations === */
+
+/**
+ * @brief Take the next chunk of a range
+ * @param p The pool
+ * @param r The range
+ * @param begin Receives the first index of the chunk
+ * @param end Receives the end of the chunk
+ * @return 1 if a chunk was taken, 0 if the range is exhausted
+ */
+static int take(struct pool *p, struct pool_range *r,
+    uint32_t *begin, uint32_t *end)
+{
+    uint32_t limit = r->end;
+
+    if (__atomic_load_n(&r->next, __ATOMIC_RELAXED) >= limit) {
+        return 0;
+    }
+    *begin = __atomic_fetch_add(&r->next, p->chunk, __ATOMIC_RELAXED);
+    if (*begin >= limit) {
+        return 0;
+    }
+    *end = *begin + p->chunk < limit ? *begin + p->chunk : limit;
+    return 1;
+}
+
+/**
+ * @brief Work on the own range, then steal from the others
+ * @param p The pool
+ * @param tid The thread
+ */
+static void work(struct pool *p, int tid)
+{
+    uint32_t begin, end;
+
+    for (int i = 0; i < p->nthreads; ++i) {
+        struct pool_range *r = &p->ranges[(tid + i) % p->nthreads];
+        while (take(p, r, &begin, &end)) {
+            p->fn(p->ctx, tid, begin, end);
+        }
+    }
+}
+
+/**
+ * @brief Main function of a helper thread
+ * @param arg The helper
+ * @return NULL
+ */
+static void *run_helper(void *arg)
+{
+    struct pool_helper *h = arg;
+    struct pool *p = h->pool;
+    unsigned long seen = 0;
+
+    (void) pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->generation == seen && !p->stop) {
+            (void) pthread_cond_wait(&p->start, &p->lock);
+        }
+        if (p->stop) {
+            break;
+        }
+        seen = p->generation;
+        (void) pthread_mutex_unlock(&p->lock);
+
+        work(p, h->tid);
+
+        (void) pthread_mutex_lock(&p->lock);
+        if (--p->busy == 0) {
+            (void) pthread_cond_signal(&p->done);
+        }
+    }
+    (void) pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+int pool_init(struct pool *p, int nthreads)
+{
+    if (nthreads < 1) {
+        nthreads = 1;
+    } else if (nthreads > POOL_MAX_THREADS) {
+        nthreads = POOL_MAX_THREADS;
+    }
+    p->nthreads = 1;
+    p->generation = 0;
+    p->busy = 0;
+    p->stop = 0;
+    (void) pthread_mutex_init(&p->lock, NULL);
+    (void) pthread_cond_init(&p->start, NULL);
+    (void) pthread_cond_init(&p->done, NULL);
+    for (int i = 1; i < nthreads; ++i) {
+        struct pool_helper *h = &p->helpers[i];
+        h->pool = p;
+        h->tid = i;
+        if (pthread_create(&p->threads[i], NULL, run_helper, h) != 0) {
+            pool_destroy(p);
+            return -1;
+        }
+        p->nthreads++;
+    }
+    return 0;
+}
+
+void pool_run(struct pool *p, uint32_t n, uint32_t chunk, pool_fn fn,
+    void *ctx)
+{
+    uint32_t share = n / p->nthreads;
+
+    p->fn = fn;
+    p->ctx = ctx;
+    p->chunk = chunk > 0 ? chunk : 1;
+    for (int i = 0; i < p->nthreads; ++i) {
+        p->ranges[i].next = i * share;
+        p->ranges[i].end = i + 1 < p->nthreads ? (i + 1) * share : n;
+    }
+    if (p->nthreads == 1) {
+        work(p, 0);
+        return;
+    }
+
+    (void) pthread_mutex_lock(&p->lock);
+    p->busy = p->nthreads - 1;
+    p->generation++;
+    (void) pthread_cond_broadcast(&p->start);
+    (void) pthread_mutex_unlock(&p->lock);
+
+    work(p, 0);
+
+    (void) pthread_mutex_lock(&p->lock);
+    while (p->busy > 0) {
+        (void) pthread_cond_wait(&p->done, &p->lock);
+    }
+    (void) pthread_mutex_unlock(&p->lock);
+}
+
+void pool_destroy(struct pool *p)
+{
+    (void) pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    (void) pthread_cond_broadcast(&p->start);
+    (void) pthread_mutex_unlock(&p->lock);
+    for (int i = 1; i < p->nthreads; ++i) {
+        (void) pthread_join(p->threads[i], NULL);
+    }
+    p->nthreads = 1;
+    (void) pthread_mutex_destroy(&p->lock);
+    (void) pthread_cond_destroy(&p->start);
+    (void) pthread_cond_destroy(&p->done);
+}
@@ -0,0 +1,83 @@
+/**
+ * @brief thread pool with work stealing for parallel loops
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * pool_run() splits an index range evenly between the threads. Every
+ * thread takes chunks from the front of its own range and, once that is
+ * exhausted, steals chunks from the ranges of the other threads. Ranges
+ * are plain atomic cursors, so taking a chunk is one fetch-and-add. The
+ * calling thread works as thread 0.
+*/
+
+#ifndef MM_POOL_H_
+#define MM_POOL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* === Constants === */
+
+#define POOL_MAX_THREADS (64)
+
+/* === Type Definitions === */
+
+/* Work function: process [begin, end) on thread tid */
+typedef void (*pool_fn)(void *ctx, int tid, uint32_t begin, uint32_t end);
+
+/* Remaining part of the range of one thread */
+struct pool_range {
+    uint32_t next;
+    uint32_t end;
+} __attribute__((aligned(64)));
+
+/* Argument of a helper thread */
+struct pool_helper {
+    struct pool *pool;
+    int tid;
+};
+
+struct pool {
+    int nthreads;
+    pthread_t threads[POOL_MAX_THREADS];
+    struct pool_helper helpers[POOL_MAX_THREADS];
+    struct pool_range ranges[POOL_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation;   /* incremented for every job */
+    int busy;                   /* helper threads still working */
+    int stop;
+    pool_fn fn;
+    void *ctx;
+    uint32_t chunk;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Start the helper threads of a pool
+ * @param p The pool
+ * @param nthreads Number of threads including the caller
+ * @return 0 on success, -1 if the threads could not be started
+ */
+int pool_init(struct pool *p, int nthreads);
+
+/**
+ * @brief Run a parallel loop and wait until it is done
+ * @param p The pool
+ * @param n Number of indices
+ * @param chunk Number of indices taken at once
+ * @param fn Function called for every chunk
+ * @param ctx Passed to fn
+ */
+void pool_run(struct pool *p, uint32_t n, uint32_t chunk, pool_fn fn,
+    void *ctx);
+
+/**
+ * @brief Stop the helper threads
+ * @param p The pool
+ */
+void pool_destroy(struct pool *p);
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * @brief binary replay log of every round a server plays
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "replay.h"
+
+/* === Implementations === */
+
+/**
+ * @brief Get the size of a full segment file
+ * @param l The log
+ * @return The size in bytes
+ */
+static size_t segment_bytes(const struct replay_log *l)
+{
+    return sizeof(struct replay_header)
+        + (size_t) l->capacity * sizeof(struct replay_rec);
+}
+
+/**
+ * @brief Create, preallocate and map a segment file
+ * @param l The log
+ * @param segment Sequence number of the segment
+ * @param seg Receives the segment
+ * @return 0 on success, -1 with errno set on error
+ */
+static int create_segment(const struct replay_log *l, uint64_t segment,
+    struct replay_seg *seg)
+{
+    char path[PATH_MAX];
+    size_t bytes = segment_bytes(l);
+    struct replay_header *hdr;
+    struct timespec ts;
+    int fd, err;
+
+    if (replay_path(path, sizeof(path), l->dir, l->worker, segment)
+            >= (int) sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+        return -1;
+    }
+    /* reserve the blocks now, a full disk must not SIGBUS the worker */
+    if ((err = posix_fallocate(fd, 0, bytes)) != 0) {
+        errno = err;
+        goto fail;
+    }
+    hdr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        fd, 0);
+    if (hdr == MAP_FAILED) {
+        goto fail;
+    }
+    (void) clock_gettime(CLOCK_REALTIME, &ts);
+    (void) memcpy(hdr->magic, REPLAY_MAGIC, sizeof(hdr->magic));
+    hdr->rec_bytes = sizeof(struct replay_rec);
+    hdr->worker = l->worker;
+    hdr->segment = segment;
+    hdr->records = 0;
+    hdr->capacity = l->capacity;
+    hdr->created = (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+    seg->fd = fd;
+    seg->hdr = hdr;
+    seg->recs = (struct replay_rec *) (hdr + 1);
+    seg->used = 0;
+    return 0;
+
+fail:
+    err = errno;
+    (void) close(fd);
+    (void) unlink(path);
+    errno = err;
+    return -1;
+}
+
+/**
+ * @brief Record the number of records of a segment, cut off the unused
+ * part and close it
+ * @param l The log
+ * @param seg The segment
+ */
+static void close_segment(const struct replay_log *l, struct replay_seg *seg)
+{
+    seg->hdr->records = seg->used;
+    (void) munmap(seg->hdr, segment_bytes(l));
+    (void) ftruncate(seg->fd, sizeof(struct replay_header)
+        + (off_t) seg->used * sizeof(struct replay_rec));
+    (void) close(seg->fd);
+    seg->fd = -1;
+    seg->hdr = NULL;
+    seg->recs = NULL;
+}
+
+/**
+ * @brief Close and delete a segment that was never written
+ * @param l The log
+ * @param seg The segment
+ */
+static void discard_segment(const struct replay_log *l,
+    struct replay_seg *seg)
+{
+    char path[PATH_MAX];
+
+    (void) replay_path(path, sizeof(path), l->dir, l->worker,
+        seg->hdr->segment);
+    (void) munmap(seg->hdr, segment_bytes(l));
+    (void) close(seg->fd);
+    (void) unlink(path);
+    seg->fd = -1;
+    seg->hdr = NULL;
+    seg->recs = NULL;
+}
+
+/**
+ * @brief Thread of a log: close full segments and create the next one
+ * @param arg The log
+ * @return NULL
+ */
+static void *run_log(void *arg)
+{
+    struct replay_log *l = arg;
+    struct replay_seg seg;
+    struct timespec ts;
+    int ret, err;
+
+    (void) pthread_mutex_lock(&l->lock);
+    while (!l->stop) {
+        if (l->full.hdr != NULL) {
+            seg = l->full;
+            l->full.hdr = NULL;
+            (void) pthread_mutex_unlock(&l->lock);
+            close_segment(l, &seg);
+            (void) pthread_mutex_lock(&l->lock);
+            (void) pthread_cond_broadcast(&l->cond);
+        } else if (l->next.hdr == NULL && l->error == 0) {
+            uint64_t segment = l->segment;
+
+            (void) pthread_mutex_unlock(&l->lock);
+            ret = create_segment(l, segment, &seg);
+            err = errno;
+            (void) pthread_mutex_lock(&l->lock);
+            if (ret == 0) {
+                l->next = seg;
+                l->segment = segment + 1;
+            } else {
+                l->error = err;
+            }
+            (void) pthread_cond_broadcast(&l->cond);
+        } else if (l->error != 0) {
+            /* the worker drops records meanwhile instead of waiting */
+            (void) clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += REPLAY_RETRY_SECS;
+            if (pthread_cond_timedwait(&l->cond, &l->lock, &ts) == ETIMEDOUT) {
+                l->error = 0;
+            }
+        } else {
+            (void) pthread_cond_wait(&l->cond, &l->lock);
+        }
+    }
+    (void) pthread_mutex_unlock(&l->lock);
+    return NULL;
+}
+
+int replay_path(char *path, size_t size, const char *dir, int worker,
+    uint64_t segment)
+{
+    return snprintf(path, size, "%s/replay-w%d-%06llu.mmr", dir, worker,
+        (unsigned long long) segment);
+}
+
+int replay_open(struct replay_log *l, const char *dir, int worker,
+    uint32_t capacity)
+{
+    int err;
+
+    (void) memset(l, 0, sizeof(*l));
+    l->cur.fd = l->next.fd = l->full.fd = -1;
+    l->dir = dir;
+    l->worker = worker;
+    l->capacity = capacity;
+    if (capacity == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (create_segment(l, 0, &l->cur) < 0) {
+        return -1;
+    }
+    l->segment = 1;
+    l->recs = l->cur.recs;
+    (void) pthread_mutex_init(&l->lock, NULL);
+    (void) pthread_cond_init(&l->cond, NULL);
+    if ((err = pthread_create(&l->thread, NULL, run_log, l)) != 0) {
+        discard_segment(l, &l->cur);
+        (void) pthread_mutex_destroy(&l->lock);
+        (void) pthread_cond_destroy(&l->cond);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+void replay_close(struct replay_log *l)
+{
+    if (l->cur.hdr == NULL) {
+        return;
+    }
+    (void) pthread_mutex_lock(&l->lock);
+    l->stop = 1;
+    (void) pthread_cond_broadcast(&l->cond);
+    (void) pthread_mutex_unlock(&l->lock);
+    (void) pthread_join(l->thread, NULL);
+
+    if (l->full.hdr != NULL) {
+        close_segment(l, &l->full);
+    }
+    l->cur.used = l->used;
+    close_segment(l, &l->cur);
+    if (l->next.hdr != NULL) {
+        discard_segment(l, &l->next);
+    }
+    (void) pthread_mutex_destroy(&l->lock);
+    (void) pthread_cond_destroy(&l->cond);
+    l->recs = NULL;
+    l->used = l->capacity = 0;
+}
+
+int replay_rotate(struct replay_log *l)
+{
+    int stalled = 0;
+
+    (void) pthread_mutex_lock(&l->lock);
+    /* the thread closes the previous full segment before it creates the
+       next one, so both are done once next is there */
+    while (l->full.hdr != NULL || (l->next.hdr == NULL && l->error == 0)) {
+        if (!stalled) {
+            l->stalls++;
+            stalled = 1;
+        }
+        (void) pthread_cond_wait(&l->cond, &l->lock);
+    }
+    if (l->next.hdr == NULL) {
+        (void) pthread_mutex_unlock(&l->lock);
+        return -1;
+    }
+    l->cur.used = l->used;
+    l->full = l->cur;
+    l->cur = l->next;
+    l->next.hdr = NULL;
+    l->next.fd = -1;
+    (void) pthread_cond_broadcast(&l->cond);
+    (void) pthread_mutex_unlock(&l->lock);
+
+    l->recs = l->cur.recs;
+    l->used = 0;
+    return 0;
+}
@@ -0,0 +1,157 @@
+/**
+ * @brief binary replay log of every round a server plays
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Every worker appends one fixed-size record per round to its own log.
+ * A log is a sequence of segment files, each a struct replay_header
+ * followed by room for a fixed number of records. Segments are created
+ * at full size (posix_fallocate) and mapped with their pages populated,
+ * so appending a record is a plain store into the page cache: no system
+ * call, no page fault, no copy.
+ *
+ * A background thread per log creates the next segment while the worker
+ * fills the current one, and truncates and closes full segments. Rotating
+ * is a pointer swap under a mutex; the worker only waits if the thread is
+ * a whole segment behind, and drops records if the disk is full.
+ *
+ * Records are little endian (the layout of the host). A segment that was
+ * not closed, e.g. after a crash, has 0 records in its header; its
+ * records end at the first one with round 0, the rest of the file was
+ * preallocated with zeros.
+*/
+
+#ifndef MM_REPLAY_H_
+#define MM_REPLAY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/* === Constants === */
+
+#define REPLAY_MAGIC "MMREPLY1"
+#define REPLAY_SEGMENT_RECORDS (1 << 22)    /* 48 MiB per segment */
+#define REPLAY_RETRY_SECS (1)               /* after failing to create one */
+
+/* === Type Definitions === */
+
+/* Header of a segment file, 64 bytes */
+struct replay_header {
+    char magic[8];
+    uint32_t rec_bytes;     /* sizeof(struct replay_rec) */
+    uint32_t worker;        /* the worker that wrote the segment */
+    uint64_t segment;       /* sequence number, starts at 0 per log */
+    uint64_t records;       /* set when the segment is closed, else 0 */
+    uint64_t capacity;      /* records the segment has room for */
+    int64_t created;        /* CLOCK_REALTIME in ns */
+    uint8_t reserved[16];
+};
+
+/* One round. A connection plays one game, or one game per id at a time if
+   it is multiplexed (see game.h): round 1 starts the next game of an id */
+struct replay_rec {
+    uint32_t conn;          /* number of the connection in its worker */
+    uint16_t id;            /* game id on multiplexed connections, else 0 */
+    uint16_t request;       /* the request word */
+    uint16_t secret;        /* the packed secret, see score.h */
+    uint8_t round;          /* starts at 1 */
+    uint8_t response;       /* the response byte */
+};
+
+/* A mapped segment file */
+struct replay_seg {
+    int fd;
+    struct replay_header *hdr;  /* NULL if there is no segment */
+    struct replay_rec *recs;
+    uint32_t used;              /* records written */
+};
+
+struct replay_log {
+    struct replay_rec *recs;    /* records of the current segment */
+    uint32_t used;
+    uint32_t capacity;
+    uint64_t dropped;           /* records lost because no segment was ready */
+    uint64_t stalls;            /* rotations that waited for the thread */
+    struct replay_seg cur;
+    struct replay_seg next;     /* created ahead by the thread */
+    struct replay_seg full;     /* for the thread to close */
+    const char *dir;
+    int worker;
+    uint64_t segment;           /* sequence number of the next segment */
+    int error;                  /* errno of the thread's last failure */
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Create the first segment of a log and start its thread
+ * @param l The log
+ * @param dir Directory of the segment files, has to outlive the log
+ * @param worker Id of the worker, part of the file names
+ * @param capacity Records per segment
+ * @return 0 on success, -1 with errno set on error
+ */
+int replay_open(struct replay_log *l, const char *dir, int worker,
+    uint32_t capacity);
+
+/**
+ * @brief Stop the thread, close the current segment and delete the
+ * segment that was created ahead
+ * @param l The log
+ */
+void replay_close(struct replay_log *l);
+
+/**
+ * @brief Switch to the next segment, called when the current one is full
+ * @param l The log
+ * @return 0 on success, -1 if there is no next segment
+ */
+int replay_rotate(struct replay_log *l);
+
+/**
+ * @brief Get the name of a segment file
+ * @param path Receives the name
+ * @param size Size of path
+ * @param dir Directory of the log
+ * @param worker Id of the worker
+ * @param segment Sequence number of the segment
+ * @return Length of the name as for snprintf()
+ */
+int replay_path(char *path, size_t size, const char *dir, int worker,
+    uint64_t segment);
+
+/**
+ * @brief Append a round to a log
+ * @param l The log
+ * @param conn Number of the connection
+ * @param id Game id of a multiplexed connection, else 0
+ * @param request The request word
+ * @param secret The packed secret
+ * @param round The round
+ * @param response The response byte
+ */
+static inline void replay_append(struct replay_log *l, uint32_t conn,
+    uint16_t id, uint16_t request, uint16_t secret, uint8_t round,
+    uint8_t response)
+{
+    struct replay_rec *rec;
+
+    if (l->used == l->capacity && replay_rotate(l) < 0) {
+        l->dropped++;
+        return;
+    }
+    rec = &l->recs[l->used++];
+    rec->conn = conn;
+    rec->id = id;
+    rec->request = request;
+    rec->secret = secret;
+    rec->round = round;
+    rec->response = response;
+}
+
+#endif
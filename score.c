@@ -0,0 +1,544 @@
+/*
+ * @brief scoring of mastermind guesses against a secret
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+#include "score.h"
+#include "codec.h"
+
+/* === Constants === */
+
+/* Length of an array */
+#define COUNT_OF(x) (sizeof(x)/sizeof(x[0]))
+
+/* lowest bit of every slot */
+#define FIELD_LSB (0x1249)
+
+#define CACHE_BUCKETS (1024)
+#define CACHE_MAX_IDLE (64) /* unused tables kept for later games */
+
+/* === Type Definitions === */
+
+/* A cached table, the table is the first member so that a table pointer
+   can be converted back to its entry */
+struct score_entry {
+    uint8_t table[CODES];
+    struct score_entry *next;       /* hash chain */
+    struct score_entry *idle_prev;  /* list of unreferenced entries */
+    struct score_entry *idle_next;
+    unsigned long refs;
+    uint16_t secret;
+};
+
+/* === Global Variables === */
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct score_entry *buckets[CACHE_BUCKETS];
+
+/* least recently used idle entry first */
+static struct score_entry *idle_head = NULL;
+static struct score_entry *idle_tail = NULL;
+static unsigned long nidle = 0;
+
+/* === Implementations === */
+
+uint16_t score_pack(const uint8_t *colors)
+{
+    uint16_t code = 0;
+
+    for (int j = SLOTS - 1; j >= 0; --j) {
+        code = (code << SHIFT_WIDTH) | (colors[j] & 0x7);
+    }
+    return code;
+}
+
+int score_parse(const char *str, uint16_t *code)
+{
+    static const char letters[COLORS] = "bdgorsvw";
+    uint8_t colors[SLOTS];
+
+    for (int j = 0; j < SLOTS; ++j) {
+        const char *c = str[j] != '\0' ? memchr(letters, str[j], COLORS) : NULL;
+        if (c == NULL) {
+            return -1;
+        }
+        colors[j] = c - letters;
+    }
+    if (str[SLOTS] != '\0') {
+        return -1;
+    }
+    *code = score_pack(colors);
+    return 0;
+}
+
+uint8_t score_ref(uint16_t guess, uint16_t secret)
+{
+    int colors_left[COLORS];
+    int g[SLOTS], s[SLOTS];
+    uint8_t parity_calc;
+    int red, white;
+    int j;
+
+    /* extract the guess and calculate parity */
+    parity_calc = 0;
+    for (j = 0; j < SLOTS; ++j) {
+        int tmp = guess & 0x7;
+        parity_calc ^= tmp ^ (tmp >> 1) ^ (tmp >> 2);
+        g[j] = tmp;
+        s[j] = secret & 0x7;
+        guess >>= SHIFT_WIDTH;
+        secret >>= SHIFT_WIDTH;
+    }
+    parity_calc &= 0x1;
+
+    /* marking red and white */
+    (void) memset(&colors_left[0], 0, sizeof(colors_left));
+    red = white = 0;
+    for (j = 0; j < SLOTS; ++j) {
+        /* mark red */
+        if (g[j] == s[j]) {
+            red++;
+        } else {
+            colors_left[s[j]]++;
+        }
+    }
+    for (j = 0; j < SLOTS; ++j) {
+        /* not marked red */
+        if (g[j] != s[j]) {
+            if (colors_left[g[j]] > 0) {
+                white++;
+                colors_left[g[j]]--;
+            }
+        }
+    }
+    return red | (white << SHIFT_WIDTH) | (parity_calc << SCORE_PARITY_BIT);
+}
+
+/**
+ * @brief Count the slots whose lowest bit is set
+ * @param fields A code masked with FIELD_LSB
+ * @return Number of bits set
+ */
+static inline unsigned count_fields(unsigned fields)
+{
+    /* the multiplication sums up all five bits in bits 12-14 */
+    return ((fields * FIELD_LSB) >> 12) & 0x7;
+}
+
+/**
+ * @brief Mark the slots of a code that hold a color
+ * @param code The code
+ * @param color The color
+ * @return The lowest bit of every slot that equals color
+ */
+static inline unsigned match_fields(unsigned code, unsigned color)
+{
+    unsigned x = code ^ (color * FIELD_LSB);
+    return ~(x | (x >> 1) | (x >> 2)) & FIELD_LSB;
+}
+
+uint8_t score_swar(uint16_t guess, uint16_t secret)
+{
+    unsigned x = (guess ^ secret) & CODE_MASK;
+    unsigned red = SLOTS - count_fields((x | (x >> 1) | (x >> 2)) & FIELD_LSB);
+    unsigned common = 0;
+
+    for (unsigned c = 0; c < COLORS; ++c) {
+        unsigned g = count_fields(match_fields(guess, c));
+        unsigned s = count_fields(match_fields(secret, c));
+        common += g < s ? g : s;
+    }
+    return red | ((common - red) << SHIFT_WIDTH)
+        | (codec_parity(guess) << SCORE_PARITY_BIT);
+}
+
+#ifdef __SSE2__
+
+/* 8 codes per vector, see score_swar() for the scalar version */
+
+static inline __m128i count_fields_sse2(__m128i fields)
+{
+    const __m128i lsb = _mm_set1_epi16(FIELD_LSB);
+    return _mm_and_si128(
+        _mm_srli_epi16(_mm_mullo_epi16(fields, lsb), 12), _mm_set1_epi16(7));
+}
+
+static inline __m128i zero_fields_sse2(__m128i x)
+{
+    return _mm_or_si128(_mm_or_si128(x, _mm_srli_epi16(x, 1)),
+        _mm_srli_epi16(x, 2));
+}
+
+/**
+ * @brief Score 8 codes a against the fixed code b
+ * @param a The varying codes
+ * @param b The fixed code
+ * @param b_counts Number of slots of b holding each color
+ * @param guess_parity Parity of the guesses if b is the guess, else -1
+ * @return 8 scores in 16 bit lanes
+ */
+static inline __m128i score_sse2(__m128i a, uint16_t b,
+    const uint16_t *b_counts, int guess_parity)
+{
+    const __m128i lsb = _mm_set1_epi16(FIELD_LSB);
+    __m128i nz, red, common, par;
+
+    a = _mm_and_si128(a, _mm_set1_epi16(CODE_MASK));
+    nz = zero_fields_sse2(_mm_xor_si128(a, _mm_set1_epi16(b)));
+    red = _mm_sub_epi16(_mm_set1_epi16(SLOTS),
+        count_fields_sse2(_mm_and_si128(nz, lsb)));
+    common = _mm_setzero_si128();
+    for (unsigned c = 0; c < COLORS; ++c) {
+        __m128i x = _mm_xor_si128(a, _mm_set1_epi16(c * FIELD_LSB));
+        __m128i n = count_fields_sse2(_mm_andnot_si128(zero_fields_sse2(x), lsb));
+        common = _mm_add_epi16(common,
+            _mm_min_epi16(n, _mm_set1_epi16(b_counts[c])));
+    }
+    if (guess_parity >= 0) {
+        par = _mm_set1_epi16(guess_parity << SCORE_PARITY_BIT);
+    } else {
+        par = _mm_xor_si128(a, _mm_srli_epi16(a, 8));
+        par = _mm_xor_si128(par, _mm_srli_epi16(par, 4));
+        par = _mm_xor_si128(par, _mm_srli_epi16(par, 2));
+        par = _mm_xor_si128(par, _mm_srli_epi16(par, 1));
+        par = _mm_slli_epi16(_mm_and_si128(par, _mm_set1_epi16(1)),
+            SCORE_PARITY_BIT);
+    }
+    return _mm_or_si128(_mm_or_si128(red, par),
+        _mm_slli_epi16(_mm_sub_epi16(common, red), SHIFT_WIDTH));
+}
+
+/**
+ * @brief Batch kernel with 8 codes per step
+ * @return Number of codes scored, the rest is left to the caller
+ */
+static size_t batch_sse2(const uint16_t *codes, uint16_t fixed,
+    const uint16_t *counts, int guess_parity, uint8_t *scores, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) &codes[i]);
+        __m128i r = score_sse2(a, fixed, counts, guess_parity);
+        _mm_storel_epi64((__m128i *) &scores[i], _mm_packus_epi16(r, r));
+    }
+    return i;
+}
+
+/**
+ * @brief Pairwise kernel with 8 pairs per step
+ * @return Number of pairs scored, the rest is left to the caller
+ */
+static size_t pairs_sse2(const uint16_t *guesses, const uint16_t *secrets,
+    uint8_t *scores, size_t n)
+{
+    const __m128i lsb = _mm_set1_epi16(FIELD_LSB);
+    const __m128i mask = _mm_set1_epi16(CODE_MASK);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m128i g = _mm_and_si128(
+            _mm_loadu_si128((const __m128i *) &guesses[i]), mask);
+        __m128i s = _mm_and_si128(
+            _mm_loadu_si128((const __m128i *) &secrets[i]), mask);
+        __m128i nz = zero_fields_sse2(_mm_xor_si128(g, s));
+        __m128i red = _mm_sub_epi16(_mm_set1_epi16(SLOTS),
+            count_fields_sse2(_mm_and_si128(nz, lsb)));
+        __m128i common = _mm_setzero_si128();
+        __m128i par, r;
+
+        for (unsigned c = 0; c < COLORS; ++c) {
+            __m128i rep = _mm_set1_epi16(c * FIELD_LSB);
+            __m128i ng = count_fields_sse2(_mm_andnot_si128(
+                zero_fields_sse2(_mm_xor_si128(g, rep)), lsb));
+            __m128i ns = count_fields_sse2(_mm_andnot_si128(
+                zero_fields_sse2(_mm_xor_si128(s, rep)), lsb));
+            common = _mm_add_epi16(common, _mm_min_epi16(ng, ns));
+        }
+        par = _mm_xor_si128(g, _mm_srli_epi16(g, 8));
+        par = _mm_xor_si128(par, _mm_srli_epi16(par, 4));
+        par = _mm_xor_si128(par, _mm_srli_epi16(par, 2));
+        par = _mm_xor_si128(par, _mm_srli_epi16(par, 1));
+        par = _mm_slli_epi16(_mm_and_si128(par, _mm_set1_epi16(1)),
+            SCORE_PARITY_BIT);
+        r = _mm_or_si128(_mm_or_si128(red, par),
+            _mm_slli_epi16(_mm_sub_epi16(common, red), SHIFT_WIDTH));
+        _mm_storel_epi64((__m128i *) &scores[i], _mm_packus_epi16(r, r));
+    }
+    return i;
+}
+
+/* 16 codes per vector, same as the SSE2 version */
+
+__attribute__((target("avx2")))
+static inline __m256i count_fields_avx2(__m256i fields)
+{
+    const __m256i lsb = _mm256_set1_epi16(FIELD_LSB);
+    return _mm256_and_si256(_mm256_srli_epi16(
+        _mm256_mullo_epi16(fields, lsb), 12), _mm256_set1_epi16(7));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i zero_fields_avx2(__m256i x)
+{
+    return _mm256_or_si256(_mm256_or_si256(x, _mm256_srli_epi16(x, 1)),
+        _mm256_srli_epi16(x, 2));
+}
+
+__attribute__((target("avx2")))
+static size_t batch_avx2(const uint16_t *codes, uint16_t fixed,
+    const uint16_t *counts, int guess_parity, uint8_t *scores, size_t n)
+{
+    const __m256i lsb = _mm256_set1_epi16(FIELD_LSB);
+    const __m256i b = _mm256_set1_epi16(fixed);
+    __m256i bc[COLORS], rep[COLORS];
+    size_t i;
+
+    for (unsigned c = 0; c < COLORS; ++c) {
+        bc[c] = _mm256_set1_epi16(counts[c]);
+        rep[c] = _mm256_set1_epi16(c * FIELD_LSB);
+    }
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_and_si256(
+            _mm256_loadu_si256((const __m256i *) &codes[i]),
+            _mm256_set1_epi16(CODE_MASK));
+        __m256i nz = zero_fields_avx2(_mm256_xor_si256(a, b));
+        __m256i red = _mm256_sub_epi16(_mm256_set1_epi16(SLOTS),
+            count_fields_avx2(_mm256_and_si256(nz, lsb)));
+        __m256i common = _mm256_setzero_si256();
+        __m256i par, r;
+
+        for (unsigned c = 0; c < COLORS; ++c) {
+            __m256i x = zero_fields_avx2(_mm256_xor_si256(a, rep[c]));
+            __m256i n = count_fields_avx2(_mm256_andnot_si256(x, lsb));
+            common = _mm256_add_epi16(common, _mm256_min_epi16(n, bc[c]));
+        }
+        if (guess_parity >= 0) {
+            par = _mm256_set1_epi16(guess_parity << SCORE_PARITY_BIT);
+        } else {
+            par = _mm256_xor_si256(a, _mm256_srli_epi16(a, 8));
+            par = _mm256_xor_si256(par, _mm256_srli_epi16(par, 4));
+            par = _mm256_xor_si256(par, _mm256_srli_epi16(par, 2));
+            par = _mm256_xor_si256(par, _mm256_srli_epi16(par, 1));
+            par = _mm256_slli_epi16(
+                _mm256_and_si256(par, _mm256_set1_epi16(1)), SCORE_PARITY_BIT);
+        }
+        r = _mm256_or_si256(_mm256_or_si256(red, par),
+            _mm256_slli_epi16(_mm256_sub_epi16(common, red), SHIFT_WIDTH));
+        _mm_storeu_si128((__m128i *) &scores[i],
+            _mm_packus_epi16(_mm256_castsi256_si128(r),
+                _mm256_extracti128_si256(r, 1)));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t pairs_avx2(const uint16_t *guesses, const uint16_t *secrets,
+    uint8_t *scores, size_t n)
+{
+    const __m256i lsb = _mm256_set1_epi16(FIELD_LSB);
+    const __m256i mask = _mm256_set1_epi16(CODE_MASK);
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m256i g = _mm256_and_si256(
+            _mm256_loadu_si256((const __m256i *) &guesses[i]), mask);
+        __m256i s = _mm256_and_si256(
+            _mm256_loadu_si256((const __m256i *) &secrets[i]), mask);
+        __m256i nz = zero_fields_avx2(_mm256_xor_si256(g, s));
+        __m256i red = _mm256_sub_epi16(_mm256_set1_epi16(SLOTS),
+            count_fields_avx2(_mm256_and_si256(nz, lsb)));
+        __m256i common = _mm256_setzero_si256();
+        __m256i par, r;
+
+        for (unsigned c = 0; c < COLORS; ++c) {
+            __m256i rep = _mm256_set1_epi16(c * FIELD_LSB);
+            __m256i ng = count_fields_avx2(_mm256_andnot_si256(
+                zero_fields_avx2(_mm256_xor_si256(g, rep)), lsb));
+            __m256i ns = count_fields_avx2(_mm256_andnot_si256(
+                zero_fields_avx2(_mm256_xor_si256(s, rep)), lsb));
+            common = _mm256_add_epi16(common, _mm256_min_epi16(ng, ns));
+        }
+        par = _mm256_xor_si256(g, _mm256_srli_epi16(g, 8));
+        par = _mm256_xor_si256(par, _mm256_srli_epi16(par, 4));
+        par = _mm256_xor_si256(par, _mm256_srli_epi16(par, 2));
+        par = _mm256_xor_si256(par, _mm256_srli_epi16(par, 1));
+        par = _mm256_slli_epi16(
+            _mm256_and_si256(par, _mm256_set1_epi16(1)), SCORE_PARITY_BIT);
+        r = _mm256_or_si256(_mm256_or_si256(red, par),
+            _mm256_slli_epi16(_mm256_sub_epi16(common, red), SHIFT_WIDTH));
+        _mm_storeu_si128((__m128i *) &scores[i],
+            _mm_packus_epi16(_mm256_castsi256_si128(r),
+                _mm256_extracti128_si256(r, 1)));
+    }
+    return i;
+}
+
+#endif
+
+/**
+ * @brief Score codes against a fixed code with the best available kernel
+ * @param codes The varying codes
+ * @param fixed The fixed code
+ * @param fixed_is_guess Set if fixed is the guess, else the codes are
+ * @param scores n scores
+ * @param n Number of codes
+ */
+static void score_batch(const uint16_t *codes, uint16_t fixed,
+    int fixed_is_guess, uint8_t *scores, size_t n)
+{
+    size_t i = 0;
+    uint16_t counts[COLORS];
+    int guess_parity = fixed_is_guess ? (int) codec_parity(fixed) : -1;
+
+    for (unsigned c = 0; c < COLORS; ++c) {
+        counts[c] = count_fields(match_fields(fixed, c));
+    }
+#ifdef __SSE2__
+    if (__builtin_cpu_supports("avx2")) {
+        i = batch_avx2(codes, fixed, counts, guess_parity, scores, n);
+    }
+    i += batch_sse2(codes + i, fixed, counts, guess_parity, scores + i, n - i);
+#endif
+    for (; i < n; ++i) {
+        scores[i] = fixed_is_guess ? score_swar(fixed, codes[i])
+            : score_swar(codes[i], fixed);
+    }
+}
+
+void score_batch_guesses(uint16_t secret, const uint16_t *guesses,
+    uint8_t *scores, size_t n)
+{
+    score_batch(guesses, secret & CODE_MASK, 0, scores, n);
+}
+
+void score_batch_secrets(uint16_t guess, const uint16_t *secrets,
+    uint8_t *scores, size_t n)
+{
+    score_batch(secrets, guess & CODE_MASK, 1, scores, n);
+}
+
+void score_batch_pairs(const uint16_t *guesses, const uint16_t *secrets,
+    uint8_t *scores, size_t n)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    if (__builtin_cpu_supports("avx2")) {
+        i = pairs_avx2(guesses, secrets, scores, n);
+    }
+    i += pairs_sse2(guesses + i, secrets + i, scores + i, n - i);
+#endif
+    for (; i < n; ++i) {
+        scores[i] = score_swar(guesses[i], secrets[i] & CODE_MASK);
+    }
+}
+
+void score_table_build(uint16_t secret, uint8_t *table)
+{
+    uint16_t codes[256];
+
+    for (uint32_t base = 0; base < CODES; base += COUNT_OF(codes)) {
+        for (uint32_t i = 0; i < COUNT_OF(codes); ++i) {
+            codes[i] = base + i;
+        }
+        score_batch_guesses(secret, codes, &table[base], COUNT_OF(codes));
+    }
+}
+
+/**
+ * @brief Unlink an entry from the idle list
+ * @param e The entry
+ */
+static void idle_remove(struct score_entry *e)
+{
+    if (e->idle_prev != NULL) {
+        e->idle_prev->idle_next = e->idle_next;
+    } else {
+        idle_head = e->idle_next;
+    }
+    if (e->idle_next != NULL) {
+        e->idle_next->idle_prev = e->idle_prev;
+    } else {
+        idle_tail = e->idle_prev;
+    }
+    e->idle_prev = e->idle_next = NULL;
+    nidle--;
+}
+
+/**
+ * @brief Remove an entry from its hash chain and free it
+ * @param e The entry
+ */
+static void evict(struct score_entry *e)
+{
+    struct score_entry **p = &buckets[e->secret % CACHE_BUCKETS];
+
+    while (*p != e) {
+        p = &(*p)->next;
+    }
+    *p = e->next;
+    free(e);
+}
+
+const uint8_t *score_table_acquire(uint16_t secret)
+{
+    struct score_entry *e;
+
+    secret &= CODE_MASK;
+    (void) pthread_mutex_lock(&cache_lock);
+    for (e = buckets[secret % CACHE_BUCKETS]; e != NULL; e = e->next) {
+        if (e->secret == secret) {
+            break;
+        }
+    }
+    if (e == NULL) {
+        if ((e = malloc(sizeof(*e))) != NULL) {
+            score_table_build(secret, e->table);
+            e->secret = secret;
+            e->refs = 0;
+            e->idle_prev = e->idle_next = NULL;
+            e->next = buckets[secret % CACHE_BUCKETS];
+            buckets[secret % CACHE_BUCKETS] = e;
+        }
+    } else if (e->refs == 0) {
+        idle_remove(e);
+    }
+    if (e != NULL) {
+        e->refs++;
+    }
+    (void) pthread_mutex_unlock(&cache_lock);
+    return e != NULL ? e->table : NULL;
+}
+
+void score_table_release(const uint8_t *table)
+{
+    struct score_entry *e = (struct score_entry *) table;
+
+    (void) pthread_mutex_lock(&cache_lock);
+    if (--e->refs == 0) {
+        /* keep it around, the next game may well use the same secret */
+        e->idle_prev = idle_tail;
+        if (idle_tail != NULL) {
+            idle_tail->idle_next = e;
+        } else {
+            idle_head = e;
+        }
+        idle_tail = e;
+        nidle++;
+        if (nidle > CACHE_MAX_IDLE) {
+            struct score_entry *old = idle_head;
+            idle_remove(old);
+            evict(old);
+        }
+    }
+    (void) pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,133 @@
+/**
+ * @brief scoring of mastermind guesses against a secret
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Codes are packed into 15 bits, slot i occupies bits 3i..3i+2. A score is
+ * the lower 7 bits of the server's response byte: red in bits 0-2, white
+ * in bits 3-5 and the parity the guess should have in bit 6.
+ *
+ * As every game only ever sees one secret, all 32768 scores of a secret
+ * fit into a 32 KiB table, which turns scoring into a single load. Tables
+ * are shared between all games with the same secret.
+ *
+ * For bulk work (solvers, replay verification) there are branchless batch
+ * kernels that treat a code as five 3 bit fields: red counts the fields
+ * of guess ^ secret that are zero, white follows from the per-colour
+ * counts of both codes. They use AVX2 or SSE2 if available and give the
+ * same results as score_ref().
+*/
+
+#ifndef MM_SCORE_H_
+#define MM_SCORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* === Constants === */
+
+#define SLOTS (5)
+#define COLORS (8)
+#define SHIFT_WIDTH (3)
+
+#define CODE_BITS (SLOTS * SHIFT_WIDTH)
+#define CODES (1 << CODE_BITS)
+#define CODE_MASK (CODES - 1)
+#define SCORE_PARITY_BIT (6)
+
+/* === Prototypes === */
+
+/**
+ * @brief Pack colors into a code
+ * @param colors SLOTS colors, each less than COLORS
+ * @return The packed code
+ */
+uint16_t score_pack(const uint8_t *colors);
+
+/**
+ * @brief Parse a code written as color letters
+ * @param str SLOTS letters out of bdgorsvw, see README.md
+ * @param code Receives the packed code
+ * @return 0 on success, -1 if str is not a valid code
+ */
+int score_parse(const char *str, uint16_t *code);
+
+/**
+ * @brief Score a guess, straightforward reference implementation
+ * @param guess The guess, bit 15 is ignored
+ * @param secret The packed secret
+ * @return The score, see above
+ */
+uint8_t score_ref(uint16_t guess, uint16_t secret);
+
+/**
+ * @brief Score a guess without branches or tables
+ * @param guess The guess, bit 15 is ignored
+ * @param secret The packed secret
+ * @return The score, same as score_ref()
+ */
+uint8_t score_swar(uint16_t guess, uint16_t secret);
+
+/**
+ * @brief Score many guesses against one secret
+ * @param secret The packed secret
+ * @param guesses The guesses, bit 15 is ignored
+ * @param scores n scores, same as score_ref()
+ * @param n Number of guesses
+ */
+void score_batch_guesses(uint16_t secret, const uint16_t *guesses,
+    uint8_t *scores, size_t n);
+
+/**
+ * @brief Score one guess against many secrets
+ * @param guess The guess, bit 15 is ignored
+ * @param secrets The packed secrets
+ * @param scores n scores, same as score_ref()
+ * @param n Number of secrets
+ */
+void score_batch_secrets(uint16_t guess, const uint16_t *secrets,
+    uint8_t *scores, size_t n);
+
+/**
+ * @brief Score many guesses, each against its own secret
+ * @param guesses The guesses, bit 15 is ignored
+ * @param secrets The packed secrets, one per guess
+ * @param scores n scores, same as score_ref()
+ * @param n Number of pairs
+ */
+void score_batch_pairs(const uint16_t *guesses, const uint16_t *secrets,
+    uint8_t *scores, size_t n);
+
+/**
+ * @brief Fill a table with the scores of all codes against a secret
+ * @param secret The packed secret
+ * @param table CODES entries
+ */
+void score_table_build(uint16_t secret, uint8_t *table);
+
+/**
+ * @brief Get the shared score table of a secret, building it on first use
+ * @param secret The packed secret
+ * @return The table or NULL if out of memory
+ */
+const uint8_t *score_table_acquire(uint16_t secret);
+
+/**
+ * @brief Drop a reference obtained by score_table_acquire()
+ * @param table The table
+ */
+void score_table_release(const uint8_t *table);
+
+/**
+ * @brief Score a request with a table
+ * @param table Table of the secret
+ * @param req Request word as sent by the client, including the parity bit
+ * @return Response byte, bit 6 set on a parity error
+ */
+static inline uint8_t score_lookup(const uint8_t *table, uint16_t req)
+{
+    /* the table holds the expected parity, so a xor flags a mismatch */
+    return table[req & CODE_MASK] ^ ((req >> 15) << SCORE_PARITY_BIT);
+}
+
+#endif
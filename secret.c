@@ -0,0 +1,163 @@
+/*
+ * @brief sources of secrets for new games
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "secret.h"
+
+/* === Implementations === */
+
+/**
+ * @brief Parse the codes of a text secret file
+ * @param f The file, base and size hold its contents
+ * @return 0 on success, -1 with errno set on error
+ */
+static int parse_text(struct secret_file *f)
+{
+    const char *p = f->base, *end = p + f->size;
+    uint32_t n = 0;
+
+    /* a code and its newline take at least SLOTS + 1 bytes */
+    if ((f->parsed = malloc((f->size / (SLOTS + 1) + 1)
+            * sizeof(*f->parsed))) == NULL) {
+        return -1;
+    }
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        size_t len = (eol != NULL ? eol : end) - p;
+        char line[SLOTS + 1];
+
+        if (len > 0 && p[len - 1] == '\r') {
+            len--;
+        }
+        if (len > 0) {
+            if (len != SLOTS) {
+                errno = EINVAL;
+                return -1;
+            }
+            (void) memcpy(line, p, SLOTS);
+            line[SLOTS] = '\0';
+            if (score_parse(line, &f->parsed[n]) < 0) {
+                errno = EINVAL;
+                return -1;
+            }
+            n++;
+        }
+        p = eol != NULL ? eol + 1 : end;
+    }
+    f->codes = f->parsed;
+    f->count = n;
+    return 0;
+}
+
+int secret_file_open(struct secret_file *f, const char *path)
+{
+    const struct secret_header *h;
+    struct stat st;
+    int fd, saved;
+
+    (void) memset(f, 0, sizeof(*f));
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0) {
+        saved = errno;
+        (void) close(fd);
+        errno = saved;
+        return -1;
+    }
+    if (st.st_size == 0) {
+        (void) close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    f->size = st.st_size;
+    f->base = mmap(NULL, f->size, PROT_READ, MAP_SHARED, fd, 0);
+    saved = errno;
+    (void) close(fd);
+    if (f->base == MAP_FAILED) {
+        f->base = NULL;
+        errno = saved;
+        return -1;
+    }
+
+    h = f->base;
+    if (f->size >= sizeof(*h)
+        && memcmp(h->magic, SECRET_MAGIC, sizeof(h->magic)) == 0) {
+        if (h->count == 0
+            || (f->size - sizeof(*h)) / sizeof(uint16_t) < h->count) {
+            secret_file_close(f);
+            errno = EINVAL;
+            return -1;
+        }
+        f->codes = (const uint16_t *) (h + 1);
+        f->count = h->count;
+        return 0;
+    }
+
+    /* a text file is not needed once it is parsed */
+    if (parse_text(f) < 0 || f->count == 0) {
+        saved = f->codes != NULL ? EINVAL : errno;
+        secret_file_close(f);
+        errno = saved;
+        return -1;
+    }
+    (void) munmap(f->base, f->size);
+    f->base = NULL;
+    return 0;
+}
+
+void secret_file_close(struct secret_file *f)
+{
+    if (f->base != NULL) {
+        (void) munmap(f->base, f->size);
+    }
+    free(f->parsed);
+    (void) memset(f, 0, sizeof(*f));
+}
+
+void secret_gen_fixed(struct secret_gen *g, uint16_t code)
+{
+    (void) memset(g, 0, sizeof(*g));
+    g->mode = SECRET_FIXED;
+    g->fixed = code & CODE_MASK;
+}
+
+void secret_gen_random(struct secret_gen *g, uint64_t seed, uint32_t stream)
+{
+    /* splitmix64 spreads the seed over the state, as its authors advise */
+    uint64_t z = seed ^ ((uint64_t) stream << 32);
+
+    (void) memset(g, 0, sizeof(*g));
+    g->mode = SECRET_RANDOM;
+    for (int i = 0; i < 4; ++i) {
+        uint64_t x = (z += 0x9e3779b97f4a7c15ULL);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        g->s[i] = x ^ (x >> 31);
+    }
+}
+
+void secret_gen_list(struct secret_gen *g, const struct secret_file *f,
+    uint32_t start, uint32_t step)
+{
+    (void) memset(g, 0, sizeof(*g));
+    g->mode = SECRET_LIST;
+    g->codes = f->codes;
+    g->count = f->count;
+    g->pos = start % f->count;
+    g->step = step % f->count;
+    if (g->step == 0) {
+        g->step = 1; /* at least as many generators as codes */
+    }
+}
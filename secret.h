@@ -0,0 +1,148 @@
+/**
+ * @brief sources of secrets for new games
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Every game is played against a secret drawn from a generator. A
+ * generator either repeats one fixed code, draws uniformly random codes
+ * from a xoshiro256** stream, or walks a list of codes loaded from a
+ * secret file. Drawing is a few instructions and never allocates, so
+ * every thread owns a generator and calls secret_next() per game.
+ *
+ * Secret files are either text, one code per line written as color
+ * letters like the server's secret, or binary: a struct secret_header
+ * followed by count little endian packed codes. Binary files are mapped
+ * read-only and shared, text files are parsed once when they are opened.
+*/
+
+#ifndef MM_SECRET_H_
+#define MM_SECRET_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "score.h"
+
+/* === Constants === */
+
+#define SECRET_MAGIC "MMSECRT1"
+
+#define SECRET_FIXED (0)
+#define SECRET_RANDOM (1)
+#define SECRET_LIST (2)
+
+/* === Type Definitions === */
+
+/* Header of a binary secret file */
+struct secret_header {
+    char magic[8];
+    uint32_t count;
+    uint32_t reserved;
+};
+
+/* The codes of a secret file */
+struct secret_file {
+    const uint16_t *codes;
+    uint32_t count;
+    void *base;             /* mapping of a binary file, else NULL */
+    size_t size;
+    uint16_t *parsed;       /* codes of a text file, else NULL */
+};
+
+struct secret_gen {
+    int mode;               /* SECRET_* */
+    uint16_t fixed;
+    uint64_t s[4];          /* xoshiro256** state */
+    const uint16_t *codes;
+    uint32_t count;
+    uint32_t pos;
+    uint32_t step;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Load a secret file
+ * @param f Receives the codes
+ * @param path The file
+ * @return 0 on success, -1 on error (errno is set, EINVAL for a bad file)
+ */
+int secret_file_open(struct secret_file *f, const char *path);
+
+/**
+ * @brief Release a secret file
+ * @param f The file
+ */
+void secret_file_close(struct secret_file *f);
+
+/**
+ * @brief Set up a generator that always returns the same code
+ * @param g The generator
+ * @param code The packed code
+ */
+void secret_gen_fixed(struct secret_gen *g, uint16_t code);
+
+/**
+ * @brief Set up a generator of random codes
+ * @param g The generator
+ * @param seed The seed shared by all streams
+ * @param stream Number of the stream, e.g. the worker, for distinct codes
+ */
+void secret_gen_random(struct secret_gen *g, uint64_t seed, uint32_t stream);
+
+/**
+ * @brief Set up a generator that walks the codes of a file
+ * @param g The generator
+ * @param f The file, it has to hold at least one code
+ * @param start Index of the first code
+ * @param step Distance to the next code; with n generators of start 0 to
+ * n - 1 and step n each code is drawn by one generator until they wrap
+ */
+void secret_gen_list(struct secret_gen *g, const struct secret_file *f,
+    uint32_t start, uint32_t step);
+
+/**
+ * @brief Next step of a xoshiro256** generator
+ * @param s The state
+ * @return 64 random bits
+ */
+static inline uint64_t secret_xoshiro(uint64_t *s)
+{
+    uint64_t r = s[1] * 5, t = s[1] << 17;
+
+    r = ((r << 7) | (r >> 57)) * 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return r;
+}
+
+/**
+ * @brief Draw the secret of a new game
+ * @param g The generator
+ * @return The packed secret
+ */
+static inline uint16_t secret_next(struct secret_gen *g)
+{
+    uint16_t code;
+
+    switch (g->mode) {
+    case SECRET_RANDOM:
+        /* the high bits are the best ones */
+        return secret_xoshiro(g->s) >> (64 - CODE_BITS);
+    case SECRET_LIST:
+        code = g->codes[g->pos] & CODE_MASK;
+        if (g->pos >= g->count - g->step) {
+            g->pos -= g->count - g->step;
+        } else {
+            g->pos += g->step;
+        }
+        return code;
+    default:
+        return g->fixed;
+    }
+}
+
+#endif
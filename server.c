@@ -29,130 +29,1621 @@
 #include <stdarg.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
 #include <signal.h>
 #include <errno.h>
 #include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "tbucket.h"
+#include "logger.h"
+#include "score.h"
+#include "game.h"
+#include "geometry.h"
+#include "slab.h"
+#include "gametab.h"
+#include "secret.h"
+#include "hist.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "timewheel.h"
+#include "shm.h"
+#ifdef HAVE_IO_URING
+#include "uring.h"
+#endif
+#include "args.h"
 #include "server.h"
 
-/* === Macros === */
+/* === Macros === */
+
+#ifdef ENDEBUG
+#define DEBUG(...) do { fprintf(stderr, __VA_ARGS__); } while(0)
+#else
+#define DEBUG(...)
+#endif
+
+/* Length of an array */
+#define COUNT_OF(x) (sizeof(x)/sizeof(x[0]))
+
+/* === Global Variables === */
+
+/* Name of the program */
+static const char *progname = "server"; /* default name */
+
+/* Eventfd that wakes all workers when the server shuts down */
+static int wakefd = -1;
+
+/* Worker threads, each serving its own share of the connections */
+static struct worker *workers = NULL;
+static int nworkers = 0;
+static int nrunning = 0;    /* worker threads started */
+
+/* Set by a worker thread that stopped on an error */
+static int worker_failed = 0;
+
+/* Codes of the secret file given with -f */
+static struct secret_file secret_file;
+
+/* Unix socket the stats thread serves (-S) */
+static int statsfd = -1;
+static const char *stats_path = NULL;
+static pthread_t stats_thread;
+static int stats_running = 0;
+
+/* Snapshots of the games (-k): the file, the snapshot restored at startup,
+   and the generation and key of the tokens handed out */
+static const char *snapshot_path = NULL;
+static long int snapshot_secs = DEFAULT_SNAPSHOT_SECS;
+static struct snapshot restored;
+static uint32_t generation = 0;
+static uint64_t token_key = 0;
+static struct snap_table *snap_tables = NULL;
+static pthread_t snapshot_thread;
+static int snapshot_running = 0;
+
+/* Pacing of the rounds of one game and of one worker */
+static struct tb_rate game_rate;
+static struct tb_rate worker_rate;
+static int pacing = 0;
+
+/* Timeouts of the games in milliseconds, 0 if off (-t, -T, -G) */
+static uint32_t idle_ms = 0;
+static uint32_t round_ms = 0;
+static uint32_t game_ms = 0;
+static int timeouts = 0;
+
+/* Unix socket clients connect to for a shared-memory channel (-U), and
+   whether the workers poll the channels instead of sleeping (-B) */
+static int shmfd = -1;
+static const char *shm_path = NULL;
+static int busy_poll = 0;
+
+/* This variable is set upon receipt of a signal */
+volatile sig_atomic_t quit = 0;
+
+/* === Implementations === */
+
+static void setup_worker(struct worker *w, const struct opts *options)
+{
+    struct sockaddr_in serv_addr;
+    int optval = 1;
+
+    /* records are packed at their natural 32 byte alignment, two per cache
+       line; the slab hands out low indices first to keep them dense */
+    if(slab_init(&w->game_slab, sizeof(*w->games), 1, options->max_games) < 0
+        || slab_init(&w->buf_slab, sizeof(w->scratch), CACHE_LINE,
+            options->max_games) < 0
+        || gametab_init(&w->tab, options->max_games) < 0
+        || (w->deferred =
+            malloc(options->max_games * sizeof(*w->deferred))) == NULL
+        || (w->bufs = calloc(options->max_games, sizeof(*w->bufs))) == NULL
+        || (w->clocks =
+            calloc(options->max_games, sizeof(*w->clocks))) == NULL) {
+        bail_out(EXIT_FAILURE, "allocating game table");
+    }
+    w->tick = tb_now() / 1000000;
+    if (timeouts && (tw_init(&w->timers, options->max_games, w->tick) < 0
+            || (w->expired =
+                malloc(EXPIRE_BATCH * sizeof(*w->expired))) == NULL)) {
+        bail_out(EXIT_FAILURE, "allocating timers");
+    }
+    if (options->shm_path != NULL && (w->shm_games =
+            malloc(options->max_games * sizeof(*w->shm_games))) == NULL) {
+        bail_out(EXIT_FAILURE, "allocating shared-memory games");
+    }
+    if (options->replay_dir != NULL) {
+        if ((w->replay = malloc(sizeof(*w->replay))) == NULL) {
+            bail_out(EXIT_FAILURE, "allocating replay log");
+        }
+        if (replay_open(w->replay, options->replay_dir, w->id,
+                REPLAY_SEGMENT_RECORDS) < 0) {
+            free(w->replay);
+            w->replay = NULL;
+            bail_out(EXIT_FAILURE, "creating replay log in %s",
+                options->replay_dir);
+        }
+    }
+    /* the only secret: one table per worker, taken before it serves, so
+       games never touch the shared cache and its lock */
+    if (options->fixed_secret
+        && (w->table = score_table_acquire(score_pack(options->secret)))
+            == NULL) {
+        bail_out(EXIT_FAILURE, "allocating score table");
+    }
+    w->games = (struct game *) w->game_slab.mem;
+    w->max_games = options->max_games;
+
+    if((w->sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        bail_out(EXIT_FAILURE, "creating socket");
+    }
+    if(setsockopt(w->sockfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0
+        || setsockopt(w->sockfd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0) {
+        bail_out(EXIT_FAILURE, "set socket option");
+    }
+    if(fcntl(w->sockfd, F_SETFL, O_NONBLOCK) < 0) {
+        bail_out(EXIT_FAILURE, "set socket non-blocking");
+    }
+
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(options->portno);
+    serv_addr.sin_addr.s_addr = INADDR_ANY;
+
+    if(bind(w->sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        bail_out(EXIT_FAILURE, "binding socket");
+    }
+    if(listen(w->sockfd, BACKLOG) == -1) {
+        bail_out(EXIT_FAILURE, "listen socket");
+    }
+
+    /* an io_uring is set up by the worker thread, which has to own it */
+    w->use_uring = options->uring;
+    if (!w->use_uring && setup_epoll(w) < 0) {
+        bail_out(EXIT_FAILURE, "setting up epoll");
+    }
+}
+
+static int setup_epoll(struct worker *w)
+{
+    struct epoll_event ev;
+
+    if((w->epfd = epoll_create1(0)) < 0) {
+        return -1;
+    }
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL; /* marks the listening socket */
+    if(epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->sockfd, &ev) < 0) {
+        return -1;
+    }
+    ev.events = EPOLLIN; /* level triggered, never read: wakes every worker */
+    ev.data.ptr = &wakefd;
+    if(epoll_ctl(w->epfd, EPOLL_CTL_ADD, wakefd, &ev) < 0) {
+        return -1;
+    }
+    if (shmfd >= 0) {
+        /* level triggered, but only one of the workers is woken */
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = &shmfd;
+        if(epoll_ctl(w->epfd, EPOLL_CTL_ADD, shmfd, &ev) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void *run_worker(void *arg)
+{
+    struct worker *w = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    if (w->use_uring) {
+#ifdef HAVE_IO_URING
+        if (setup_uring(w) == 0) {
+            run_uring(w);
+            return NULL;
+        }
+        LOG(LVL_WARN, "Worker %lld: io_uring not available (errno %lld), "
+            "using epoll", w->id, errno);
+#endif
+        if (setup_epoll(w) < 0) {
+            stop_on_error(w, "setting up epoll");
+            return NULL;
+        }
+    }
+
+    /* serve games until the server shuts down */
+    while (!quit) {
+        int timeout = run_deferred(w);
+        int timers = run_timers(w);
+        int n;
+
+        if (timers >= 0 && (timeout < 0 || timers < timeout)) {
+            timeout = timers;
+        }
+        if (busy_poll && w->nshm > 0) {
+            timeout = 0;
+        }
+        n = epoll_wait(w->epfd, events, MAX_EVENTS, timeout);
+        w->syscalls++;
+        if (timeouts) {
+            w->tick = tb_now() / 1000000;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            stop_on_error(w, "epoll_wait");
+            return NULL;
+        }
+        for (int i = 0; i < n; ++i) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == NULL) {
+                accept_games(w);
+            } else if (ptr == &shmfd) {
+                accept_shm(w);
+            } else if (ptr != &wakefd) {
+                handle_game(w, ptr, events[i].events);
+            }
+        }
+        /* a pass that found nothing hands the core to the clients if
+           they share it */
+        if (busy_poll && poll_shm(w) == 0 && n == 0) {
+            (void) sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static int run_deferred(struct worker *w)
+{
+    uint64_t now, min_wait = UINT64_MAX;
+    uint32_t n = w->ndeferred;
+
+    if (n == 0) {
+        return -1;
+    }
+    now = tb_now();
+    while (n-- > 0) {
+        uint32_t idx = w->deferred[w->deferred_head];
+        struct game *game = &w->games[idx];
+        uint64_t wait;
+
+        w->deferred_head = (w->deferred_head + 1) % w->max_games;
+        w->ndeferred--;
+        wait = take_tokens(w, game, now);
+        if (wait != 0) {
+            /* requeue at the tail to keep the order of arrival */
+            w->deferred[(w->deferred_head + w->ndeferred) % w->max_games] = idx;
+            w->ndeferred++;
+            if (wait < min_wait) {
+                min_wait = wait;
+            }
+            continue;
+        }
+        game->deferred = 0;
+        /* deferred games always have their own buffer, see keep_buf() */
+        w->bufs[idx]->paid = 1;
+#ifdef HAVE_IO_URING
+        if (w->uring) {
+            serve_uring(w, game, w->bufs[idx]);
+            continue;
+        }
+#endif
+        handle_game(w, game, 0);
+    }
+    if (w->ndeferred == 0) {
+        return -1;
+    }
+    if (min_wait == UINT64_MAX) {
+        /* all waiting games were deferred again while playing */
+        struct game *game = &w->games[w->deferred[w->deferred_head]];
+        uint64_t wait_game = tb_wait(&game_rate, game->tat, now);
+
+        min_wait = tb_wait(&worker_rate, w->tat, now);
+        if (wait_game > min_wait) {
+            min_wait = wait_game;
+        }
+    }
+    /* round up, waking early would only requeue the games again */
+    return (min_wait + 999999) / 1000000;
+}
+
+static int run_timers(struct worker *w)
+{
+    size_t n;
+    uint32_t next;
+
+    if (!timeouts) {
+        return -1;
+    }
+    /* timers are not moved on activity, only the clocks are updated; a
+       timer that comes due checks them and is armed again if the game
+       was active meanwhile */
+    while ((n = tw_expire(&w->timers, w->tick, w->expired,
+                EXPIRE_BATCH)) > 0) {
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t idx = w->expired[i];
+            struct game *game = &w->games[idx];
+            struct game_clock *clock = &w->clocks[idx];
+            uint32_t deadline;
+
+            if (game->closing) {
+                continue; /* freed with its last completion */
+            }
+            if (game->deferred) {
+                /* waiting for the server, not for the client */
+                clock->seen = clock->played = w->tick;
+            }
+            deadline = game_deadline(w, idx);
+            if ((int32_t) (deadline - w->tick) > 0) {
+                tw_arm(&w->timers, idx, deadline);
+                continue;
+            }
+            stat_add(&w->stats.games_expired, 1);
+            LOG(LVL_INFO, "Game on fd %lld: timed out, idle for %lld ms, "
+                "%lld ms since the last round", game->fd,
+                w->tick - clock->seen, w->tick - clock->played);
+#ifdef HAVE_IO_URING
+            if (w->uring) {
+                close_uring(w, game);
+                continue;
+            }
+#endif
+            end_game(w, game);
+        }
+    }
+    next = tw_next(&w->timers);
+    /* the tick after the current one is tw_next() == 0 */
+    return next == TW_IDLE ? -1 : (int) next + 1;
+}
+
+static uint32_t game_deadline(const struct worker *w, uint32_t idx)
+{
+    const struct game_clock *clock = &w->clocks[idx];
+    uint32_t deadline = w->tick + INT32_MAX;
+
+    if (idle_ms > 0 && (int32_t) (clock->seen + idle_ms - deadline) < 0) {
+        deadline = clock->seen + idle_ms;
+    }
+    if (round_ms > 0
+        && (int32_t) (clock->played + round_ms - deadline) < 0) {
+        deadline = clock->played + round_ms;
+    }
+    /* a multiplexed connection plays many games, it has no end */
+    if (game_ms > 0 && !w->games[idx].mux
+        && (int32_t) (clock->started + game_ms - deadline) < 0) {
+        deadline = clock->started + game_ms;
+    }
+    return deadline;
+}
+
+static uint64_t take_tokens(struct worker *w, struct game *game, uint64_t now)
+{
+    uint64_t wait_game = tb_wait(&game_rate, game->tat, now);
+    uint64_t wait_worker = tb_wait(&worker_rate, w->tat, now);
+
+    if (wait_game != 0 || wait_worker != 0) {
+        return wait_game > wait_worker ? wait_game : wait_worker;
+    }
+    (void) tb_take(&game_rate, &game->tat, now);
+    (void) tb_take(&worker_rate, &w->tat, now);
+    return 0;
+}
+
+static struct game *start_game(struct worker *w, int fd)
+{
+    struct game *game;
+    uint16_t code;
+
+    if ((game = slab_alloc(&w->game_slab)) == NULL) {
+        LOG(LVL_WARN, "Worker %lld: rejecting connection, %lld games "
+            "in progress", w->id, w->game_slab.live);
+        (void) close(fd);
+        return NULL;
+    }
+    (void) memset(game, 0, sizeof(*game));
+    game->fd = fd;
+    code = secret_next(&w->secrets);
+    gametab_start(&w->tab, game - w->games, code, w->conns++);
+    /* a table pays off only if all games share the secret */
+    game->table = w->table;
+    w->clocks[game - w->games].started = w->tick;
+    w->clocks[game - w->games].played = w->tick;
+    w->clocks[game - w->games].seen = w->tick;
+    if (timeouts) {
+        tw_arm(&w->timers, game - w->games,
+            game_deadline(w, game - w->games));
+    }
+    stat_add(&w->stats.games_started, 1);
+    DEBUG("Worker %d accepted game on fd %d\n", w->id, fd);
+    return game;
+}
+
+static void accept_games(struct worker *w)
+{
+    for (;;) {
+        struct sockaddr_in cli_addr;
+        socklen_t cli_size = sizeof(cli_addr);
+        struct epoll_event ev;
+        struct game *game;
+        int fd;
+
+        fd = accept(w->sockfd, (struct sockaddr *)&cli_addr, &cli_size);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                DEBUG("accept: %s\n", strerror(errno));
+            }
+            return;
+        }
+        if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+            (void) close(fd);
+            continue;
+        }
+        if ((game = start_game(w, fd)) == NULL) {
+            continue;
+        }
+
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = game;
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            DEBUG("epoll_ctl: %s\n", strerror(errno));
+            end_game(w, game);
+        }
+    }
+}
+
+static void accept_shm(struct worker *w)
+{
+    for (;;) {
+        struct epoll_event ev;
+        struct conn_buf *buf;
+        struct game *game;
+        uint32_t idx;
+        int fd;
+
+        fd = accept(shmfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                DEBUG("accept: %s\n", strerror(errno));
+            }
+            return;
+        }
+        if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+            (void) close(fd);
+            continue;
+        }
+        if ((game = start_game(w, fd)) == NULL) {
+            continue;
+        }
+        idx = game - w->games;
+        if ((buf = slab_alloc(&w->buf_slab)) == NULL) {
+            LOG(LVL_WARN, "Worker %lld: no memory for connection buffer",
+                w->id);
+            end_game(w, game);
+            continue;
+        }
+        buf->in_len = buf->in_off = buf->out_len = buf->out_off = 0;
+        buf->paid = 0;
+        buf->recv_at = 0;
+        (void) memset(buf->rounds, 0, sizeof(buf->rounds));
+        buf->shm_hup = 0;
+        buf->shm_pos = w->nshm;
+        w->shm_games[w->nshm++] = idx;
+        w->bufs[idx] = buf;
+        game->shm = 1;
+        if (shm_accept(&buf->shm, fd) < 0) {
+            LOG(LVL_WARN, "Worker %lld: no shared-memory channel "
+                "(errno %lld)", w->id, errno);
+            end_game(w, game);
+            continue;
+        }
+
+        /* the socket only reports the hangup, the eventfd the wakeups */
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = game;
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            DEBUG("epoll_ctl: %s\n", strerror(errno));
+            end_game(w, game);
+            continue;
+        }
+        ev.events = EPOLLIN | EPOLLET;
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, buf->shm.wake_fd, &ev) < 0) {
+            DEBUG("epoll_ctl: %s\n", strerror(errno));
+            end_game(w, game);
+            continue;
+        }
+        /* requests written before this asked for a wakeup woke nobody */
+        handle_game(w, game, 0);
+    }
+}
+
+static uint32_t poll_shm(struct worker *w)
+{
+    uint32_t served = 0;
+
+    /* backwards: a game that ends is replaced by the last one, which was
+       polled already */
+    for (uint32_t i = w->nshm; i-- > 0;) {
+        uint32_t idx = w->shm_games[i];
+        struct conn_buf *buf = w->bufs[idx];
+
+        if (shm_readable(&buf->shm) || buf->out_off < buf->out_len
+            || buf->shm_hup) {
+            handle_game(w, &w->games[idx], 0);
+            served++;
+        }
+    }
+    return served;
+}
+
+static ssize_t conn_send(struct worker *w, struct game *game,
+    const void *data, size_t len)
+{
+    struct shm_chan *c;
+    size_t n;
+
+    if (!game->shm) {
+        w->syscalls++;
+        return send(game->fd, data, len, MSG_NOSIGNAL);
+    }
+    c = &w->bufs[game - w->games]->shm;
+    /* the client wakes the worker once it made room, unless it is polled */
+    while ((n = shm_write(c, data, len)) == 0) {
+        if (busy_poll || shm_want_write(c) == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+    return n;
+}
+
+static ssize_t conn_recv(struct worker *w, struct game *game, void *data,
+    size_t len)
+{
+    struct conn_buf *buf;
+    size_t n;
+
+    if (!game->shm) {
+        w->syscalls++;
+        return recv(game->fd, data, len, 0);
+    }
+    buf = w->bufs[game - w->games];
+    /* the client wrote everything before it closed the socket */
+    while ((n = shm_read(&buf->shm, data, len)) == 0) {
+        if (buf->shm_hup) {
+            return 0;
+        }
+        if (busy_poll || shm_want_read(&buf->shm) == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+    return n;
+}
+
+static void handle_game(struct worker *w, struct game *game, uint32_t events)
+{
+    uint32_t idx = game - w->games;
+    struct conn_buf *buf = w->bufs[idx];
+    int drained = 0;
+
+    if (game->shm && (events & (EPOLLRDHUP | EPOLLHUP))) {
+        /* edge triggered: reported once, kept for the last recv */
+        buf->shm_hup = 1;
+    }
+    if (game->deferred) {
+        /* not before its round was played, errors show up on the next recv */
+        return;
+    }
+    if (events & EPOLLERR) {
+        end_game(w, game);
+        return;
+    }
+    if (buf == NULL) {
+        /* most connections have nothing left over between two events */
+        buf = &w->scratch;
+        buf->in_len = buf->in_off = buf->out_len = buf->out_off = 0;
+        buf->paid = 0;
+    }
+
+    /* edge triggered: consume everything until the socket would block */
+    for (;;) {
+        ssize_t r;
+        int played;
+
+        /* send all responses in one go before playing further requests */
+        while (buf->out_off < buf->out_len) {
+            r = conn_send(w, game, &buf->out[buf->out_off],
+                buf->out_len - buf->out_off);
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    end_game(w, game);
+                    return;
+                }
+                break;
+            }
+            buf->out_off += r;
+        }
+        if (buf->out_off < buf->out_len) {
+            break; /* wait for EPOLLOUT */
+        }
+        buf->out_off = buf->out_len = 0;
+        if (game_is_over(w, game)) {
+            end_game(w, game);
+            return;
+        }
+        if (game->deferred) {
+            break;
+        }
+
+        if ((played = play_requests(w, game, buf)) < 0) {
+            end_game(w, game);
+            return;
+        }
+        if (w->bufs[idx] != NULL) {
+            buf = w->bufs[idx]; /* moved off the scratch buffer */
+        }
+        if (played > 0) {
+            continue;
+        }
+        if (game->deferred || drained) {
+            break;
+        }
+
+        /* keep the partial request and read the next batch behind it */
+        (void) memmove(buf->in, &buf->in[buf->in_off],
+            buf->in_len - buf->in_off);
+        buf->in_len -= buf->in_off;
+        buf->in_off = 0;
+        r = conn_recv(w, game, &buf->in[buf->in_len],
+            CONN_BUF_BYTES - buf->in_len);
+        if (r == 0) {
+            end_game(w, game);
+            return;
+        }
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                end_game(w, game);
+                return;
+            }
+            break;
+        }
+        /* a short read emptied the socket, the next data raises a new edge;
+           a hangup has to be read until recv returns 0 though; a channel
+           only wakes the worker if it asked for it when it was empty */
+        drained = !game->shm && (size_t) r < CONN_BUF_BYTES - buf->in_len
+            && !(events & (EPOLLRDHUP | EPOLLHUP));
+        if (buf->in_len < request_bytes(game)) {
+            buf->recv_at = tb_now(); /* no complete request was waiting */
+        }
+        buf->in_len += r;
+        w->clocks[idx].seen = w->tick;
+    }
+
+    if (keep_buf(w, game, buf) == NULL) {
+        end_game(w, game);
+    } else if (buf != &w->scratch && !game->mux && !game->geo && !game->shm
+        && buf->in_off == buf->in_len && buf->out_off == buf->out_len) {
+        /* back in step with the client */
+        slab_free(&w->buf_slab, buf);
+        w->bufs[idx] = NULL;
+    }
+}
+
+static int play_requests(struct worker *w, struct game *game,
+    struct conn_buf *buf)
+{
+    size_t req_bytes = request_bytes(game);
+    size_t resp_bytes = game->mux ? MUX_RESP_BYTES
+        : game->geo ? GEO_RESP_BYTES : WRITE_BYTES;
+    uint32_t idx = game - w->games;
+    uint64_t start = 0;
+    int played = 0;
+
+    if (buf->in_len - buf->in_off >= req_bytes) {
+        start = tb_now();
+    }
+    while (!game_is_over(w, game) && buf->in_len - buf->in_off >= req_bytes
+        && buf->out_len + resp_bytes <= CONN_BUF_BYTES) {
+        const uint8_t *frame = &buf->in[buf->in_off];
+        uint16_t id = 0, secret, resp;
+        uint32_t request;
+        uint8_t round;
+        int over, invalid, lost;
+
+        if (game->mux) {
+            id = frame[0] | (frame[1] << 8);
+            frame += 2;
+            if (id >= MUX_MAX_GAMES) {
+                LOG(LVL_WARN, "Game on fd %lld: invalid game id %lld",
+                    game->fd, id);
+                return -1;
+            }
+        }
+        request = frame[0] | (frame[1] << 8);
+        if (game->geo) {
+            request |= ((uint32_t) frame[2] << 16)
+                | ((uint32_t) frame[3] << 24);
+        }
+
+        if (!game->mux && !game->geo && w->tab.round[idx] == 0
+            && request == MUX_HELLO) {
+            /* switch to multiplexed mode, its game state lives in buf */
+            int one = 1;
+
+            game->mux = 1;
+            if ((buf = keep_buf(w, game, buf)) == NULL) {
+                return -1;
+            }
+            /* batches may be answered in parts while pacing, do not let
+               Nagle hold a part back until the client's delayed ACK */
+            (void) setsockopt(game->fd, IPPROTO_TCP, TCP_NODELAY,
+                &one, sizeof(one));
+            LOG(LVL_INFO, "Game on fd %lld: multiplexed", game->fd);
+            /* only the games on the connection count */
+            stat_add(&w->stats.games_started, -1);
+            buf->in_off += req_bytes;
+            buf->out[buf->out_len++] = MUX_ACK;
+            return 1;
+        }
+        if (!game->mux && !game->geo && w->tab.round[idx] == 0
+            && request == GEO_HELLO) {
+            return start_geometry(w, game, buf);
+        }
+        if (!game->mux && !game->geo && w->tab.round[idx] == 0
+            && snapshot_path != NULL
+            && (request == TOKEN_HELLO || request == RESUME_HELLO)) {
+            return request == TOKEN_HELLO ? send_token(w, game, buf)
+                : resume_game(w, game, buf);
+        }
+
+        if (pacing && !buf->paid && take_tokens(w, game, tb_now()) != 0) {
+            game->deferred = 1;
+            w->deferred[(w->deferred_head + w->ndeferred) % w->max_games] =
+                game - w->games;
+            w->ndeferred++;
+            break;
+        }
+        buf->paid = 0;
+        buf->in_off += req_bytes;
+
+        if (game->mux) {
+            if (++buf->rounds[id] == 1) {
+                buf->secrets[id] = game->table != NULL
+                    ? w->tab.secret[idx] : secret_next(&w->secrets);
+                stat_add(&w->stats.games_started, 1);
+            }
+            round = buf->rounds[id];
+            secret = buf->secrets[id];
+        } else {
+            /* published below, once the response is stored */
+            round = w->tab.round[idx] + 1;
+            secret = w->tab.secret[idx];
+        }
+        if (game->geo) {
+            /* the secret of the geometry does not fit into the table */
+            const struct geometry *g = geometry_get(game->geo - 1);
+
+            resp = g->answer(buf->geo_secret, request, round);
+            over = geometry_over(g, resp);
+            invalid = resp & (1 << GEO_INVALID_BIT);
+            lost = resp & (1 << GEO_LOST_BIT);
+        } else {
+            resp = game->table != NULL
+                ? game_answer(game->table, request, round)
+                : game_answer_code(secret, request, round);
+            over = game_over(resp);
+            invalid = resp & (1 << PARITY_ERR_BIT);
+            lost = resp & (1 << GAME_LOST_ERR_BIT);
+            if (w->replay != NULL) {
+                replay_append(w->replay, w->tab.conn[idx], id, request,
+                    secret, round, resp);
+            }
+        }
+        played++;
+        LOG(LVL_DEBUG, "Game %lld on fd %lld: request 0x%llx, response 0x%llx",
+            id, game->fd, request, resp);
+
+        if (over) {
+            /* stop the game after the answer if its over, or an error
+               occured; multiplexed ids start their next game */
+            if (invalid) {
+                stat_add(&w->stats.parity_errors, 1);
+                LOG(LVL_INFO, "Game %lld on fd %lld: parity error",
+                    id, game->fd);
+            } else if (lost) {
+                stat_add(&w->stats.games_lost, 1);
+                LOG(LVL_INFO, "Game %lld on fd %lld: game lost", id, game->fd);
+            } else {
+                stat_add(&w->stats.games_won, 1);
+                LOG(LVL_INFO, "Game %lld on fd %lld: won after %lld rounds",
+                    id, game->fd, round);
+            }
+            if (game->mux) {
+                buf->rounds[id] = 0;
+            } else {
+                w->tab.flags[idx] |= GT_OVER;
+            }
+        }
+        if (game->mux) {
+            buf->out[buf->out_len++] = id & 0xff;
+            buf->out[buf->out_len++] = id >> 8;
+        } else {
+            /* a snapshot forks while the workers run: the round goes last,
+               so a snapshot that has it also has its response and GT_OVER */
+            w->tab.resp[idx] = resp;
+            __atomic_store_n(&w->tab.round[idx], round, __ATOMIC_RELEASE);
+        }
+        buf->out[buf->out_len++] = resp;
+        if (game->geo) {
+            buf->out[buf->out_len++] = resp >> 8;
+        }
+    }
+    if (played > 0) {
+        /* one clock read per batch, the rounds of a batch share the times */
+        uint64_t end = tb_now();
+
+        stat_add(&w->stats.rounds, played);
+        w->clocks[idx].played = w->tick;
+        hist_record(&w->stats.queue, start - buf->recv_at, played);
+        hist_record(&w->stats.score, (end - start) / played, played);
+        hist_record(&w->stats.latency, end - buf->recv_at, played);
+    }
+    return played;
+}
+
+static int send_token(struct worker *w, struct game *game,
+    struct conn_buf *buf)
+{
+    uint32_t idx = game - w->games;
+    struct snap_token token;
+
+    if (buf->out_len + TOKEN_RESP_BYTES > CONN_BUF_BYTES) {
+        return 0;
+    }
+    snapshot_token(&token, token_key, w->section, idx, w->tab.conn[idx]);
+    buf->in_off += READ_BYTES;
+    buf->out[buf->out_len++] = TOKEN_ACK;
+    snapshot_token_pack(&token, &buf->out[buf->out_len]);
+    buf->out_len += GAME_TOKEN_BYTES;
+    return 1;
+}
+
+static int start_geometry(struct worker *w, struct game *game,
+    struct conn_buf *buf)
+{
+    uint32_t idx = game - w->games;
+    const struct geometry *g;
+
+    if (buf->in_len - buf->in_off < GEO_HELLO_BYTES) {
+        return 0;
+    }
+    g = geometry_get(buf->in[buf->in_off + READ_BYTES]);
+    buf->in_off += GEO_HELLO_BYTES;
+    if (g == NULL) {
+        LOG(LVL_INFO, "Game on fd %lld: unknown geometry", game->fd);
+        buf->out[buf->out_len++] = GEO_UNKNOWN;
+        w->tab.flags[idx] |= GT_OVER;
+        return 1;
+    }
+    /* the wider secret lives in buf, like the ones of multiplexed games */
+    game->geo = g->id + 1;
+    if ((buf = keep_buf(w, game, buf)) == NULL) {
+        return -1;
+    }
+    buf->geo_secret = geometry_code(g, secret_xoshiro(w->geo_secrets.s));
+    LOG(LVL_INFO, "Game on fd %lld: %lld slots, %lld colors", game->fd,
+        g->slots, g->colors);
+    buf->out[buf->out_len++] = GEO_ACK;
+    return 1;
+}
+
+static int resume_game(struct worker *w, struct game *game,
+    struct conn_buf *buf)
+{
+    uint32_t idx = game - w->games;
+    struct snap_token token;
+    struct snap_game state;
+
+    if (buf->in_len - buf->in_off < READ_BYTES + GAME_TOKEN_BYTES
+        || buf->out_len + RESUME_RESP_BYTES > CONN_BUF_BYTES) {
+        return 0;
+    }
+    snapshot_token_unpack(&token, &buf->in[buf->in_off + READ_BYTES]);
+    buf->in_off += READ_BYTES + GAME_TOKEN_BYTES;
+    if (restored.base == NULL
+        || snapshot_claim(&restored, &token, &state) < 0) {
+        LOG(LVL_INFO, "Game on fd %lld: unknown token", game->fd);
+        buf->out[buf->out_len++] = RESUME_UNKNOWN;
+        w->tab.flags[idx] |= GT_OVER;
+        return 1;
+    }
+
+    /* the game keeps its secret, the connection number is the new one */
+    if (state.secret != w->tab.secret[idx]) {
+        game->table = NULL;
+    }
+    w->tab.secret[idx] = state.secret;
+    w->tab.resp[idx] = state.resp;
+    __atomic_store_n(&w->tab.round[idx], state.round, __ATOMIC_RELEASE);
+    stat_add(&w->stats.games_started, -1);
+    stat_add(&w->stats.games_resumed, 1);
+    LOG(LVL_INFO, "Game on fd %lld: resumed after %lld rounds",
+        game->fd, state.round);
+
+    snapshot_token(&token, token_key, w->section, idx, w->tab.conn[idx]);
+    buf->out[buf->out_len++] = TOKEN_ACK;
+    snapshot_token_pack(&token, &buf->out[buf->out_len]);
+    buf->out_len += GAME_TOKEN_BYTES;
+    buf->out[buf->out_len++] = state.round;
+    buf->out[buf->out_len++] = state.resp;
+    return 1;
+}
+
+static struct conn_buf *keep_buf(struct worker *w, struct game *game,
+    struct conn_buf *buf)
+{
+    uint32_t idx = game - w->games;
+
+    if (buf != &w->scratch) {
+        return buf;
+    }
+    if (!game->mux && !game->geo && buf->in_off == buf->in_len
+        && buf->out_off == buf->out_len) {
+        return buf; /* nothing to keep */
+    }
+    if ((w->bufs[idx] = slab_alloc(&w->buf_slab)) == NULL) {
+        LOG(LVL_WARN, "Worker %lld: no memory for connection buffer", w->id);
+        return NULL;
+    }
+    /* only the live parts, the scratch buffer is mostly empty */
+    w->bufs[idx]->in_len = buf->in_len - buf->in_off;
+    w->bufs[idx]->in_off = 0;
+    (void) memcpy(w->bufs[idx]->in, &buf->in[buf->in_off],
+        w->bufs[idx]->in_len);
+    w->bufs[idx]->out_len = buf->out_len - buf->out_off;
+    w->bufs[idx]->out_off = 0;
+    (void) memcpy(w->bufs[idx]->out, &buf->out[buf->out_off],
+        w->bufs[idx]->out_len);
+    w->bufs[idx]->paid = buf->paid;
+    w->bufs[idx]->recv_at = buf->recv_at;
+    (void) memset(w->bufs[idx]->rounds, 0, sizeof(buf->rounds));
+    return w->bufs[idx];
+}
+
+#ifdef HAVE_IO_URING
+static int setup_uring(struct worker *w)
+{
+    struct io_uring_sqe *sqe;
+
+    if (uring_init(&w->ring, URING_ENTRIES) < 0) {
+        return -1;
+    }
+    /* multishot recv came with Linux 6.0 as did IORING_OP_SEND_ZC, which
+       unlike the multishot flag shows up in the opcode probe */
+    if (!uring_supports(&w->ring, IORING_OP_SEND_ZC)) {
+        uring_exit(&w->ring);
+        errno = ENOSYS;
+        return -1;
+    }
+    if (uring_bufs_init(&w->ring, &w->recv_bufs, 0, URING_BUFS,
+            URING_BUF_BYTES) < 0) {
+        uring_exit(&w->ring);
+        return -1;
+    }
+
+    /* one multishot accept serves all connections */
+    sqe = uring_sqe(&w->ring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = w->sockfd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = URING_ACCEPT;
+    sqe = uring_sqe(&w->ring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wakefd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = URING_WAKE;
+    if (uring_enter(&w->ring, 0, -1) < 0) {
+        uring_bufs_free(&w->ring, &w->recv_bufs);
+        uring_exit(&w->ring);
+        return -1;
+    }
+    w->uring = 1;
+    LOG(LVL_INFO, "Worker %lld: using io_uring", w->id);
+    return 0;
+}
 
-#ifdef ENDEBUG
-#define DEBUG(...) do { fprintf(stderr, __VA_ARGS__); } while(0)
-#else
-#define DEBUG(...)
-#endif
+static void run_uring(struct worker *w)
+{
+    /* serve games until the server shuts down */
+    while (!quit) {
+        struct io_uring_cqe *cqe;
+        int timeout = run_deferred(w);
+        int timers = run_timers(w);
 
-/* Length of an array */
-#define COUNT_OF(x) (sizeof(x)/sizeof(x[0]))
+        if (timers >= 0 && (timeout < 0 || timers < timeout)) {
+            timeout = timers;
+        }
+        /* submits everything queued since the last call in one go */
+        w->syscalls++;
+        if (uring_enter(&w->ring, 1, timeout) < 0) {
+            if (errno == EINTR) continue;
+            stop_on_error(w, "io_uring_enter");
+            return;
+        }
+        if (timeouts) {
+            w->tick = tb_now() / 1000000;
+        }
+        while ((cqe = uring_cqe(&w->ring)) != NULL) {
+            uint64_t ud = cqe->user_data;
+            int res = cqe->res;
+            uint32_t flags = cqe->flags;
+            struct game *game = &w->games[ud >> URING_OP_BITS];
 
-/* === Global Variables === */
+            uring_seen(&w->ring);
+            switch (ud & ((1 << URING_OP_BITS) - 1)) {
+            case URING_ACCEPT:
+                uring_accepted(w, res, flags);
+                break;
+            case URING_RECV:
+                uring_received(w, game, res, flags);
+                break;
+            case URING_SEND:
+                uring_sent(w, game, res);
+                break;
+            default:
+                break; /* URING_WAKE, quit is set */
+            }
+        }
+    }
+}
 
-/* Name of the program */
-static const char *progname = "server"; /* default name */
+static void uring_accepted(struct worker *w, int res, uint32_t flags)
+{
+    struct io_uring_sqe *sqe;
+    struct game *game;
 
-/* File descriptor for server socket */
-static int sockfd = -1;
+    if (!(flags & IORING_CQE_F_MORE)) {
+        /* the kernel dropped the multishot accept, arm a new one */
+        if ((sqe = uring_sqe(&w->ring)) == NULL) {
+            /* sets quit, run_uring() returns after this batch */
+            errno = EBUSY;
+            stop_on_error(w, "io_uring submission queue full");
+            return;
+        }
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = w->sockfd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->user_data = URING_ACCEPT;
+    }
+    if (res < 0) {
+        DEBUG("accept: %s\n", strerror(-res));
+        return;
+    }
+    if ((game = start_game(w, res)) != NULL && uring_recv(w, game) < 0) {
+        end_game(w, game);
+    }
+}
 
-/* File descriptor for connection socket */
-static int connfd = -1;
+static int uring_recv(struct worker *w, struct game *game)
+{
+    struct io_uring_sqe *sqe = uring_sqe(&w->ring);
 
-/* This variable is set upon receipt of a signal */
-volatile sig_atomic_t quit = 0;
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = game->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = w->recv_bufs.group;
+    sqe->user_data = ((uint64_t) (game - w->games) << URING_OP_BITS)
+        | URING_RECV;
+    game->recving = 1;
+    game->inflight++;
+    return 0;
+}
 
-/* === Implementations === */
+static void uring_received(struct worker *w, struct game *game, int res,
+    uint32_t flags)
+{
+    struct conn_buf *buf = w->bufs[game - w->games];
+    const uint8_t *data = NULL;
+    uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        game->recving = 0;
+        game->inflight--;
+    }
+    if (flags & IORING_CQE_F_BUFFER) {
+        data = uring_buf(&w->recv_bufs, bid);
+    }
+    if (game->closing || (res <= 0 && res != -ENOBUFS)) {
+        if (data != NULL) {
+            uring_buf_put(&w->recv_bufs, bid);
+        }
+        close_uring(w, game);
+        return;
+    }
+
+    if (res > 0) {
+        if (buf == NULL) {
+            buf = &w->scratch;
+            buf->in_len = buf->in_off = buf->out_len = buf->out_off = 0;
+            buf->paid = 0;
+        }
+        (void) memmove(buf->in, &buf->in[buf->in_off],
+            buf->in_len - buf->in_off);
+        buf->in_len -= buf->in_off;
+        buf->in_off = 0;
+        if (buf->in_len + res > CONN_BUF_BYTES) {
+            /* without backpressure a client may only run this far ahead */
+            LOG(LVL_WARN, "Game on fd %lld: too many requests in flight",
+                game->fd);
+            uring_buf_put(&w->recv_bufs, bid);
+            close_uring(w, game);
+            return;
+        }
+        (void) memcpy(&buf->in[buf->in_len], data, res);
+        if (buf->in_len < request_bytes(game)) {
+            buf->recv_at = tb_now(); /* no complete request was waiting */
+        }
+        buf->in_len += res;
+        w->clocks[game - w->games].seen = w->tick;
+        uring_buf_put(&w->recv_bufs, bid);
+        serve_uring(w, game, buf);
+    }
+    /* out of provided buffers (-ENOBUFS) or stopped for another reason */
+    if (game->fd >= 0 && !game->closing && !game->recving
+        && uring_recv(w, game) < 0) {
+        close_uring(w, game);
+    }
+}
 
-static uint8_t *read_from_client(int fd, uint8_t *buffer, size_t n)
+static int uring_send(struct worker *w, struct game *game,
+    const uint8_t *data, uint32_t len)
 {
-    /* loop, as packet can arrive in several partial reads */
-    size_t bytes_recv = 0;
-    do {
-        ssize_t r;
-        r = recv(fd, buffer + bytes_recv, n - bytes_recv, 0);
-        if (r <= 0) {
-            return NULL;
+    struct io_uring_sqe *sqe = uring_sqe(&w->ring);
+
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = game->fd;
+    sqe->addr = (uint64_t) (uintptr_t) data;
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = ((uint64_t) (game - w->games) << URING_OP_BITS)
+        | URING_SEND;
+    game->sending = 1;
+    game->inflight++;
+    return 0;
+}
+
+static void uring_sent(struct worker *w, struct game *game, int res)
+{
+    struct conn_buf *buf = w->bufs[game - w->games];
+
+    game->sending = 0;
+    game->inflight--;
+    if (game->closing || res < 0) {
+        close_uring(w, game);
+        return;
+    }
+    if (game->tx_len > 0) {
+        if (res < game->tx_len) {
+            game->tx_len -= res;
+            (void) memmove(game->tx, &game->tx[res], game->tx_len);
+            if (uring_send(w, game, game->tx, game->tx_len) < 0) {
+                close_uring(w, game);
+            }
+            return;
+        }
+        game->tx_len = 0;
+        if (buf == NULL) {
+            if (game_is_over(w, game)) {
+                close_uring(w, game);
+            }
+            return;
+        }
+        res = 0; /* the buffer's responses were not part of this send */
+    }
+    buf->out_off += res;
+    serve_uring(w, game, buf);
+}
+
+static void serve_uring(struct worker *w, struct game *game,
+    struct conn_buf *buf)
+{
+    uint32_t idx = game - w->games;
+
+    if (game->closing || game->deferred || game->sending) {
+        /* requests that arrive meanwhile wait in the connection's buffer */
+        if (keep_buf(w, game, buf) == NULL) {
+            close_uring(w, game);
+        }
+        return;
+    }
+    if (buf->out_off == buf->out_len) {
+        buf->out_off = buf->out_len = 0;
+        if (game_is_over(w, game)) {
+            close_uring(w, game);
+            return;
+        }
+        if (play_requests(w, game, buf) < 0) {
+            close_uring(w, game);
+            return;
+        }
+        if (w->bufs[idx] != NULL) {
+            buf = w->bufs[idx]; /* moved off the scratch buffer */
         }
-        bytes_recv += r;
-    } while (bytes_recv < n);
+    }
 
-    if (bytes_recv < n) {
-        return NULL;
+    if (buf->out_off < buf->out_len) {
+        uint32_t len = buf->out_len - buf->out_off;
+
+        if (buf == &w->scratch && buf->in_off == buf->in_len
+            && len <= sizeof(game->tx)) {
+            /* a lock-step response is sent from the game record */
+            (void) memcpy(game->tx, &buf->out[buf->out_off], len);
+            game->tx_len = len;
+            buf->out_off = buf->out_len = 0;
+            if (uring_send(w, game, game->tx, len) < 0) {
+                close_uring(w, game);
+            }
+            return;
+        }
+        /* the responses have to stay put until the send completes */
+        if ((buf = keep_buf(w, game, buf)) == NULL
+            || uring_send(w, game, &buf->out[buf->out_off],
+                buf->out_len - buf->out_off) < 0) {
+            close_uring(w, game);
+        }
+        return;
+    }
+    if (game_is_over(w, game)) {
+        close_uring(w, game);
+    } else if (keep_buf(w, game, buf) == NULL) {
+        close_uring(w, game);
+    } else if (buf != &w->scratch && !game->mux && !game->geo
+        && !game->deferred && buf->in_off == buf->in_len) {
+        /* back in step with the client */
+        slab_free(&w->buf_slab, buf);
+        w->bufs[idx] = NULL;
     }
-    return buffer;
 }
 
-static uint8_t *send_to_client(int fd, uint8_t *buffer, size_t n)
+static void close_uring(struct worker *w, struct game *game)
 {
-    /* loop, as packet can arrive in several partial reads */
-    size_t bytes_sent = 0;
-    do {
-        ssize_t r;
-        r = send(fd, buffer + bytes_sent, n - bytes_sent, 0);
-        if (r <= 0) {
-            return NULL;
+    if (game->inflight == 0) {
+        end_game(w, game);
+    } else if (!game->closing) {
+        /* ends the multishot recv, the record is freed with the last CQE */
+        game->closing = 1;
+        (void) shutdown(game->fd, SHUT_RDWR);
+    }
+}
+#endif
+
+static size_t request_bytes(const struct game *game)
+{
+    return game->mux ? MUX_REQ_BYTES : game->geo ? GEO_REQ_BYTES : READ_BYTES;
+}
+
+static int game_is_over(const struct worker *w, const struct game *game)
+{
+    return w->tab.flags[game - w->games] & GT_OVER;
+}
+
+static void end_game(struct worker *w, struct game *game)
+{
+    uint32_t idx = game - w->games;
+
+    if (game->deferred) {
+        /* only if its buffer could not be kept, drop it from the ring */
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < w->ndeferred; ++i) {
+            uint32_t d = w->deferred[(w->deferred_head + i) % w->max_games];
+            if (d != idx) {
+                w->deferred[(w->deferred_head + n++) % w->max_games] = d;
+            }
         }
-        bytes_sent += r;
-    } while (bytes_sent < n);
+        w->ndeferred = n;
+    }
+    if (timeouts) {
+        tw_cancel(&w->timers, idx);
+    }
+    if (game->shm) {
+        struct conn_buf *buf = w->bufs[idx];
 
-    if (bytes_sent < n) {
-        return NULL;
+        /* the eventfd leaves the epoll set with it, the socket is below */
+        shm_close(&buf->shm);
+        w->shm_games[buf->shm_pos] = w->shm_games[--w->nshm];
+        w->bufs[w->shm_games[buf->shm_pos]]->shm_pos = buf->shm_pos;
+    }
+    DEBUG("Closing game on fd %d\n", game->fd);
+    /* closing the socket also removes it from the epoll set */
+    (void) close(game->fd);
+    if (w->bufs[idx] != NULL) {
+        slab_free(&w->buf_slab, w->bufs[idx]);
+        w->bufs[idx] = NULL;
     }
-    return buffer;
+    game->fd = -1;
+    gametab_end(&w->tab, idx);
+    slab_free(&w->game_slab, game);
 }
 
-static int compute_answer(uint16_t req, uint8_t *resp, uint8_t *secret)
+static void stat_add(uint64_t *counter, int64_t n)
 {
-    int colors_left[COLORS];
-    int guess[COLORS];
-    uint8_t parity_calc, parity_recv;
-    int red, white;
-    int j;
+    /* a plain store suffices, only the owning worker writes the counter */
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
 
-    parity_recv = (req >> 15) & 1;
+static void setup_stats(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
 
-    /* extract the guess and calculate parity */
-    parity_calc = 0;
-    for (j = 0; j < SLOTS; ++j) {
-        int tmp = req & 0x7;
-        parity_calc ^= tmp ^ (tmp >> 1) ^ (tmp >> 2);
-        guess[j] = tmp;
-        req >>= SHIFT_WIDTH;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        bail_out(EXIT_FAILURE, "stats socket %s", path);
     }
-    parity_calc &= 0x1;
+    (void) memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    (void) strcpy(addr.sun_path, path);
+    /* a socket left behind by an earlier run, other files stay */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        (void) unlink(path);
+    }
+    if ((statsfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+        || bind(statsfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        bail_out(EXIT_FAILURE, "stats socket %s", path);
+    }
+    stats_path = path;
+    if (listen(statsfd, 16) < 0) {
+        bail_out(EXIT_FAILURE, "listen on %s", path);
+    }
+}
 
-    /* marking red and white */
-    (void) memset(&colors_left[0], 0, sizeof(colors_left));
-    red = white = 0;
-    for (j = 0; j < SLOTS; ++j) {
-        /* mark red */
-        printf("%d:%d, ", guess[j], secret[j]);
-        if (guess[j] == secret[j]) {
-            red++;
-        } else {
-            colors_left[secret[j]]++;
+static void setup_shm(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        bail_out(EXIT_FAILURE, "shared-memory socket %s", path);
+    }
+    (void) memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    (void) strcpy(addr.sun_path, path);
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        (void) unlink(path);
+    }
+    if ((shmfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+        || bind(shmfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        bail_out(EXIT_FAILURE, "shared-memory socket %s", path);
+    }
+    shm_path = path;
+    if (fcntl(shmfd, F_SETFL, O_NONBLOCK) < 0
+        || listen(shmfd, BACKLOG) < 0) {
+        bail_out(EXIT_FAILURE, "listen on %s", path);
+    }
+}
+
+static void *run_stats(void *arg)
+{
+    struct pollfd fds[2] = {
+        { .fd = statsfd, .events = POLLIN },
+        { .fd = wakefd, .events = POLLIN },
+    };
+
+    (void) arg;
+    while (poll(fds, COUNT_OF(fds), -1) >= 0 || errno == EINTR) {
+        int fd;
+
+        if (fds[1].revents & POLLIN) {
+            break; /* shutting down */
         }
+        if (!(fds[0].revents & POLLIN)
+            || (fd = accept(statsfd, NULL, NULL)) < 0) {
+            continue;
+        }
+        serve_stats(fd);
+        (void) close(fd);
     }
-    for (j = 0; j < SLOTS; ++j) {
-        /* not marked red */
-        if (guess[j] != secret[j]) {
-            if (colors_left[guess[j]] > 0) {
-                white++;
-                colors_left[guess[j]]--;
-            }
+    return NULL;
+}
+
+static void serve_stats(int fd)
+{
+    static char out[4096];
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = 100000 };
+    char cmd[16] = "";
+    size_t len, off = 0;
+    ssize_t r;
+
+    /* an optional request line picks the format, text if there is none */
+    (void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    (void) setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if ((r = recv(fd, cmd, sizeof(cmd) - 1, 0)) > 0) {
+        cmd[r] = '\0';
+    }
+    len = format_stats(out, sizeof(out), strncmp(cmd, "json", 4) == 0);
+    while (off < len
+        && (r = send(fd, &out[off], len - off, MSG_NOSIGNAL)) > 0) {
+        off += r;
+    }
+}
+
+static size_t format_stats(char *out, size_t size, int json)
+{
+    static const char *const counter_names[] = { "games_started",
+        "games_resumed", "games_won", "games_lost", "parity_errors",
+        "games_expired", "rounds" };
+    static const char *const hist_names[] = { "latency_ns", "score_ns",
+        "queue_ns" };
+    static const char *const pct_names[] = { "p50", "p90", "p99", "p999",
+        "max" };
+    static const double pcts[] = { 50, 90, 99, 99.9, 100 };
+    static struct hist hists[COUNT_OF(hist_names)];
+    uint64_t counters[COUNT_OF(counter_names)] = { 0 };
+    size_t len = 0;
+
+    /* the workers keep playing, the sums are a consistent enough view */
+    (void) memset(hists, 0, sizeof(hists));
+    for (int i = 0; i < nworkers; ++i) {
+        const struct worker_stats *st = &workers[i].stats;
+        const uint64_t *c[] = { &st->games_started, &st->games_resumed,
+            &st->games_won, &st->games_lost, &st->parity_errors,
+            &st->games_expired, &st->rounds };
+
+        for (size_t j = 0; j < COUNT_OF(c); ++j) {
+            counters[j] += __atomic_load_n(c[j], __ATOMIC_RELAXED);
         }
+        hist_merge(&hists[0], &st->latency);
+        hist_merge(&hists[1], &st->score);
+        hist_merge(&hists[2], &st->queue);
     }
 
-    printf("Red: %d\n", red);
+    len += snprintf(out + len, size - len,
+        json ? "{\"workers\": %d" : "workers %d\n", nworkers);
+    for (size_t j = 0; j < COUNT_OF(counters); ++j) {
+        len += snprintf(out + len, size - len,
+            json ? ", \"%s\": %llu" : "%s %llu\n",
+            counter_names[j], (unsigned long long) counters[j]);
+    }
+    for (size_t h = 0; h < COUNT_OF(hists); ++h) {
+        len += snprintf(out + len, size - len,
+            json ? ", \"%s\": {\"count\": %llu" : "%s count %llu",
+            hist_names[h], (unsigned long long) hist_count(&hists[h]));
+        for (size_t p = 0; p < COUNT_OF(pcts); ++p) {
+            len += snprintf(out + len, size - len,
+                json ? ", \"%s\": %llu" : " %s %llu", pct_names[p],
+                (unsigned long long) hist_percentile(&hists[h], pcts[p]));
+        }
+        len += snprintf(out + len, size - len, json ? "}" : "\n");
+    }
+    if (json) {
+        len += snprintf(out + len, size - len, "}\n");
+    }
+    return len;
+}
 
-    /* build response buffer */
-    resp[0] = red;
-    resp[0] |= (white << SHIFT_WIDTH);
-    if (parity_recv != parity_calc) {
-        resp[0] |= (1 << PARITY_ERR_BIT);
-        return -1;
-    } else {
-        return red;
+static void *run_snapshots(void *arg)
+{
+    struct pollfd pfd = { .fd = wakefd, .events = POLLIN };
+    int r;
+
+    (void) arg;
+    while ((r = poll(&pfd, 1, snapshot_secs * 1000)) >= 0 || errno == EINTR) {
+        if (r > 0) {
+            break; /* shutting down, main() takes the last snapshot */
+        }
+        if (r == 0) {
+            take_snapshot(1);
+        }
+    }
+    return NULL;
+}
+
+static void take_snapshot(int fork_child)
+{
+    uint64_t start = tb_now(), forked;
+    pid_t pid;
+    int status;
+
+    if (!fork_child) {
+        if (snapshot_write(snapshot_path, token_key, generation,
+                snap_tables, list_tables()) < 0) {
+            LOG(LVL_ERROR, "Writing snapshot failed (errno %lld)", errno);
+        }
+        return;
+    }
+    /* the child gets a copy of the tables as they are now and writes it,
+       the workers only pay for the pages they write to meanwhile */
+    if ((pid = fork()) == 0) {
+        _exit(snapshot_write(snapshot_path, token_key, generation,
+            snap_tables, list_tables()) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    forked = tb_now();
+    if (pid < 0) {
+        LOG(LVL_WARN, "Snapshot: fork failed (errno %lld)", errno);
+        return;
+    }
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        LOG(LVL_WARN, "Writing snapshot failed");
+        return;
+    }
+    LOG(LVL_INFO, "Snapshot written in %lld us, fork took %lld us",
+        (tb_now() - start) / 1000, (forked - start) / 1000);
+}
+
+static uint32_t list_tables(void)
+{
+    uint32_t n = 0;
+
+    for (int i = 0; i < nworkers; ++i) {
+        snap_tables[n].id = workers[i].section;
+        snap_tables[n].count = workers[i].game_slab.used;
+        snap_tables[n++].tab = &workers[i].tab;
+    }
+    /* games that were not resumed yet survive the next restart as well */
+    for (uint32_t i = 0; i < restored.nsections; ++i) {
+        snap_tables[n].id = restored.ids[i];
+        snap_tables[n].count = restored.tabs[i].capacity;
+        snap_tables[n++].tab = &restored.tabs[i];
+    }
+    return n;
+}
+
+static void report_bench(double secs)
+{
+    uint64_t games_total = 0, rounds_total = 0, syscalls_total = 0;
+
+    for (int i = 0; i < nworkers; ++i) {
+        const struct worker *w = &workers[i];
+        (void) printf("worker %d: %llu games, %.0f games/s, %.0f rounds/s, "
+            "%.2f syscalls/round\n",
+            w->id, (unsigned long long) w->stats.games_started,
+            w->stats.games_started / secs, w->stats.rounds / secs,
+            w->stats.rounds > 0
+                ? (double) w->syscalls / w->stats.rounds : 0.0);
+        (void) printf("worker %d: %u games live, %u peak, %u buffers peak, "
+            "%.1f KiB in use at peak\n", w->id, w->game_slab.live,
+            w->game_slab.peak, w->buf_slab.peak,
+            (w->game_slab.peak * w->game_slab.stride
+                + w->buf_slab.peak * w->buf_slab.stride) / 1024.0);
+        if (w->replay != NULL) {
+            (void) printf("worker %d: replay log at segment %llu, "
+                "%llu stalls, %llu records dropped\n", w->id,
+                (unsigned long long) w->replay->cur.hdr->segment,
+                (unsigned long long) w->replay->stalls,
+                (unsigned long long) w->replay->dropped);
+        }
+        games_total += w->stats.games_started;
+        rounds_total += w->stats.rounds;
+        syscalls_total += w->syscalls;
     }
+    (void) printf("total: %llu games, %.0f games/s, %.0f rounds/s, "
+        "%.2f syscalls/round\n",
+        (unsigned long long) games_total,
+        games_total / secs, rounds_total / secs,
+        rounds_total > 0 ? (double) syscalls_total / rounds_total : 0.0);
 }
 
 static void bail_out(int exitcode, const char *fmt, ...)
@@ -170,19 +1661,118 @@ static void bail_out(int exitcode, const char *fmt, ...)
     }
     (void) fprintf(stderr, "\n");
 
+    stop_threads();
     free_resources();
     exit(exitcode);
 }
 
+static void stop_on_error(const struct worker *w, const char *what)
+{
+    (void) fprintf(stderr, "%s: worker %d: %s: %s\n", progname, w->id, what,
+        strerror(errno));
+    __atomic_store_n(&worker_failed, 1, __ATOMIC_SEQ_CST);
+    quit = 1;
+    /* signals are blocked in the workers: this wakes the main thread */
+    (void) kill(getpid(), SIGTERM);
+}
+
+static void stop_threads(void)
+{
+    uint64_t one = 1;
+
+    quit = 1;
+    if (wakefd >= 0 && write(wakefd, &one, sizeof(one)) < 0) {
+        (void) fprintf(stderr, "%s: waking workers: %s\n", progname,
+            strerror(errno));
+    }
+    for (int i = 0; i < nrunning; ++i) {
+        (void) pthread_join(workers[i].thread, NULL);
+    }
+    nrunning = 0;
+    if(stats_running) {
+        (void) pthread_join(stats_thread, NULL);
+        stats_running = 0;
+    }
+    if(snapshot_running) {
+        (void) pthread_join(snapshot_thread, NULL);
+        snapshot_running = 0;
+    }
+}
+
 static void free_resources(void)
 {
     /* clean up resources */
     DEBUG("Shutting down server\n");
-    if(connfd >= 0) {
-        (void) close(connfd);
+    log_stop();
+    for (int i = 0; i < nworkers; ++i) {
+        struct worker *w = &workers[i];
+        /* records past used were never handed out and read as zero */
+        for (uint32_t j = 0; j < w->game_slab.used; ++j) {
+            if (w->games[j].fd >= 0) {
+                if (w->games[j].shm) {
+                    shm_close(&w->bufs[j]->shm);
+                }
+                (void) close(w->games[j].fd);
+            }
+        }
+        free(w->bufs);
+        slab_destroy(&w->buf_slab);
+        slab_destroy(&w->game_slab);
+        gametab_destroy(&w->tab);
+        if (w->table != NULL) {
+            score_table_release(w->table);
+            w->table = NULL;
+        }
+        w->games = NULL;
+        if (w->replay != NULL) {
+            replay_close(w->replay);
+            free(w->replay);
+            w->replay = NULL;
+        }
+        free(w->deferred);
+        free(w->clocks);
+        free(w->expired);
+        free(w->shm_games);
+        tw_destroy(&w->timers);
+        if(w->epfd >= 0) {
+            (void) close(w->epfd);
+        }
+#ifdef HAVE_IO_URING
+        if (w->uring) {
+            uring_bufs_free(&w->ring, &w->recv_bufs);
+            uring_exit(&w->ring);
+            w->uring = 0;
+        }
+#endif
+        if(w->sockfd >= 0) {
+            (void) close(w->sockfd);
+        }
+    }
+    free(workers);
+    workers = NULL;
+    nworkers = 0;
+    secret_file_close(&secret_file);
+    snapshot_close(&restored);
+    free(snap_tables);
+    snap_tables = NULL;
+    if(statsfd >= 0) {
+        (void) close(statsfd);
+        statsfd = -1;
+    }
+    if(stats_path != NULL) {
+        (void) unlink(stats_path);
+        stats_path = NULL;
     }
-    if(sockfd >= 0) {
-        (void) close(sockfd);
+    if(shmfd >= 0) {
+        (void) close(shmfd);
+        shmfd = -1;
+    }
+    if(shm_path != NULL) {
+        (void) unlink(shm_path);
+        shm_path = NULL;
+    }
+    if(wakefd >= 0) {
+        (void) close(wakefd);
     }
 }
 
@@ -195,21 +1785,35 @@ static void signal_handler(int sig)
  * @brief Program entry point
  * @param argc The argument counter
  * @param argv The argument vector
- * @return EXIT_SUCCESS on success, EXIT_PARITY_ERROR in case of an parity
- * error, EXIT_GAME_LOST in case client needed to many guesses,
- * EXIT_MULTIPLE_ERRORS in case multiple errors occured in one round
+ * @return EXIT_SUCCESS after a signal terminated the server, EXIT_FAILURE
+ * in case of an error
  */
 int main(int argc, char *argv[])
 {
 
     struct opts options;
-    int round;
-    int ret;
+    struct timespec start, end;
+    sigset_t blocked, orig;
 
     parse_args(argc, argv, &options);
+    if (options.secret_file != NULL
+        && secret_file_open(&secret_file, options.secret_file) < 0) {
+        bail_out(EXIT_FAILURE, "reading %s", options.secret_file);
+    }
+
+    /* every worker gets an equal share of the global rate, with a burst of
+       10ms worth of rounds so that short stalls do not lower the rate */
+    double share = options.total_rate / options.workers;
+    tb_init(&game_rate, options.game_rate, 1);
+    tb_init(&worker_rate, share, share / 100);
+    pacing = options.game_rate > 0 || options.total_rate > 0;
+    idle_ms = options.idle_secs * 1000;
+    round_ms = options.round_secs * 1000;
+    game_ms = options.game_secs * 1000;
+    timeouts = idle_ms > 0 || round_ms > 0 || game_ms > 0;
 
     /* setup signal handlers */
-    const int signals[] = {SIGINT, SIGTERM};
+    const int signals[] = {SIGINT, SIGTERM, SIGALRM};
     struct sigaction s;
 
     s.sa_handler = signal_handler;
@@ -223,103 +1827,142 @@ int main(int argc, char *argv[])
         }
     }
 
-    if((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        bail_out(EXIT_FAILURE, "creating socket");
-    }
-    int optval = 1;
-    if(setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0) {
-        bail_out(EXIT_FAILURE, "set socket option");
+    /* signals are only handled by the main thread, workers inherit the mask */
+    (void) sigemptyset(&blocked);
+    for(int i = 0; i < COUNT_OF(signals); i++) {
+        (void) sigaddset(&blocked, signals[i]);
     }
-
-    struct sockaddr_in serv_addr;
-
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(options.portno);
-    serv_addr.sin_addr.s_addr = INADDR_ANY;
-
-    if(bind(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-        bail_out(EXIT_FAILURE, "binding socket");
+    if(pthread_sigmask(SIG_BLOCK, &blocked, &orig) != 0) {
+        bail_out(EXIT_FAILURE, "pthread_sigmask");
     }
 
-    if(listen(sockfd, BACKLOG) == -1) {
-        bail_out(EXIT_FAILURE, "listen socket");
+    if(log_start(options.log_level) < 0) {
+        bail_out(EXIT_FAILURE, "starting logger");
     }
-
-    struct sockaddr_in cli_addr;
-    socklen_t cli_size;
-    if((connfd = accept(sockfd, (struct sockaddr *)&cli_addr, &cli_size)) < 0) {
-        bail_out(EXIT_FAILURE, "accepting client");
+    if (options.secret_file != NULL) {
+        LOG(LVL_INFO, "%lld secrets from file", secret_file.count);
+    } else if (!options.fixed_secret) {
+        LOG(LVL_INFO, "Random secrets, seed %lld", options.seed);
     }
+    /* games of the last run wait in the snapshot until their clients come
+       back, and their tokens stay valid as the key is kept */
+    if (options.snapshot_path != NULL) {
+        uint64_t restore_start = tb_now();
 
-    /* accepted the connection */
-    ret = EXIT_SUCCESS;
-    for (round = 1; round <= MAX_TRIES && !quit; ++round) {
-        uint16_t request;
-        static uint8_t buffer[BUFFER_BYTES];
-        int correct_guesses;
-        int error = 0;
-
-        sleep(1);
+        snapshot_path = options.snapshot_path;
+        snapshot_secs = options.snapshot_secs;
+        if (snapshot_open(&restored, snapshot_path) == 0) {
+            generation = restored.generation + 1;
+            token_key = restored.key;
+            LOG(LVL_INFO, "Restored %lld games in %lld sections in %lld us",
+                restored.games, restored.nsections,
+                (tb_now() - restore_start) / 1000);
+        } else if (errno != ENOENT) {
+            bail_out(EXIT_FAILURE, "reading snapshot %s", snapshot_path);
+        } else {
+            int fd = open("/dev/urandom", O_RDONLY);
 
-        /* read from client */
-        if (read_from_client(connfd, &buffer[0], READ_BYTES) == NULL) {
-            if (quit) break; /* caught signal */
-            bail_out(EXIT_FAILURE, "read_from_client");
+            if (fd < 0 || read(fd, &token_key, sizeof(token_key))
+                    != sizeof(token_key)) {
+                bail_out(EXIT_FAILURE, "drawing the token key");
+            }
+            (void) close(fd);
         }
-
-        fprintf(stdout, "Runde %d: ", round);
-
-        request = (buffer[1] << 8) | buffer[0];
-        //fprintf(stderr, "%d", request);
-        DEBUG("Round %d: Received 0x%x\n", round, request);
-
-        /* compute answer */
-        correct_guesses = compute_answer(request, &buffer[0], options.secret);
-        if (round == MAX_TRIES && correct_guesses != SLOTS) {
-            buffer[0] |= 1 << GAME_LOST_ERR_BIT;
+        if ((snap_tables = calloc(options.workers + restored.nsections,
+                sizeof(*snap_tables))) == NULL) {
+            bail_out(EXIT_FAILURE, "allocating snapshot tables");
         }
-
-        DEBUG("Sending byte 0x%x\n", buffer[0]);
-
-        /* send message to client */
-        if (send_to_client(connfd, &buffer[0], WRITE_BYTES) == NULL) {
-            if (quit) break; /* caught signal */
-            bail_out(EXIT_FAILURE, "send_to_client");
+    }
+#ifndef HAVE_IO_URING
+    if(options.uring) {
+        LOG(LVL_WARN, "Built without io_uring, using epoll");
+        options.uring = 0;
+    }
+#endif
+    if((wakefd = eventfd(0, 0)) < 0) {
+        bail_out(EXIT_FAILURE, "creating eventfd");
+    }
+    /* before the workers, which all watch it */
+    if(options.shm_path != NULL) {
+        setup_shm(options.shm_path);
+        busy_poll = options.busy_poll;
+    }
+    if((workers = calloc(options.workers, sizeof(*workers))) == NULL) {
+        bail_out(EXIT_FAILURE, "allocating workers");
+    }
+    for(int i = 0; i < options.workers; ++i) {
+        workers[i].id = i;
+        workers[i].section = (generation << 8) | i;
+        workers[i].sockfd = workers[i].epfd = -1;
+        nworkers++;
+        setup_worker(&workers[i], &options);
+        /* every worker walks its own share of the file */
+        if (options.secret_file != NULL) {
+            secret_gen_list(&workers[i].secrets, &secret_file, i,
+                options.workers);
+        } else if (options.fixed_secret) {
+            secret_gen_fixed(&workers[i].secrets, score_pack(options.secret));
+        } else {
+            secret_gen_random(&workers[i].secrets, options.seed, i);
         }
+        /* other geometries always get random secrets, from streams of
+           their own */
+        secret_gen_random(&workers[i].geo_secrets, options.seed,
+            options.workers + i);
+    }
 
-        /* We sent the answer to the client; now stop the game
-           if its over, or an error occured */
-        if (*buffer & (1<<PARITY_ERR_BIT)) {
-            (void) fprintf(stderr, "Parity error\n");
-            error = 1;
-            ret = EXIT_PARITY_ERROR;
+    (void) clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i = 0; i < nworkers; ++i) {
+        errno = pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]);
+        if(errno != 0) {
+            bail_out(EXIT_FAILURE, "creating worker thread");
         }
-        if (*buffer & (1 << GAME_LOST_ERR_BIT)) {
-            (void) fprintf(stderr, "Game lost\n");
-            error = 1;
-            if (ret == EXIT_PARITY_ERROR) {
-                ret = EXIT_MULTIPLE_ERRORS;
-            } else {
-                ret = EXIT_GAME_LOST;
-            }
+        nrunning++;
+    }
+    if(options.stats_path != NULL) {
+        setup_stats(options.stats_path);
+        if((errno = pthread_create(&stats_thread, NULL, run_stats, NULL)) != 0) {
+            bail_out(EXIT_FAILURE, "creating stats thread");
         }
-        if (error) {
-            break;
-        } else if (correct_guesses == SLOTS) {
-            /* won */
-            (void) printf("Runden: %d\n", round);
-            break;
+        stats_running = 1;
+    }
+    if(snapshot_path != NULL) {
+        if((errno = pthread_create(&snapshot_thread, NULL, run_snapshots,
+                NULL)) != 0) {
+            bail_out(EXIT_FAILURE, "creating snapshot thread");
         }
+        snapshot_running = 1;
+    }
+
+    /* wait for a signal, then wake up and collect the workers */
+    if(options.bench_secs > 0) {
+        (void) alarm(options.bench_secs);
+    }
+    while (!quit) {
+        (void) sigsuspend(&orig);
+    }
+    /* nothing is freed before every thread returned */
+    stop_threads();
+    /* with the workers stopped there is no need to fork */
+    if(snapshot_path != NULL) {
+        take_snapshot(0);
+    }
+    (void) clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if(options.bench_secs > 0) {
+        report_bench((end.tv_sec - start.tv_sec)
+            + (end.tv_nsec - start.tv_nsec) / 1e9);
     }
 
     /* we are done */
     free_resources();
-    return ret;
+    return worker_failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 static void parse_args(int argc, char **argv, struct opts *options)
 {
     int i;
+    int c;
     char *port_arg;
     char *secret_arg;
     char *endptr;
@@ -328,12 +1971,108 @@ static void parse_args(int argc, char **argv, struct opts *options)
     if(argc > 0) {
         progname = argv[0];
     }
-    if (argc != 3) {
+    options->workers = 1;
+    options->max_games = DEFAULT_GAMES;
+    options->bench_secs = 0;
+    options->game_rate = options->total_rate = 0;
+    options->log_level = LVL_WARN;
+    options->uring = 0;
+    options->secret_file = NULL;
+    options->stats_path = NULL;
+    options->replay_dir = NULL;
+    options->snapshot_path = NULL;
+    options->snapshot_secs = DEFAULT_SNAPSHOT_SECS;
+    options->idle_secs = DEFAULT_IDLE_SECS;
+    options->round_secs = options->game_secs = 0;
+    options->shm_path = NULL;
+    options->busy_poll = 0;
+    options->seed = ((uint64_t) time(NULL) << 20) ^ getpid();
+    while ((c = getopt(argc, argv, "j:c:b:r:R:f:x:S:l:k:i:t:T:G:U:Buv")) != -1) {
+        switch (c) {
+        case 'S':
+            options->stats_path = optarg;
+            break;
+        case 'l':
+            options->replay_dir = optarg;
+            break;
+        case 'k':
+            options->snapshot_path = optarg;
+            break;
+        case 'i':
+            options->snapshot_secs = parse_number(optarg, "-i", 1,
+                INT_MAX / 1000, bail_out);
+            break;
+        case 't':
+            options->idle_secs = parse_number(optarg, "-t", 0,
+                INT_MAX / 1000, bail_out);
+            break;
+        case 'T':
+            options->round_secs = parse_number(optarg, "-T", 0,
+                INT_MAX / 1000, bail_out);
+            break;
+        case 'G':
+            options->game_secs = parse_number(optarg, "-G", 0,
+                INT_MAX / 1000, bail_out);
+            break;
+        case 'f':
+            options->secret_file = optarg;
+            break;
+        case 'x':
+            options->seed = parse_number(optarg, "-x", 0, LONG_MAX, bail_out);
+            break;
+        case 'u':
+            options->uring = 1;
+            break;
+        case 'U':
+            options->shm_path = optarg;
+            break;
+        case 'B':
+            options->busy_poll = 1;
+            break;
+        case 'j':
+            options->workers = parse_number(optarg, "-j", 1,
+                MAX_WORKERS, bail_out);
+            break;
+        case 'c':
+            options->max_games = parse_number(optarg, "-c", 1,
+                INT_MAX / 2, bail_out);
+            break;
+        case 'b':
+            options->bench_secs = parse_number(optarg, "-b", 1,
+                INT_MAX, bail_out);
+            break;
+        case 'r':
+            options->game_rate = parse_number(optarg, "-r", 1,
+                INT_MAX, bail_out);
+            break;
+        case 'R':
+            options->total_rate = parse_number(optarg, "-R", 1,
+                INT_MAX, bail_out);
+            break;
+        case 'v':
+            if (options->log_level < LVL_DEBUG) {
+                options->log_level++;
+            }
+            break;
+        default:
+            goto usage;
+        }
+    }
+    options->fixed_secret = argc - optind == 2;
+    if (argc - optind != 1 + options->fixed_secret
+        || (options->fixed_secret && options->secret_file != NULL)
+        || (options->shm_path != NULL && options->uring)
+        || (options->busy_poll && options->shm_path == NULL)) {
+usage:
         bail_out(EXIT_FAILURE,
-            "Usage: %s <server-port> <secret-sequence>", progname);
+            "Usage: %s [-uv] [-U shm-socket [-B]] [-j workers] [-c games] "
+            "[-b seconds] [-r rounds/s] [-R rounds/s] [-f secret-file] [-x seed] "
+            "[-S stats-socket] [-l replay-dir] [-k snapshot-file] "
+            "[-i seconds] [-t seconds] [-T seconds] [-G seconds] "
+            "<server-port> [secret-sequence]",
+            progname);
     }
-    port_arg = argv[1];
-    secret_arg = argv[2];
+    port_arg = argv[optind];
 
     errno = 0;
     options->portno = strtol(port_arg, &endptr, 10);
@@ -361,6 +2100,10 @@ static void parse_args(int argc, char **argv, struct opts *options)
         bail_out(EXIT_FAILURE, "Use a valid TCP/IP port range (1-65535)");
     }
 
+    if (!options->fixed_secret) {
+        return;
+    }
+    secret_arg = argv[optind + 1];
     if (strlen(secret_arg) != SLOTS) {
         bail_out(EXIT_FAILURE,
             "<secret-sequence> has to be %d chars long", SLOTS);
@@ -9,30 +9,166 @@
 
 /* === Constants === */
 
-#define MAX_TRIES (35)
-#define SLOTS (5)
-#define COLORS (8)
-
 #define READ_BYTES (2)
 #define WRITE_BYTES (1)
 #define BUFFER_BYTES (2)
-#define SHIFT_WIDTH (3)
-#define PARITY_ERR_BIT (6)
-#define GAME_LOST_ERR_BIT (7)
 
 #define EXIT_PARITY_ERROR (2)
 #define EXIT_GAME_LOST (3)
 #define EXIT_MULTIPLE_ERRORS (4)
 
-#define BACKLOG (5)
+#define BACKLOG (SOMAXCONN)
+#define MAX_EVENTS (256)
+#define MAX_WORKERS (256)
+#define DEFAULT_GAMES (16384)
+#define CACHE_LINE (64)
+#define CONN_BUF_BYTES (4096)
+
+#define DEFAULT_SNAPSHOT_SECS (1)
+#define DEFAULT_IDLE_SECS (60)
+#define EXPIRE_BATCH (1024)     /* games closed per pass over the timers */
+
+#define URING_ENTRIES (4096)
+#define URING_BUFS (1024)       /* provided receive buffers per worker */
+#define URING_BUF_BYTES (1024)
+#define URING_OP_BITS (8)       /* user_data: game index << 8 | operation */
+#define URING_ACCEPT (0)
+#define URING_WAKE (1)
+#define URING_RECV (2)
+#define URING_SEND (3)
 
  /* === Type Definitions === */
 
 struct opts {
     long int portno;
     uint8_t secret[SLOTS];
+    int fixed_secret;     /* secret is used for all games */
+    const char *secret_file; /* else draw secrets from this file */
+    uint64_t seed;        /* or from random streams seeded with this */
+    long int workers;     /* number of worker threads */
+    long int max_games;   /* concurrent games per worker */
+    long int bench_secs;  /* run for this long and report throughput */
+    double game_rate;     /* rounds/s per game, 0 for unlimited */
+    double total_rate;    /* rounds/s of the whole server, 0 for unlimited */
+    int log_level;        /* see logger.h */
+    int uring;            /* use io_uring instead of epoll if possible */
+    const char *stats_path; /* serve statistics on this Unix socket */
+    const char *replay_dir; /* log every round to segments in here */
+    const char *snapshot_path; /* keep games in this snapshot file */
+    long int snapshot_secs; /* seconds between two snapshots */
+    long int idle_secs;   /* timeouts, 0 for none: nothing received */
+    long int round_secs;  /* no round played */
+    long int game_secs;   /* since the game started */
+    const char *shm_path; /* serve shared-memory clients on this socket */
+    int busy_poll;        /* poll shared-memory games instead of sleeping */
+};
+
+/* I/O state of one connection, which plays one game or, if it is
+   multiplexed, several (see game.h). Kept at 32 bytes so that two records
+   share a cache line. The state of its lock-step game is in the worker's
+   gametab at the same index. */
+struct game {
+    uint64_t tat;       /* token bucket of the game, see tbucket.h */
+    const uint8_t *table; /* scores of the game's secret, see score.h */
+    int fd;             /* -1 if the record is free */
+    uint8_t deferred;   /* set while a complete request waits for a token */
+    uint8_t mux;        /* set if the connection is multiplexed */
+    uint8_t geo;        /* 1 + id of the game's geometry, 0 for 5x8 */
+    uint8_t inflight;   /* io_uring: operations not completed yet */
+    uint8_t recving;    /* io_uring: a multishot recv is armed */
+    uint8_t sending;    /* io_uring: a send is in flight */
+    uint8_t closing;    /* io_uring: closed once inflight drops to 0 */
+    uint8_t tx_len;     /* io_uring: bytes of tx being sent */
+    uint8_t tx[3];      /* io_uring: short response sent from the record */
+    uint8_t shm;        /* set if the client plays over shared memory */
+};
+
+/* Requests received but not played yet and responses not sent yet.
+   Connections that have nothing left over between two events use the
+   worker's scratch buffer, the others get their own. Requests are read
+   and answered in batches of up to CONN_BUF_BYTES. */
+struct conn_buf {
+    uint8_t in[CONN_BUF_BYTES];
+    uint32_t in_len;
+    uint32_t in_off;        /* first byte that is not played yet */
+    uint8_t out[CONN_BUF_BYTES];
+    uint32_t out_len;
+    uint32_t out_off;       /* first byte that is not sent yet */
+    uint8_t paid;           /* set if the next request got its tokens */
+    uint64_t recv_at;       /* when the first unplayed request arrived */
+    uint8_t rounds[MUX_MAX_GAMES];  /* multiplexed: 0 for unused ids */
+    uint16_t secrets[MUX_MAX_GAMES];
+    uint32_t geo_secret;    /* of a game with another geometry */
+    /* shared-memory games keep their buffer for the whole game */
+    struct shm_chan shm;    /* the channel */
+    uint32_t shm_pos;       /* index in the worker's shm_games */
+    uint8_t shm_hup;        /* set once the client hung up */
+};
+
+/* When a game started, last played a round and last received anything,
+   in milliseconds of the worker's tick; the timeouts count from these */
+struct game_clock {
+    uint32_t started;
+    uint32_t played;
+    uint32_t seen;
 };
 
+/* Counters and histograms (in ns) of a worker. Only the worker writes
+   them, the stats thread reads them without locks, see hist.h */
+struct worker_stats {
+    uint64_t games_started;
+    uint64_t games_resumed; /* taken over from a snapshot */
+    uint64_t games_won;
+    uint64_t games_lost;
+    uint64_t parity_errors;
+    uint64_t games_expired; /* closed by a timeout */
+    uint64_t rounds;
+    struct hist latency;    /* request received until its response is ready */
+    struct hist score;      /* playing a round */
+    struct hist queue;      /* request received until it is played */
+};
+
+/* A worker owns a listening socket, an epoll instance or io_uring and a
+   table of games; workers share nothing but the read-only configuration */
+struct worker {
+    int id;
+    int sockfd;
+    int epfd;
+    int use_uring;          /* try io_uring first */
+    int uring;              /* ring and recv_bufs are in use */
+#ifdef HAVE_IO_URING
+    struct uring ring;
+    struct uring_bufs recv_bufs;
+#endif
+    pthread_t thread;
+    struct slab game_slab;  /* game records, indexed like games */
+    struct slab buf_slab;   /* connection buffers of the games out of step */
+    struct game *games;     /* == game_slab.mem */
+    struct gametab tab;     /* secret, round and flags of games, same index */
+    uint32_t conns;         /* connections accepted, numbers them */
+    uint32_t section;       /* id of tab in snapshots */
+    struct replay_log *replay; /* NULL unless rounds are logged */
+    struct secret_gen secrets; /* secrets of new games */
+    struct secret_gen geo_secrets; /* of games with another geometry */
+    const uint8_t *table;   /* scores of the fixed secret, NULL if none;
+                               its games borrow it */
+    struct conn_buf **bufs; /* per game, NULL while it uses scratch */
+    struct conn_buf scratch;
+    uint32_t max_games;
+    struct timewheel timers; /* one per game while timeouts are on */
+    struct game_clock *clocks; /* per game, same index */
+    uint32_t *expired;      /* EXPIRE_BATCH games taken from timers */
+    uint32_t tick;          /* milliseconds, read after every wait */
+    uint32_t *shm_games;    /* games played over shared memory (-U) */
+    uint32_t nshm;
+    uint32_t *deferred;     /* ring of games waiting for a token */
+    uint32_t deferred_head;
+    uint32_t ndeferred;
+    uint64_t tat;           /* this worker's share of the global bucket */
+    uint64_t syscalls;      /* epoll_wait, recv and send calls */
+    struct worker_stats stats;
+} __attribute__((aligned(CACHE_LINE)));
+
 /* === Prototypes === */
 
 /**
@@ -44,37 +180,339 @@ struct opts {
 static void parse_args(int argc, char **argv, struct opts *options);
 
 /**
- * @brief Read message from socket
- *
- * This code *illustrates* one way to deal with partial reads
- *
- * @param sockfd_con Socket to read from
- * @param buffer Buffer where read data is stored
- * @param n Size to read
- * @return Pointer to buffer on success, else NULL
+ * @brief Create the listening socket, epoll instance and game table of a
+ * worker
+ * @param w The worker to set up
+ * @param options The parsed command line options
+ */
+static void setup_worker(struct worker *w, const struct opts *options);
+
+/**
+ * @brief Create the epoll instance of a worker
+ * @param w The worker
+ * @return 0 on success, -1 with errno set on error
+ */
+static int setup_epoll(struct worker *w);
+
+/**
+ * @brief Event loop of a worker thread
+ * @param arg The worker
+ * @return NULL
+ */
+static void *run_worker(void *arg);
+
+/**
+ * @brief Play the rounds of deferred games whose tokens became available
+ * @param w The worker owning the games
+ * @return Milliseconds until the next deferred game can play, -1 if none
+ */
+static int run_deferred(struct worker *w);
+
+/**
+ * @brief Close the games whose timeout passed, in batches of EXPIRE_BATCH
+ * @param w The worker owning the games
+ * @return Milliseconds until the next timer may expire, -1 if none is armed
+ */
+static int run_timers(struct worker *w);
+
+/**
+ * @brief Get the earliest deadline of a game
+ * @param w The worker owning the game
+ * @param idx Index of the game
+ * @return The tick at which the game times out
+ */
+static uint32_t game_deadline(const struct worker *w, uint32_t idx);
+
+/**
+ * @brief Take the tokens a game needs to play a round
+ * @param w The worker owning the game
+ * @param game The game with a complete request
+ * @param now Current time, see tb_now()
+ * @return 0 if the round may be played, else the nanoseconds to wait
+ */
+static uint64_t take_tokens(struct worker *w, struct game *game, uint64_t now);
+
+/**
+ * @brief Take a free game record for a new connection
+ * @param w The worker that accepted the connection
+ * @param fd The connection, closed if there is no free record
+ * @return The game or NULL
+ */
+static struct game *start_game(struct worker *w, int fd);
+
+/**
+ * @brief Accept all pending connections on the listening socket
+ * @param w The worker owning the listening socket
+ */
+static void accept_games(struct worker *w);
+
+/**
+ * @brief Accept all pending clients on the shared-memory socket and send
+ * each its channel
+ * @param w The worker that got the event
+ */
+static void accept_shm(struct worker *w);
+
+/**
+ * @brief Serve the shared-memory games that have requests or responses
+ * pending, instead of waiting for their wakeups (-B)
+ * @param w The worker owning the games
+ * @return Number of games served
+ */
+static uint32_t poll_shm(struct worker *w);
+
+/**
+ * @brief Send bytes to a connection's client, over its socket or its
+ * channel
+ * @param w The worker owning the connection
+ * @param game The connection's game record
+ * @param data The bytes
+ * @param len Number of bytes
+ * @return Bytes sent, -1 with errno set, EAGAIN if nothing fits now
+ */
+static ssize_t conn_send(struct worker *w, struct game *game,
+    const void *data, size_t len);
+
+/**
+ * @brief Receive bytes from a connection's client, over its socket or its
+ * channel
+ * @param w The worker owning the connection
+ * @param game The connection's game record
+ * @param data Receives the bytes
+ * @param len Room in data
+ * @return Bytes received, 0 if the client hung up, -1 with errno set,
+ * EAGAIN if there are none now
+ */
+static ssize_t conn_recv(struct worker *w, struct game *game, void *data,
+    size_t len);
+
+/**
+ * @brief Handle readiness events of a connection
+ * @param w The worker owning the game
+ * @param game The game that belongs to the connection
+ * @param events The events reported by epoll
+ */
+static void handle_game(struct worker *w, struct game *game, uint32_t events);
+
+/**
+ * @brief Play the complete requests in a connection's buffer
+ * @param w The worker owning the connection
+ * @param game The connection's game record
+ * @param buf The buffer of the connection
+ * @return Number of requests played, -1 if a request is invalid
+ */
+static int play_requests(struct worker *w, struct game *game,
+    struct conn_buf *buf);
+
+/**
+ * @brief Answer TOKEN_HELLO with the token of a game
+ * @param w The worker owning the connection
+ * @param game The connection's game record
+ * @param buf The buffer of the connection
+ * @return 1 if it was answered, 0 if there is no room for the answer
+ */
+static int send_token(struct worker *w, struct game *game,
+    struct conn_buf *buf);
+
+/**
+ * @brief Answer GEO_HELLO: switch the game to the geometry whose id follows
+ * @param w The worker owning the connection
+ * @param game The connection's game record, it has not played yet
+ * @param buf The buffer of the connection
+ * @return 1 if it was answered, 0 if the id is not there yet, -1 if there
+ * is no memory for the game's buffer
+ */
+static int start_geometry(struct worker *w, struct game *game,
+    struct conn_buf *buf);
+
+/**
+ * @brief Answer RESUME_HELLO: take the game of the token that follows out
+ * of the restored snapshot and continue it on this connection
+ * @param w The worker owning the connection
+ * @param game The connection's game record, it has not played yet
+ * @param buf The buffer of the connection
+ * @return 1 if it was answered, 0 if the token is not complete yet
+ */
+static int resume_game(struct worker *w, struct game *game,
+    struct conn_buf *buf);
+
+/**
+ * @brief Give a connection its own buffer if it has to keep anything
+ * @param w The worker owning the connection
+ * @param game The connection's game record
+ * @param buf The buffer the connection used
+ * @return The buffer to use from now on, NULL if there is no memory
  */
-static uint8_t *read_from_client(int sockfd_con, uint8_t *buffer, size_t n);
+static struct conn_buf *keep_buf(struct worker *w, struct game *game,
+    struct conn_buf *buf);
 
+#ifdef HAVE_IO_URING
 /**
- * @brief Send message via socket
- *
- * This code *illustrates* one way to deal with partial reads
- *
- * @param sockfd_con Socket to send with
- * @param buffer Buffer with data to write
- * @param n Size to write
- * @return Pointer to buffer on success, else NULL
+ * @brief Create the io_uring of a worker, has to run on the worker thread
+ * @param w The worker
+ * @return 0 on success, -1 with errno set if io_uring is not available
  */
-static uint8_t *send_to_client(int sockfd_con, uint8_t *buffer, size_t n);
+static int setup_uring(struct worker *w);
 
 /**
- * @brief Compute answer to request
- * @param req Client's guess
- * @param resp Buffer that will be sent to the client
- * @param secret The server's secret
- * @return Number of correct matches on success; -1 in case of a parity error
+ * @brief Completion loop of a worker thread using io_uring
+ * @param w The worker
  */
-static int compute_answer(uint16_t req, uint8_t *resp, uint8_t *secret);
+static void run_uring(struct worker *w);
+
+/**
+ * @brief Handle a completion of the multishot accept
+ * @param w The worker
+ * @param res The accepted socket or a negative error
+ * @param flags Flags of the completion
+ */
+static void uring_accepted(struct worker *w, int res, uint32_t flags);
+
+/**
+ * @brief Arm a multishot recv on a connection
+ * @param w The worker owning the connection
+ * @param game The connection's game record
+ * @return 0 on success, -1 if the submission queue is full
+ */
+static int uring_recv(struct worker *w, struct game *game);
+
+/**
+ * @brief Handle a completion of a connection's multishot recv
+ * @param w The worker owning the connection
+ * @param game The connection's game record
+ * @param res Bytes received or a negative error
+ * @param flags Flags of the completion, with the provided buffer's id
+ */
+static void uring_received(struct worker *w, struct game *game, int res,
+    uint32_t flags);
+
+/**
+ * @brief Queue a send on a connection
+ * @param w The worker owning the connection
+ * @param game The connection's game record
+ * @param data The bytes to send, unchanged until the send completes
+ * @param len Number of bytes
+ * @return 0 on success, -1 if the submission queue is full
+ */
+static int uring_send(struct worker *w, struct game *game,
+    const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Handle a completion of a connection's send
+ * @param w The worker owning the connection
+ * @param game The connection's game record
+ * @param res Bytes sent or a negative error
+ */
+static void uring_sent(struct worker *w, struct game *game, int res);
+
+/**
+ * @brief Play the buffered requests of a connection and queue the send
+ * @param w The worker owning the connection
+ * @param game The connection's game record
+ * @param buf The buffer of the connection
+ */
+static void serve_uring(struct worker *w, struct game *game,
+    struct conn_buf *buf);
+
+/**
+ * @brief Close a connection once none of its operations is in flight
+ * @param w The worker owning the connection
+ * @param game The connection's game record
+ */
+static void close_uring(struct worker *w, struct game *game);
+#endif
+
+/**
+ * @brief Get the size of a connection's requests
+ * @param game The connection's game record
+ * @return Bytes per request frame
+ */
+static size_t request_bytes(const struct game *game);
+
+/**
+ * @brief Check whether the connection is closed after its pending responses
+ * @param w The worker owning the game
+ * @param game The game
+ * @return Nonzero if the game is won or lost
+ */
+static int game_is_over(const struct worker *w, const struct game *game);
+
+/**
+ * @brief Close the connection of a game and free its state
+ * @param w The worker owning the game
+ * @param game The game to end
+ */
+static void end_game(struct worker *w, struct game *game);
+
+/**
+ * @brief Add to a counter of the calling worker's stats
+ * @param counter The counter
+ * @param n The amount, may be negative
+ */
+static void stat_add(uint64_t *counter, int64_t n);
+
+/**
+ * @brief Create the listening stats socket, replacing a stale one
+ * @param path Path of the Unix socket
+ */
+static void setup_stats(const char *path);
+
+/**
+ * @brief Create the listening shared-memory socket, replacing a stale one
+ * @param path Path of the Unix socket
+ */
+static void setup_shm(const char *path);
+
+/**
+ * @brief Thread function: answer stats requests until shutdown
+ * @param arg Unused
+ * @return NULL
+ */
+static void *run_stats(void *arg);
+
+/**
+ * @brief Send a snapshot of the stats to a client, as JSON if its first
+ * line says "json", else as text
+ * @param fd The client's socket
+ */
+static void serve_stats(int fd);
+
+/**
+ * @brief Sum up the stats of all workers
+ * @param out Receives the text
+ * @param size Size of out
+ * @param json Nonzero for JSON, else one line per value
+ * @return Length of the text
+ */
+static size_t format_stats(char *out, size_t size, int json);
+
+/**
+ * @brief Thread function: take a snapshot every snapshot_secs until
+ * shutdown
+ * @param arg Unused
+ * @return NULL
+ */
+static void *run_snapshots(void *arg);
+
+/**
+ * @brief Write the games of all workers and the ones of the restored
+ * snapshot that were not resumed to the snapshot file
+ * @param fork_child Nonzero to write from a forked child while the
+ * workers go on, else the workers have to be stopped
+ */
+static void take_snapshot(int fork_child);
+
+/**
+ * @brief List the tables a snapshot consists of, async-signal-safe
+ * @return Number of tables in snap_tables
+ */
+static uint32_t list_tables(void);
+
+/**
+ * @brief Print the throughput of every worker
+ * @param secs Wall clock seconds the workers were running
+ */
+static void report_bench(double secs);
 
 /**
  * @brief terminate program on program error
@@ -83,6 +521,19 @@ static int compute_answer(uint16_t req, uint8_t *resp, uint8_t *secret);
  */
 static void bail_out(int exitcode, const char *fmt, ...);
 
+/**
+ * @brief Report the error that stops a worker thread and have the main
+ * thread shut the server down; the worker returns afterwards
+ * @param w The worker
+ * @param what What failed
+ */
+static void stop_on_error(const struct worker *w, const char *what);
+
+/**
+ * @brief Wake all threads that were started and wait for them to return
+ */
+static void stop_threads(void);
+
 /**
  * @brief Signal handler
  * @param sig Signal number catched
@@ -0,0 +1,396 @@
+/*
+ * @brief shared-memory transport for clients on the same host
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+#include "shm.h"
+
+/* === Macros === */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __asm__ __volatile__("pause" ::: "memory")
+#else
+#define CPU_RELAX() __asm__ __volatile__("" ::: "memory")
+#endif
+
+/* === Implementations === */
+
+/**
+ * @brief Wake the peer through its eventfd
+ * @param fd The peer's eventfd
+ */
+static void wake(int fd)
+{
+    uint64_t one = 1;
+
+    (void) write(fd, &one, sizeof(one));
+}
+
+/**
+ * @brief Get the number of bytes a side may read
+ * @param r The ring it reads from
+ * @return Bytes between tail and head
+ */
+static uint32_t ring_used(const struct shm_ring *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - r->tail;
+}
+
+/**
+ * @brief Get the number of bytes a side may write
+ * @param r The ring it writes to
+ * @return Free bytes between head and tail
+ */
+static uint32_t ring_room(const struct shm_ring *r)
+{
+    return SHM_RING_BYTES
+        - (r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * @brief Set a waits flag, unless what it waits for is there already
+ * @param flag The flag
+ * @param ready Checks the condition again after the flag is set
+ * @param r The ring ready looks at
+ * @return 0 if the flag stays set, 1 if the condition holds
+ */
+static int want(uint32_t *flag, uint32_t (*ready)(const struct shm_ring *),
+    const struct shm_ring *r)
+{
+    /* pairs with the barrier between moving head or tail and looking at
+       the flag: either the peer sees the flag, or this side sees the move */
+    __atomic_store_n(flag, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (ready(r) == 0) {
+        return 0;
+    }
+    /* if the peer took the flag meanwhile, its wakeup is merely spurious */
+    (void) __atomic_exchange_n(flag, 0, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+/**
+ * @brief Wake the peer if it set a waits flag
+ * @param flag The flag
+ * @param fd The peer's eventfd
+ */
+static void notify(uint32_t *flag, int fd)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(flag, __ATOMIC_RELAXED)
+        && __atomic_exchange_n(flag, 0, __ATOMIC_SEQ_CST)) {
+        wake(fd);
+    }
+}
+
+/**
+ * @brief Wait until a side may read or write, polling first
+ * @param c The channel
+ * @param for_write Nonzero to wait for room, else for bytes
+ * @return 0 once it may, -1 if the peer hung up or on error
+ */
+static int wait_peer(struct shm_chan *c, int for_write)
+{
+    struct pollfd pfd[2];
+    uint64_t count;
+
+    for (uint32_t i = 0; i < c->spin; ++i) {
+        if (for_write ? ring_room(c->tx) > 0 : ring_used(c->rx) > 0) {
+            return 0;
+        }
+        CPU_RELAX();
+        if ((i + 1) % SHM_YIELD_SPINS == 0) {
+            /* let the server run if it shares the core, and look for a
+               hangup now and then */
+            pfd[0].fd = c->sock;
+            pfd[0].events = 0;
+            if (poll(pfd, 1, 0) > 0) {
+                break;
+            }
+            (void) sched_yield();
+        }
+    }
+    if (for_write ? shm_want_write(c) : shm_want_read(c)) {
+        return 0;
+    }
+    pfd[0].fd = c->wake_fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = c->sock;
+    pfd[1].events = 0;
+    while (poll(pfd, 2, -1) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    if (pfd[0].revents & POLLIN) {
+        (void) read(c->wake_fd, &count, sizeof(count));
+    }
+    if ((pfd[1].revents & (POLLHUP | POLLERR))
+        && (for_write ? ring_room(c->tx) : ring_used(c->rx)) == 0) {
+        errno = ECONNRESET;
+        return -1;
+    }
+    return 0;
+}
+
+int shm_accept(struct shm_chan *c, int sock)
+{
+    int fds[SHM_FDS] = { -1, -1, -1 };
+    char cbuf[CMSG_SPACE(sizeof(fds))];
+    uint8_t ack = SHM_ACK;
+    struct iovec iov = { .iov_base = &ack, .iov_len = 1 };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    void *mem;
+
+    (void) memset(c, 0, sizeof(*c));
+    c->sock = sock;
+    c->wake_fd = c->peer_fd = -1;
+    if ((fds[0] = syscall(__NR_memfd_create, "mastermind-shm",
+            MFD_CLOEXEC)) < 0
+        || ftruncate(fds[0], sizeof(*c->seg)) < 0
+        || (fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0
+        || (fds[2] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        goto fail;
+    }
+    mem = mmap(NULL, sizeof(*c->seg), PROT_READ | PROT_WRITE, MAP_SHARED,
+        fds[0], 0);
+    if (mem == MAP_FAILED) {
+        goto fail;
+    }
+    c->seg = mem;
+    c->seg->magic = SHM_MAGIC;
+    c->seg->ring_bytes = SHM_RING_BYTES;
+
+    (void) memset(&msg, 0, sizeof(msg));
+    (void) memset(cbuf, 0, sizeof(cbuf));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    (void) memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    /* a new connection has room for one byte */
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) != 1) {
+        goto fail;
+    }
+    (void) close(fds[0]);
+    c->tx = &c->seg->down;
+    c->rx = &c->seg->up;
+    c->wake_fd = fds[2];
+    c->peer_fd = fds[1];
+    return 0;
+
+fail:
+    for (int i = 0; i < SHM_FDS; ++i) {
+        if (fds[i] >= 0) {
+            int saved = errno;
+
+            (void) close(fds[i]);
+            errno = saved;
+        }
+    }
+    if (c->seg != NULL) {
+        (void) munmap(c->seg, sizeof(*c->seg));
+        c->seg = NULL;
+    }
+    return -1;
+}
+
+int shm_connect(struct shm_chan *c, const char *path, uint32_t spin)
+{
+    int fds[SHM_FDS] = { -1, -1, -1 };
+    char cbuf[CMSG_SPACE(sizeof(fds))];
+    uint8_t ack = 0;
+    struct iovec iov = { .iov_base = &ack, .iov_len = 1 };
+    struct sockaddr_un addr;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    void *mem;
+
+    (void) memset(c, 0, sizeof(*c));
+    c->wake_fd = c->peer_fd = -1;
+    c->spin = spin;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    (void) memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    (void) strcpy(addr.sun_path, path);
+    if ((c->sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+    if (connect(c->sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        goto fail;
+    }
+
+    (void) memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    if (recvmsg(c->sock, &msg, MSG_CMSG_CLOEXEC) != 1 || ack != SHM_ACK
+        || (cmsg = CMSG_FIRSTHDR(&msg)) == NULL
+        || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        errno = EPROTO;
+        goto fail;
+    }
+    (void) memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    mem = mmap(NULL, sizeof(*c->seg), PROT_READ | PROT_WRITE, MAP_SHARED,
+        fds[0], 0);
+    (void) close(fds[0]);
+    fds[0] = -1;
+    if (mem == MAP_FAILED) {
+        goto fail;
+    }
+    c->seg = mem;
+    if (c->seg->magic != SHM_MAGIC || c->seg->ring_bytes != SHM_RING_BYTES) {
+        errno = EPROTO;
+        goto fail;
+    }
+    c->tx = &c->seg->up;
+    c->rx = &c->seg->down;
+    c->wake_fd = fds[1];
+    c->peer_fd = fds[2];
+    return 0;
+
+fail:
+    for (int i = 0; i < SHM_FDS; ++i) {
+        if (fds[i] >= 0) {
+            int saved = errno;
+
+            (void) close(fds[i]);
+            errno = saved;
+        }
+    }
+    if (c->seg != NULL) {
+        (void) munmap(c->seg, sizeof(*c->seg));
+        c->seg = NULL;
+    }
+    {
+        int saved = errno;
+
+        (void) close(c->sock);
+        c->sock = -1;
+        errno = saved;
+    }
+    return -1;
+}
+
+void shm_close(struct shm_chan *c)
+{
+    if (c->seg != NULL) {
+        (void) munmap(c->seg, sizeof(*c->seg));
+        c->seg = NULL;
+    }
+    if (c->wake_fd >= 0) {
+        (void) close(c->wake_fd);
+        c->wake_fd = -1;
+    }
+    if (c->peer_fd >= 0) {
+        (void) close(c->peer_fd);
+        c->peer_fd = -1;
+    }
+}
+
+size_t shm_write(struct shm_chan *c, const void *src, size_t len)
+{
+    struct shm_ring *r = c->tx;
+    uint32_t head = r->head;
+    uint32_t n = ring_room(r);
+    uint32_t off = head & (SHM_RING_BYTES - 1);
+    uint32_t first;
+
+    if (n > len) {
+        n = len;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    first = n < SHM_RING_BYTES - off ? n : SHM_RING_BYTES - off;
+    (void) memcpy(&r->data[off], src, first);
+    (void) memcpy(r->data, (const uint8_t *) src + first, n - first);
+    __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+    notify(&r->consumer_waits, c->peer_fd);
+    return n;
+}
+
+size_t shm_read(struct shm_chan *c, void *dst, size_t len)
+{
+    struct shm_ring *r = c->rx;
+    uint32_t tail = r->tail;
+    uint32_t n = ring_used(r);
+    uint32_t off = tail & (SHM_RING_BYTES - 1);
+    uint32_t first;
+
+    if (n > len) {
+        n = len;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    first = n < SHM_RING_BYTES - off ? n : SHM_RING_BYTES - off;
+    (void) memcpy(dst, &r->data[off], first);
+    (void) memcpy((uint8_t *) dst + first, r->data, n - first);
+    __atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+    notify(&r->producer_waits, c->peer_fd);
+    return n;
+}
+
+int shm_want_read(struct shm_chan *c)
+{
+    return want(&c->rx->consumer_waits, ring_used, c->rx);
+}
+
+int shm_want_write(struct shm_chan *c)
+{
+    return want(&c->tx->producer_waits, ring_room, c->tx);
+}
+
+int shm_send(struct shm_chan *c, const void *src, size_t len)
+{
+    size_t off = 0;
+
+    while (off < len) {
+        size_t n = shm_write(c, (const uint8_t *) src + off, len - off);
+
+        if (n == 0 && wait_peer(c, 1) < 0) {
+            return -1;
+        }
+        off += n;
+    }
+    return 0;
+}
+
+int shm_recv(struct shm_chan *c, void *dst, size_t len)
+{
+    size_t off = 0;
+
+    while (off < len) {
+        size_t n = shm_read(c, (uint8_t *) dst + off, len - off);
+
+        if (n == 0 && wait_peer(c, 0) < 0) {
+            return -1;
+        }
+        off += n;
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * @brief shared-memory transport for clients on the same host
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * A channel is a segment in a memfd with two lock-free single-producer
+ * single-consumer byte rings, one carrying the client's requests to the
+ * server and one the responses back. The bytes are the same as on a TCP
+ * connection (see game.h), so every kind of game can be played over
+ * either. Head and tail are free running 32 bit counters on cache lines
+ * of their own; the producer publishes bytes with a release store of
+ * head, the consumer frees them with a release store of tail.
+ *
+ * Each side has an eventfd the other side writes to, but only when it
+ * asked for it: before a side sleeps it sets the waits flag of the ring
+ * it waits for and looks at the ring once more, and a side that moved
+ * head or tail checks the flag behind a full barrier. Rounds between two
+ * sides that keep polling take no system call at all.
+ *
+ * Setup: the client connects to the server's Unix socket and receives
+ * one byte, SHM_ACK, with the memfd and both eventfds (SCM_RIGHTS). The
+ * socket stays open while the channel is used; a side that closes it
+ * ends the channel, the other one sees a hangup on it.
+*/
+
+#ifndef MM_SHM_H_
+#define MM_SHM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* === Constants === */
+
+#define SHM_MAGIC (0x314d48534d4dULL)  /* "MMSHM1" */
+#define SHM_RING_BYTES (4096)   /* a power of two */
+#define SHM_ACK (0xff)
+#define SHM_FDS (3)             /* memfd, client's and server's eventfd */
+#define SHM_LINE (64)
+#define SHM_SPIN (2000)         /* polls before a client sleeps */
+#define SHM_YIELD_SPINS (1024)  /* polls between two sched_yield() */
+
+/* === Type Definitions === */
+
+/* One direction of a channel */
+struct shm_ring {
+    uint32_t head __attribute__((aligned(SHM_LINE))); /* bytes written */
+    uint32_t producer_waits;    /* the producer sleeps until there is room */
+    uint32_t tail __attribute__((aligned(SHM_LINE))); /* bytes read */
+    uint32_t consumer_waits;    /* the consumer sleeps until there are bytes */
+    uint8_t data[SHM_RING_BYTES] __attribute__((aligned(SHM_LINE)));
+};
+
+/* The shared segment */
+struct shm_segment {
+    uint64_t magic;
+    uint32_t ring_bytes;
+    struct shm_ring up;         /* client to server */
+    struct shm_ring down;       /* server to client */
+};
+
+/* One side of a channel */
+struct shm_chan {
+    struct shm_segment *seg;    /* NULL if not in use */
+    struct shm_ring *tx;
+    struct shm_ring *rx;
+    int sock;                   /* the Unix socket of the setup */
+    int wake_fd;                /* eventfd the peer wakes this side with */
+    int peer_fd;                /* eventfd of the peer */
+    uint32_t spin;              /* polls before sleeping, UINT32_MAX: never */
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Create a channel for a client that connected and send it the
+ * segment
+ * @param c The server's side of the channel
+ * @param sock The client's connection, nonblocking; owned by the caller
+ * @return 0 on success, -1 with errno set on error
+ */
+int shm_accept(struct shm_chan *c, int sock);
+
+/**
+ * @brief Connect to a server's Unix socket and map the channel it sends
+ * @param c The client's side of the channel
+ * @param path Path of the server's socket
+ * @param spin Polls before sleeping, UINT32_MAX to busy-poll
+ * @return 0 on success, -1 with errno set on error
+ */
+int shm_connect(struct shm_chan *c, const char *path, uint32_t spin);
+
+/**
+ * @brief Unmap a channel and close its eventfds; the socket is left to the
+ * caller
+ * @param c The channel, may be unused
+ */
+void shm_close(struct shm_chan *c);
+
+/**
+ * @brief Write as many bytes as fit, waking the peer if it waits for them
+ * @param c The channel
+ * @param src The bytes
+ * @param len Number of bytes
+ * @return Number of bytes written
+ */
+size_t shm_write(struct shm_chan *c, const void *src, size_t len);
+
+/**
+ * @brief Read the bytes there are, waking the peer if it waits for room
+ * @param c The channel
+ * @param dst Receives the bytes
+ * @param len Room in dst
+ * @return Number of bytes read
+ */
+size_t shm_read(struct shm_chan *c, void *dst, size_t len);
+
+/**
+ * @brief Ask the peer for a wakeup once there are bytes to read
+ * @param c The channel
+ * @return 0 if it will wake this side, 1 if there are bytes already
+ */
+int shm_want_read(struct shm_chan *c);
+
+/**
+ * @brief Ask the peer for a wakeup once there is room to write
+ * @param c The channel
+ * @return 0 if it will wake this side, 1 if there is room already
+ */
+int shm_want_write(struct shm_chan *c);
+
+/**
+ * @brief Write all bytes, polling and then sleeping while the ring is full
+ * @param c The channel
+ * @param src The bytes
+ * @param len Number of bytes
+ * @return 0 on success, -1 if the peer hung up or on error
+ */
+int shm_send(struct shm_chan *c, const void *src, size_t len);
+
+/**
+ * @brief Read exactly len bytes, polling and then sleeping while there
+ * are none
+ * @param c The channel
+ * @param dst Receives the bytes
+ * @param len Number of bytes
+ * @return 0 on success, -1 if the peer hung up or on error
+ */
+int shm_recv(struct shm_chan *c, void *dst, size_t len);
+
+/**
+ * @brief Check whether there are bytes to read
+ * @param c The channel
+ * @return Nonzero if there are
+ */
+static inline int shm_readable(const struct shm_chan *c)
+{
+    return __atomic_load_n(&c->rx->head, __ATOMIC_ACQUIRE) != c->rx->tail;
+}
+
+#endif
@@ -0,0 +1,397 @@
+/*
+ * @brief in-process self-play of server and client game logic
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * simulate [-e] [-m matrix-file] [-n games] [-s strategy] [-t threads]
+ *          [-x seed]
+ *
+ * Plays games with the client's solver against the server's answers
+ * without any sockets: every round goes through the same request
+ * encoding, answer and decoding functions as over TCP (see game.h), so
+ * the results are the ones the networked programs would get. Games are
+ * spread over all threads; secrets are random (seeded with -x, the same
+ * seed gives the same secrets for any thread count) or enumerated (-e).
+ * The random strategy draws its guesses from a generator seeded with -x
+ * and the number of the game, so its results do not depend on the thread
+ * count either.
+ *
+ * The solver's guesses depend on the responses only, so they are shared
+ * between games in a decision tree: a game follows the tree as long as it
+ * finds guesses there and only calls the solver for new histories.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include "tbucket.h"
+#include "solver.h"
+#include "game.h"
+#include "args.h"
+
+/* === Type Definitions === */
+
+struct sim_opts {
+    long int games;
+    long int threads;
+    long int seed;
+    int enumerate;
+    int strategy;
+    const char *matrix;
+};
+
+/* A history of responses, children are indexed by response class */
+struct node {
+    uint16_t guess;                     /* NO_GUESS until it is known */
+    struct node *child[SCORE_CLASSES];
+};
+
+/* Per thread state, every thread plays its games with its own solver */
+struct sim_thread {
+    struct solver solver;
+    struct solver_scratch scratch;
+    uint64_t rounds[MAX_TRIES + 1];  /* games won per number of rounds */
+    uint64_t lost;
+} __attribute__((aligned(64)));
+
+struct sim_ctx {
+    const struct sim_opts *options;
+    const struct matrix *matrix;
+    struct sim_thread *threads;
+    struct node *root;                  /* NULL for random guesses */
+};
+
+/* === Constants === */
+
+#define NO_GUESS (UINT16_MAX)
+
+/* === Global Variables === */
+
+/* Name of the program */
+static const char *progname = "simulate"; /* default name */
+
+/* === Implementations === */
+
+/**
+ * @brief terminate program on program error
+ * @param exitcode exit code
+ * @param fmt format string
+ */
+static void bail_out(int exitcode, const char *fmt, ...)
+{
+    va_list ap;
+
+    (void) fprintf(stderr, "%s: ", progname);
+    if (fmt != NULL) {
+        va_start(ap, fmt);
+        (void) vfprintf(stderr, fmt, ap);
+        va_end(ap);
+    }
+    if (errno != 0) {
+        (void) fprintf(stderr, ": %s", strerror(errno));
+    }
+    (void) fprintf(stderr, "\n");
+    exit(exitcode);
+}
+
+/**
+ * @brief Allocate a node without a guess
+ * @return The node
+ */
+static struct node *node_new(void)
+{
+    struct node *node = calloc(1, sizeof(*node));
+
+    if (node == NULL) {
+        bail_out(EXIT_FAILURE, "allocating decision tree");
+    }
+    node->guess = NO_GUESS;
+    return node;
+}
+
+/**
+ * @brief Get the child of a node, adding it if it is missing
+ * @param node The node
+ * @param cls Response class
+ * @return The child
+ */
+static struct node *node_child(struct node *node, int cls)
+{
+    struct node *child = __atomic_load_n(&node->child[cls], __ATOMIC_ACQUIRE);
+    struct node *expected = NULL;
+
+    if (child != NULL) {
+        return child;
+    }
+    child = node_new();
+    if (!__atomic_compare_exchange_n(&node->child[cls], &expected, child, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* another thread was faster */
+        free(child);
+        child = expected;
+    }
+    return child;
+}
+
+/**
+ * @brief Free a decision tree
+ * @param node The root of the tree
+ */
+static void node_free(struct node *node)
+{
+    for (int cls = 0; cls < SCORE_CLASSES; ++cls) {
+        if (node->child[cls] != NULL) {
+            node_free(node->child[cls]);
+        }
+    }
+    free(node);
+}
+
+/**
+ * @brief Get the secret of a game
+ * @param options The options
+ * @param game Number of the game
+ * @return The packed secret
+ */
+static uint16_t game_secret(const struct sim_opts *options, uint64_t game)
+{
+    uint64_t z;
+
+    if (options->enumerate) {
+        return game % CODES;
+    }
+    /* splitmix64 of the game number: independent of the thread count */
+    z = (uint64_t) options->seed + (game + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31)) & CODE_MASK;
+}
+
+/**
+ * @brief Play one game
+ * @param t The thread's state
+ * @param ctx The simulation
+ * @param game Number of the game, for its secret and random guesses
+ */
+static void play(struct sim_thread *t, const struct sim_ctx *ctx,
+    uint64_t game)
+{
+    uint16_t secret = game_secret(ctx->options, game);
+    struct node *node = ctx->root;
+    uint16_t guesses[MAX_TRIES + 1];
+    uint8_t resps[MAX_TRIES + 1];
+    int played = 0;     /* rounds the solver knows the guess of */
+    int told = 0;       /* rounds the solver knows the response to */
+
+    solver_init(&t->solver, ctx->options->strategy, NULL, ctx->matrix,
+        &t->scratch);
+    /* random guesses of a game do not depend on the thread it runs on */
+    solver_seed(&t->solver, ctx->options->seed, game);
+
+    for (int round = 1; round <= MAX_TRIES; ++round) {
+        uint16_t guess = NO_GUESS;
+        uint8_t resp;
+        int white, red;
+
+        if (node != NULL) {
+            guess = __atomic_load_n(&node->guess, __ATOMIC_RELAXED);
+        }
+        if (guess == NO_GUESS) {
+            /* pruning the candidates costs more than the rest of the
+               game, so the solver only catches up once it has to select
+               a guess; random guesses ignore the responses */
+            while (ctx->root != NULL && told < round - 1) {
+                told++;
+                if (played < told) {
+                    solver_replay(&t->solver, guesses[told]);
+                    played = told;
+                }
+                red = codec_decode(resps[told], &white);
+                solver_feedback(&t->solver, guesses[told], red, white);
+            }
+            guess = solver_guess(&t->solver);
+            played = round;
+            if (guess == SOLVER_NO_GUESS) {
+                break; /* cannot happen with the server's own answers */
+            }
+            if (node != NULL) {
+                /* racing threads select the same guess */
+                __atomic_store_n(&node->guess, guess, __ATOMIC_RELAXED);
+            }
+        }
+        /* a table of all 32768 scores would cost more than the game */
+        resp = game_answer_code(secret, codec_request(guess), round);
+        red = codec_decode(resp, &white);
+        guesses[round] = guess;
+        resps[round] = resp;
+
+        if (red == SLOTS) {
+            t->rounds[round]++;
+            return;
+        }
+        if (game_over(resp)) {
+            break;
+        }
+        if (node != NULL) {
+            node = node_child(node, red * (SLOTS + 1) + white);
+        }
+    }
+    t->lost++;
+}
+
+/**
+ * @brief Play a chunk of games, called by the pool
+ * @param arg The simulation
+ * @param tid The calling thread
+ * @param begin First game
+ * @param end End of the games
+ */
+static void play_chunk(void *arg, int tid, uint32_t begin, uint32_t end)
+{
+    const struct sim_ctx *ctx = arg;
+
+    for (uint32_t g = begin; g < end; ++g) {
+        play(&ctx->threads[tid], ctx, g);
+    }
+}
+
+/**
+ * @brief Parse command line options
+ * @param argc The argument counter
+ * @param argv The argument vector
+ * @param options Struct where parsed arguments are stored
+ */
+static void parse_args(int argc, char **argv, struct sim_opts *options)
+{
+    int c;
+
+    if (argc > 0) {
+        progname = argv[0];
+    }
+    options->games = 1000;
+    options->threads = sysconf(_SC_NPROCESSORS_ONLN);
+    options->seed = 1;
+    options->enumerate = 0;
+    options->strategy = STRATEGY_MINIMAX;
+    options->matrix = NULL;
+    if (options->threads < 1 || options->threads > POOL_MAX_THREADS) {
+        options->threads = 1;
+    }
+    while ((c = getopt(argc, argv, "em:n:s:t:x:")) != -1) {
+        switch (c) {
+        case 'e':
+            options->enumerate = 1;
+            break;
+        case 'm':
+            options->matrix = optarg;
+            break;
+        case 'n':
+            options->games = parse_number(optarg, "-n", 1,
+                UINT32_MAX, bail_out);
+            break;
+        case 's':
+            if ((options->strategy = solver_strategy(optarg)) < 0) {
+                bail_out(EXIT_FAILURE, "-s has to be one of random, minimax, "
+                    "parts or entropy");
+            }
+            break;
+        case 't':
+            options->threads = parse_number(optarg, "-t", 1,
+                POOL_MAX_THREADS, bail_out);
+            break;
+        case 'x':
+            options->seed = parse_number(optarg, "-x", 0, LONG_MAX, bail_out);
+            break;
+        default:
+            goto usage;
+        }
+    }
+    if (optind != argc) {
+usage:
+        errno = 0;
+        bail_out(EXIT_FAILURE, "Usage: %s [-e] [-m matrix-file] [-n games] "
+            "[-s strategy] [-t threads] [-x seed]", progname);
+    }
+}
+
+/**
+ * @brief Program entry point
+ * @param argc The argument counter
+ * @param argv The argument vector
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE in case of an error
+ */
+int main(int argc, char *argv[])
+{
+    struct sim_opts options;
+    struct sim_ctx ctx;
+    struct pool pool;
+    struct matrix matrix;
+    uint64_t rounds[MAX_TRIES + 1] = { 0 };
+    uint64_t won = 0, won_rounds = 0, lost = 0, start, ns;
+
+    parse_args(argc, argv, &options);
+
+    ctx.options = &options;
+    ctx.matrix = NULL;
+    ctx.root = options.strategy != STRATEGY_RANDOM ? node_new() : NULL;
+    if (options.matrix != NULL) {
+        if (matrix_open(&matrix, options.matrix) < 0) {
+            bail_out(EXIT_FAILURE, "opening %s", options.matrix);
+        }
+        ctx.matrix = &matrix;
+    }
+    if (posix_memalign((void **) &ctx.threads, 64,
+            options.threads * sizeof(*ctx.threads)) != 0) {
+        bail_out(EXIT_FAILURE, "allocating thread state");
+    }
+    (void) memset(ctx.threads, 0, options.threads * sizeof(*ctx.threads));
+    if (pool_init(&pool, options.threads) < 0) {
+        bail_out(EXIT_FAILURE, "starting threads");
+    }
+
+    /* warm the solver's opening book so that it is not part of the time */
+    solver_init(&ctx.threads[0].solver, options.strategy, NULL, ctx.matrix,
+        &ctx.threads[0].scratch);
+
+    start = tb_now();
+    pool_run(&pool, options.games, 1, play_chunk, &ctx);
+    ns = tb_now() - start;
+    pool_destroy(&pool);
+
+    for (long int t = 0; t < options.threads; ++t) {
+        for (int r = 1; r <= MAX_TRIES; ++r) {
+            rounds[r] += ctx.threads[t].rounds[r];
+        }
+        lost += ctx.threads[t].lost;
+    }
+    for (int r = 1; r <= MAX_TRIES; ++r) {
+        won += rounds[r];
+        won_rounds += rounds[r] * r;
+    }
+
+    (void) printf("%ld games on %ld threads in %.2f s, %.0f games/s\n",
+        options.games, options.threads, ns / 1e9, options.games / (ns / 1e9));
+    (void) printf("won %llu, lost %llu, %.4f rounds on average\n",
+        (unsigned long long) won, (unsigned long long) lost,
+        won > 0 ? (double) won_rounds / won : 0.0);
+    for (int r = 1; r <= MAX_TRIES; ++r) {
+        if (rounds[r] > 0) {
+            (void) printf("%2d rounds: %llu\n", r,
+                (unsigned long long) rounds[r]);
+        }
+    }
+
+    free(ctx.threads);
+    if (ctx.root != NULL) {
+        node_free(ctx.root);
+    }
+    if (ctx.matrix != NULL) {
+        matrix_close(&matrix);
+    }
+    return EXIT_SUCCESS;
+}
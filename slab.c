@@ -0,0 +1,53 @@
+/*
+ * @brief fixed-size object allocator on one contiguous mapping
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "slab.h"
+
+/* === Implementations === */
+
+int slab_init(struct slab *s, size_t size, size_t align, uint32_t capacity)
+{
+    (void) memset(s, 0, sizeof(*s));
+    if (size == 0 || align == 0 || (align & (align - 1)) != 0
+        || align > 4096) {
+        errno = EINVAL;
+        return -1;
+    }
+    s->stride = (size + align - 1) & ~(align - 1);
+    s->capacity = capacity;
+    s->map_bytes = s->stride * capacity;
+    if (s->map_bytes == 0) {
+        s->map_bytes = 1;
+    }
+
+    /* pages are only backed once objects on them are handed out */
+    s->mem = mmap(NULL, s->map_bytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (s->mem == MAP_FAILED) {
+        s->mem = NULL;
+        return -1;
+    }
+    if ((s->free = malloc(capacity * sizeof(*s->free) + 1)) == NULL) {
+        (void) munmap(s->mem, s->map_bytes);
+        s->mem = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void slab_destroy(struct slab *s)
+{
+    if (s->mem != NULL) {
+        (void) munmap(s->mem, s->map_bytes);
+    }
+    free(s->free);
+    (void) memset(s, 0, sizeof(*s));
+}
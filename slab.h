@@ -0,0 +1,120 @@
+/**
+ * @brief fixed-size object allocator on one contiguous mapping
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * A slab reserves room for a fixed number of equally sized objects in one
+ * anonymous mapping. Objects are aligned to the given alignment and stay
+ * at the same address for the life of the slab, so they can be named by
+ * their index. Freed objects go on a LIFO free list and are handed out
+ * again first, while they are still in cache; objects that were never
+ * used are handed out in address order, so pages are only touched once
+ * the number of live objects grows that far. Allocation and freeing are
+ * a few instructions and never call malloc. A slab is not thread-safe,
+ * every thread owns its own.
+*/
+
+#ifndef MM_SLAB_H_
+#define MM_SLAB_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* === Type Definitions === */
+
+struct slab {
+    uint8_t *mem;
+    size_t stride;      /* object size rounded up to the alignment */
+    size_t map_bytes;
+    uint32_t capacity;
+    uint32_t used;      /* objects [0, used) have been handed out before */
+    uint32_t *free;     /* stack of freed indices */
+    uint32_t nfree;
+    uint32_t live;
+    uint32_t peak;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Reserve memory for a slab
+ * @param s The slab
+ * @param size Size of an object
+ * @param align Alignment of every object, a power of two up to 4096
+ * @param capacity Maximum number of live objects
+ * @return 0 on success, -1 with errno set on error
+ */
+int slab_init(struct slab *s, size_t size, size_t align, uint32_t capacity);
+
+/**
+ * @brief Release the memory of a slab and all its objects
+ * @param s The slab
+ */
+void slab_destroy(struct slab *s);
+
+/**
+ * @brief Allocate an object, its contents are undefined
+ * @param s The slab
+ * @return The object or NULL if capacity objects are live
+ */
+static inline void *slab_alloc(struct slab *s)
+{
+    uint32_t idx;
+
+    if (s->nfree > 0) {
+        idx = s->free[--s->nfree];
+    } else if (s->used < s->capacity) {
+        idx = s->used++;
+    } else {
+        return NULL;
+    }
+    if (++s->live > s->peak) {
+        s->peak = s->live;
+    }
+    return s->mem + idx * s->stride;
+}
+
+/**
+ * @brief Get the index of an object
+ * @param s The slab
+ * @param obj An object of the slab
+ * @return The index, less than the capacity
+ */
+static inline uint32_t slab_index(const struct slab *s, const void *obj)
+{
+    return ((const uint8_t *) obj - s->mem) / s->stride;
+}
+
+/**
+ * @brief Free an object
+ * @param s The slab
+ * @param obj The object
+ */
+static inline void slab_free(struct slab *s, void *obj)
+{
+    s->free[s->nfree++] = slab_index(s, obj);
+    s->live--;
+}
+
+/**
+ * @brief Get an object by its index
+ * @param s The slab
+ * @param idx The index
+ * @return The object
+ */
+static inline void *slab_at(const struct slab *s, uint32_t idx)
+{
+    return s->mem + idx * s->stride;
+}
+
+/**
+ * @brief Bytes taken by the live objects
+ * @param s The slab
+ * @return The bytes
+ */
+static inline size_t slab_bytes(const struct slab *s)
+{
+    return s->live * s->stride;
+}
+
+#endif
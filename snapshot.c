@@ -0,0 +1,314 @@
+/*
+ * @brief snapshots of the game tables that let games outlive the server
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "game.h"
+#include "snapshot.h"
+
+/* === Implementations === */
+
+/**
+ * @brief Bytes of a section in the file, including padding
+ * @param count Games in the section
+ * @return The size
+ */
+static size_t section_bytes(uint32_t count)
+{
+    size_t bytes = sizeof(struct snap_section) + (size_t) count
+        * (sizeof(uint32_t) + sizeof(uint16_t) + 3 * sizeof(uint8_t));
+
+    return (bytes + SNAPSHOT_ALIGN - 1) & ~(size_t) (SNAPSHOT_ALIGN - 1);
+}
+
+/**
+ * @brief Write a buffer completely
+ * @param fd The file
+ * @param data The buffer
+ * @param n Its size
+ * @return 0 on success, -1 with errno set on error
+ */
+static int write_all(int fd, const void *data, size_t n)
+{
+    const uint8_t *p = data;
+
+    while (n > 0) {
+        ssize_t r = write(fd, p, n);
+
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += r;
+        n -= r;
+    }
+    return 0;
+}
+
+/**
+ * @brief Final step of splitmix64, a cheap 64 bit mixer
+ * @param z The value
+ * @return The mixed value
+ */
+static uint64_t mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+int snapshot_write(const char *path, uint64_t key, uint32_t generation,
+    const struct snap_table *tables, uint32_t ntables)
+{
+    static const uint8_t zeros[SNAPSHOT_ALIGN];
+    char tmp[PATH_MAX];
+    size_t len = strlen(path);
+    struct snap_header hdr;
+    struct timespec ts;
+    int fd, err;
+
+    /* no snprintf(), it is not async-signal-safe */
+    if (len + sizeof(".tmp") > sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    (void) memcpy(tmp, path, len);
+    (void) memcpy(tmp + len, ".tmp", sizeof(".tmp"));
+
+    (void) memset(&hdr, 0, sizeof(hdr));
+    (void) memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.generation = generation;
+    hdr.key = key;
+    (void) clock_gettime(CLOCK_REALTIME, &ts);
+    hdr.created = (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    for (uint32_t i = 0; i < ntables; ++i) {
+        size_t live = gametab_count(tables[i].tab, tables[i].count, 0);
+
+        if (live > 0) {
+            hdr.sections++;
+            hdr.games += live;
+        }
+    }
+
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        return -1;
+    }
+    if (write_all(fd, &hdr, sizeof(hdr)) < 0) {
+        goto fail;
+    }
+    for (uint32_t i = 0; i < ntables; ++i) {
+        const struct gametab *t = tables[i].tab;
+        uint32_t n = tables[i].count;
+        struct snap_section sec;
+        size_t pad;
+
+        if (gametab_count(t, n, 0) == 0) {
+            continue;
+        }
+        (void) memset(&sec, 0, sizeof(sec));
+        sec.id = tables[i].id;
+        sec.count = n;
+        pad = section_bytes(n) - sizeof(sec) - (size_t) n * 9;
+        if (write_all(fd, &sec, sizeof(sec)) < 0
+            || write_all(fd, t->conn, (size_t) n * sizeof(*t->conn)) < 0
+            || write_all(fd, t->secret, (size_t) n * sizeof(*t->secret)) < 0
+            || write_all(fd, t->round, n) < 0
+            || write_all(fd, t->flags, n) < 0
+            || write_all(fd, t->resp, n) < 0
+            || write_all(fd, zeros, pad) < 0) {
+            goto fail;
+        }
+    }
+    /* the old snapshot is only replaced by a complete one */
+    if (fsync(fd) < 0 || close(fd) < 0) {
+        fd = -1;
+        goto fail;
+    }
+    if (rename(tmp, path) < 0) {
+        err = errno;
+        (void) unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+
+fail:
+    err = errno;
+    if (fd >= 0) {
+        (void) close(fd);
+    }
+    (void) unlink(tmp);
+    errno = err;
+    return -1;
+}
+
+int snapshot_open(struct snapshot *s, const char *path)
+{
+    const struct snap_header *hdr;
+    struct stat st;
+    size_t off;
+    uint8_t *base;
+    int fd, err;
+
+    (void) memset(s, 0, sizeof(*s));
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0) {
+        goto fail;
+    }
+    if ((size_t) st.st_size < sizeof(*hdr)) {
+        errno = EINVAL;
+        goto fail;
+    }
+    /* private and writable: claims must not reach the file */
+    base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        goto fail;
+    }
+    (void) close(fd);
+    s->base = base;
+    s->size = st.st_size;
+
+    hdr = s->base;
+    if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) != 0) {
+        errno = EINVAL;
+        goto fail_mapped;
+    }
+    s->key = hdr->key;
+    s->generation = hdr->generation;
+    s->games = hdr->games;
+    s->nsections = hdr->sections;
+    if ((s->ids = calloc(s->nsections + 1, sizeof(*s->ids))) == NULL
+        || (s->tabs = calloc(s->nsections + 1, sizeof(*s->tabs))) == NULL) {
+        goto fail_mapped;
+    }
+    off = sizeof(*hdr);
+    for (uint32_t i = 0; i < s->nsections; ++i) {
+        const struct snap_section *sec;
+        struct gametab *t = &s->tabs[i];
+        uint8_t *p;
+
+        if (s->size - off < sizeof(*sec)) {
+            errno = EINVAL;
+            goto fail_mapped;
+        }
+        sec = (const struct snap_section *) (base + off);
+        if (s->size - off < section_bytes(sec->count)) {
+            errno = EINVAL;
+            goto fail_mapped;
+        }
+        /* a view on the arrays, not backed by a mapping of its own */
+        p = base + off + sizeof(*sec);
+        t->conn = (uint32_t *) p;
+        t->secret = (uint16_t *) (p + (size_t) sec->count * 4);
+        t->round = p + (size_t) sec->count * 6;
+        t->flags = t->round + sec->count;
+        t->resp = t->flags + sec->count;
+        t->capacity = sec->count;
+        s->ids[i] = sec->id;
+        off += section_bytes(sec->count);
+    }
+    return 0;
+
+fail_mapped:
+    err = errno;
+    snapshot_close(s);
+    errno = err;
+    return -1;
+
+fail:
+    err = errno;
+    (void) close(fd);
+    errno = err;
+    return -1;
+}
+
+void snapshot_close(struct snapshot *s)
+{
+    if (s->base != NULL) {
+        (void) munmap(s->base, s->size);
+    }
+    free(s->ids);
+    free(s->tabs);
+    (void) memset(s, 0, sizeof(*s));
+}
+
+int snapshot_claim(struct snapshot *s, const struct snap_token *token,
+    struct snap_game *game)
+{
+    struct snap_token expect;
+    struct gametab *t = NULL;
+    uint32_t idx = token->index;
+    uint8_t live = GT_LIVE;
+
+    for (uint32_t i = 0; i < s->nsections; ++i) {
+        if (s->ids[i] == token->section) {
+            t = &s->tabs[i];
+            break;
+        }
+    }
+    if (t == NULL || idx >= t->capacity
+        || __atomic_load_n(&t->flags[idx], __ATOMIC_RELAXED) != GT_LIVE) {
+        return -1;
+    }
+    snapshot_token(&expect, s->key, token->section, idx, t->conn[idx]);
+    if (expect.check != token->check) {
+        return -1;
+    }
+    /* games that are over or taken have other flags */
+    if (!__atomic_compare_exchange_n(&t->flags[idx], &live, 0, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        return -1;
+    }
+    game->secret = t->secret[idx];
+    game->round = t->round[idx];
+    game->resp = t->resp[idx];
+    return 0;
+}
+
+void snapshot_token(struct snap_token *token, uint64_t key, uint32_t section,
+    uint32_t index, uint32_t conn)
+{
+    token->section = section;
+    token->index = index;
+    token->check = mix(key ^ mix((((uint64_t) section << 32) | index)
+        ^ mix(key + conn)));
+}
+
+void snapshot_token_pack(const struct snap_token *token, uint8_t *out)
+{
+    for (int i = 0; i < 4; ++i) {
+        out[i] = token->section >> (8 * i);
+        out[4 + i] = token->index >> (8 * i);
+    }
+    for (int i = 0; i < 8; ++i) {
+        out[8 + i] = token->check >> (8 * i);
+    }
+}
+
+void snapshot_token_unpack(struct snap_token *token, const uint8_t *in)
+{
+    (void) memset(token, 0, sizeof(*token));
+    for (int i = 0; i < 4; ++i) {
+        token->section |= (uint32_t) in[i] << (8 * i);
+        token->index |= (uint32_t) in[4 + i] << (8 * i);
+    }
+    for (int i = 0; i < 8; ++i) {
+        token->check |= (uint64_t) in[8 + i] << (8 * i);
+    }
+}
@@ -0,0 +1,158 @@
+/**
+ * @brief snapshots of the game tables that let games outlive the server
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * A snapshot is a file with the state of every lock-step game: a struct
+ * snap_header and one section per game table, a struct snap_section
+ * followed by the used prefix of the table's arrays (see gametab.h),
+ * 9 bytes per game. It is written to a temporary file, synced and renamed
+ * over the previous snapshot, so the file is always complete.
+ *
+ * The server takes snapshots in a forked child: fork() gives it a copy of
+ * the tables at one instant while the workers go on playing, and the
+ * kernel copies only the pages the workers write to meanwhile. A restarted
+ * server maps the last snapshot, which is ready at once, and hands games
+ * out to the connections that present their token (see game.h). Games are
+ * taken from the mapping with an atomic claim, so a game is resumed once
+ * even if its client races itself on two workers.
+ *
+ * A token names a game by the id of its section and its index there, and
+ * carries a check value: a keyed hash of both and the game's connection
+ * number. The key is kept in the snapshot, so tokens stay valid across
+ * restarts. It is not a MAC, it only makes the tokens of other games hard
+ * to guess.
+*/
+
+#ifndef MM_SNAPSHOT_H_
+#define MM_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "gametab.h"
+
+/* === Constants === */
+
+#define SNAPSHOT_MAGIC "MMSNAP01"
+#define SNAPSHOT_ALIGN (16)     /* sections start at multiples of this */
+
+/* === Type Definitions === */
+
+/* Header of a snapshot file, 64 bytes */
+struct snap_header {
+    char magic[8];
+    uint32_t sections;
+    uint32_t generation;    /* of the server that wrote it, see below */
+    uint64_t key;           /* of the token check values */
+    int64_t created;        /* CLOCK_REALTIME in ns */
+    uint64_t games;         /* live games in all sections */
+    uint8_t reserved[24];
+};
+
+/* Header of a section, followed by its arrays in the order of struct
+   gametab: conn, secret, round, flags, resp */
+struct snap_section {
+    uint32_t id;            /* generation << 8 | worker */
+    uint32_t count;         /* games in the arrays, free ones included */
+    uint64_t reserved;
+};
+
+/* A table to write into a snapshot */
+struct snap_table {
+    uint32_t id;
+    uint32_t count;         /* games below this index are written */
+    const struct gametab *tab;
+};
+
+/* The state of a game taken from a snapshot */
+struct snap_game {
+    uint16_t secret;
+    uint8_t round;
+    uint8_t resp;
+};
+
+/* A game token, GAME_TOKEN_BYTES on the wire, little endian */
+struct snap_token {
+    uint32_t section;
+    uint32_t index;
+    uint64_t check;
+};
+
+/* A mapped snapshot */
+struct snapshot {
+    uint64_t key;
+    uint32_t generation;
+    uint64_t games;         /* live games when it was written */
+    uint32_t nsections;
+    uint32_t *ids;          /* id of every section */
+    struct gametab *tabs;   /* arrays of every section, in the mapping */
+    void *base;             /* private mapping, claims write to it */
+    size_t size;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Write a snapshot, only using async-signal-safe calls so that a
+ * forked child of a threaded process may call it
+ * @param path The file, path.tmp is used while writing
+ * @param key Key of the check values
+ * @param generation Generation of the writer
+ * @param tables The tables, sections without live games are left out
+ * @param ntables Number of tables
+ * @return 0 on success, -1 with errno set on error
+ */
+int snapshot_write(const char *path, uint64_t key, uint32_t generation,
+    const struct snap_table *tables, uint32_t ntables);
+
+/**
+ * @brief Map a snapshot
+ * @param s Receives the snapshot
+ * @param path The file
+ * @return 0 on success, -1 with errno set on error (EINVAL for a bad file)
+ */
+int snapshot_open(struct snapshot *s, const char *path);
+
+/**
+ * @brief Unmap a snapshot
+ * @param s The snapshot
+ */
+void snapshot_close(struct snapshot *s);
+
+/**
+ * @brief Take a game out of a snapshot
+ * @param s The snapshot
+ * @param token The game's token
+ * @param game Receives the state of the game
+ * @return 0 on success, -1 if the token is not valid or the game was
+ * already taken
+ */
+int snapshot_claim(struct snapshot *s, const struct snap_token *token,
+    struct snap_game *game);
+
+/**
+ * @brief Make the token of a game
+ * @param token Receives the token
+ * @param key Key of the check values
+ * @param section Id of the game's table
+ * @param index Index of the game
+ * @param conn Number of the game's connection
+ */
+void snapshot_token(struct snap_token *token, uint64_t key, uint32_t section,
+    uint32_t index, uint32_t conn);
+
+/**
+ * @brief Write a token in wire format
+ * @param token The token
+ * @param out GAME_TOKEN_BYTES bytes
+ */
+void snapshot_token_pack(const struct snap_token *token, uint8_t *out);
+
+/**
+ * @brief Read a token in wire format
+ * @param token Receives the token
+ * @param in GAME_TOKEN_BYTES bytes
+ */
+void snapshot_token_unpack(struct snap_token *token, const uint8_t *in);
+
+#endif
@@ -0,0 +1,384 @@
+/*
+ * @brief mastermind solver for the client
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include "tbucket.h"
+#include "pool.h"
+#include "secret.h"
+#include "solver.h"
+
+/* === Constants === */
+
+#define BOOK_VALID (1u << 16)
+#define SELECT_CHUNK (64) /* guesses a thread rates at once */
+
+/* === Type Definitions === */
+
+/* Quality of a guess, smaller is better */
+struct rating {
+    double value;
+    int not_candidate;
+    uint16_t code;
+};
+
+/* Best guess found by one thread, padded against false sharing */
+struct thread_best {
+    struct rating r;
+} __attribute__((aligned(64)));
+
+/* Shared state of a parallel guess selection */
+struct select_ctx {
+    struct solver *s;
+    uint32_t n;
+    const uint16_t *guesses;
+    struct thread_best best[POOL_MAX_THREADS];
+};
+
+/* === Global Variables === */
+
+static const char *strategy_names[STRATEGIES] = {
+    "random", "minimax", "parts", "entropy"
+};
+
+/* every code, the guesses considered after the opening */
+static uint16_t all_codes[CODES];
+
+/* n * log2(n) for every possible partition size */
+static double nlogn[CODES + 1];
+
+/* opening book: first guess per strategy, second guess per first class */
+static uint16_t book_first[STRATEGIES];
+static uint32_t book_second[STRATEGIES][SCORE_CLASSES];
+static pthread_once_t book_once = PTHREAD_ONCE_INIT;
+
+/* === Implementations === */
+
+/**
+ * @brief Map a score to its response class
+ * @param score A score as returned by the functions in score.h
+ * @return red * (SLOTS + 1) + white
+ */
+static inline int score_class(uint8_t score)
+{
+    return (score & 0x7) * (SLOTS + 1) + ((score >> SHIFT_WIDTH) & 0x7);
+}
+
+/**
+ * @brief Rate a guess by the partition it splits the candidates into
+ * @param strategy The strategy that defines the rating
+ * @param hist Number of candidates per response class
+ * @return The rating, smaller is better
+ */
+static double rate(enum strategy strategy, const uint32_t *hist)
+{
+    double value = 0;
+
+    for (int i = 0; i < SCORE_CLASSES; ++i) {
+        switch (strategy) {
+        case STRATEGY_MINIMAX:
+            if (hist[i] > value) {
+                value = hist[i];
+            }
+            break;
+        case STRATEGY_PARTS:
+            value -= hist[i] != 0;
+            break;
+        default:
+            /* minimising sum n log n maximises the entropy */
+            value += nlogn[hist[i]];
+            break;
+        }
+    }
+    return value;
+}
+
+/**
+ * @brief Compare two ratings
+ * @return Nonzero if a is strictly better than b
+ */
+static int better(const struct rating *a, const struct rating *b)
+{
+    if (a->value != b->value) {
+        return a->value < b->value;
+    }
+    if (a->not_candidate != b->not_candidate) {
+        return a->not_candidate < b->not_candidate;
+    }
+    return a->code < b->code;
+}
+
+/**
+ * @brief Rate one guess against a list of candidates
+ * @param s The solver, only read so that threads can share it
+ * @param guess The guess to rate
+ * @param list The candidates
+ * @param n Number of candidates
+ * @param r Receives the rating
+ */
+static void rate_guess(const struct solver *s, uint16_t guess,
+    const uint16_t *list, uint32_t n, struct rating *r)
+{
+    uint32_t hist[SCORE_CLASSES] = { 0 };
+    uint8_t scores[1024];
+    const uint16_t *row = s->matrix != NULL ? matrix_row(s->matrix, guess) : NULL;
+
+    for (uint32_t i = 0; row != NULL && i < n; ++i) {
+        hist[matrix_class(row, list[i])]++;
+    }
+    for (uint32_t base = 0; row == NULL && base < n; base += sizeof(scores)) {
+        uint32_t len = n - base < sizeof(scores) ? n - base : sizeof(scores);
+        score_batch_secrets(guess, &list[base], scores, len);
+        for (uint32_t i = 0; i < len; ++i) {
+            hist[score_class(scores[i])]++;
+        }
+    }
+    r->value = rate(s->strategy, hist);
+    r->not_candidate = !((s->cands[guess / 64] >> (guess % 64)) & 1);
+    r->code = guess;
+}
+
+/**
+ * @brief Rate a chunk of guesses, called by the pool
+ * @param arg The selection context
+ * @param tid The calling thread
+ * @param begin First guess to rate
+ * @param end End of the guesses to rate
+ */
+static void select_chunk(void *arg, int tid, uint32_t begin, uint32_t end)
+{
+    struct select_ctx *ctx = arg;
+    struct rating r, *best = &ctx->best[tid].r;
+
+    for (uint32_t i = begin; i < end; ++i) {
+        rate_guess(ctx->s, ctx->guesses[i], ctx->s->scratch->list, ctx->n, &r);
+        if (better(&r, best)) {
+            *best = r;
+        }
+    }
+}
+
+/**
+ * @brief Collect the candidates into s->scratch->list
+ * @param s The solver
+ * @return Number of candidates
+ */
+static uint32_t collect(struct solver *s)
+{
+    uint32_t n = 0;
+
+    for (uint32_t w = 0; w < CODES / 64; ++w) {
+        uint64_t bits = s->cands[w];
+        while (bits != 0) {
+            s->scratch->list[n++] = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Find the best guess among some codes
+ * @param s The solver with the candidates in s->scratch->list
+ * @param n Number of candidates
+ * @param guesses The codes to consider
+ * @param nguesses Number of codes to consider
+ * @return The best guess
+ */
+static uint16_t best_guess(struct solver *s, uint32_t n,
+    const uint16_t *guesses, uint32_t nguesses)
+{
+    struct select_ctx ctx;
+    int nthreads = s->pool != NULL ? s->pool->nthreads : 1;
+    struct rating *best = &ctx.best[0].r;
+
+    ctx.s = s;
+    ctx.n = n;
+    ctx.guesses = guesses;
+    for (int t = 0; t < nthreads; ++t) {
+        ctx.best[t].r.value = INFINITY;
+        ctx.best[t].r.not_candidate = 1;
+        ctx.best[t].r.code = UINT16_MAX;
+    }
+    if (s->pool != NULL) {
+        pool_run(s->pool, nguesses, SELECT_CHUNK, select_chunk, &ctx);
+    } else {
+        select_chunk(&ctx, 0, 0, nguesses);
+    }
+
+    /* the order is total, so the result does not depend on the threads */
+    for (int t = 1; t < nthreads; ++t) {
+        if (better(&ctx.best[t].r, best)) {
+            best = &ctx.best[t].r;
+        }
+    }
+    return best->code;
+}
+
+/**
+ * @brief Fill the global tables and the first guesses of the opening book
+ */
+static void init_book(void)
+{
+    static struct solver s;
+    static struct solver_scratch scratch;
+    uint16_t canon[CODES];
+    uint32_t ncanon = 0;
+
+    for (uint32_t i = 0; i < CODES; ++i) {
+        all_codes[i] = i;
+        nlogn[i + 1] = (i + 1) * log2(i + 1);
+    }
+
+    /* codes that use colors in order of first appearance are all distinct
+       first guesses, any other code is one of them with colors renamed */
+    for (uint32_t code = 0; code < CODES; ++code) {
+        int max = -1, ok = 1;
+        for (int j = 0; j < SLOTS && ok; ++j) {
+            int c = (code >> (j * SHIFT_WIDTH)) & 0x7;
+            if (c > max + 1) {
+                ok = 0;
+            } else if (c > max) {
+                max = c;
+            }
+        }
+        if (ok) {
+            canon[ncanon++] = code;
+        }
+    }
+
+    (void) memset(s.cands, 0xff, sizeof(s.cands));
+    s.scratch = &scratch;
+    s.ncands = collect(&s);
+    s.pool = NULL;
+    s.matrix = NULL;
+    for (int st = STRATEGY_MINIMAX; st < STRATEGIES; ++st) {
+        s.strategy = st;
+        book_first[st] = best_guess(&s, s.ncands, canon, ncanon);
+    }
+}
+
+int solver_strategy(const char *name)
+{
+    for (int i = 0; i < STRATEGIES; ++i) {
+        if (strcmp(name, strategy_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void solver_init(struct solver *s, enum strategy strategy, struct pool *pool,
+    const struct matrix *matrix, struct solver_scratch *scratch)
+{
+    (void) pthread_once(&book_once, init_book);
+    (void) memset(s->cands, 0xff, sizeof(s->cands));
+    s->ncands = CODES;
+    s->strategy = strategy;
+    s->pool = pool;
+    s->matrix = matrix;
+    s->scratch = scratch;
+    s->round = 0;
+    s->first_class = -1;
+    s->guess_ns = 0;
+}
+
+void solver_seed(struct solver *s, uint64_t seed, uint64_t stream)
+{
+    /* splitmix64, as for the server's secrets */
+    uint64_t z = seed ^ stream * 0xd1b54a32d192ed03ULL;
+
+    for (int i = 0; i < 4; ++i) {
+        uint64_t x = (z += 0x9e3779b97f4a7c15ULL);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        s->rng[i] = x ^ (x >> 31);
+    }
+}
+
+uint16_t solver_guess(struct solver *s)
+{
+    uint64_t start = tb_now();
+    uint32_t *book = NULL;
+    uint16_t guess;
+
+    s->round++;
+    if (s->strategy == STRATEGY_RANDOM) {
+        /* the high bits are the best ones */
+        guess = secret_xoshiro(s->rng) >> (64 - CODE_BITS);
+        s->guess_ns += tb_now() - start;
+        return guess;
+    }
+    if (s->round == 1) {
+        guess = book_first[s->strategy];
+        s->guess_ns += tb_now() - start;
+        return guess;
+    }
+    if (s->round == 2) {
+        book = &book_second[s->strategy][s->first_class];
+        uint32_t entry = __atomic_load_n(book, __ATOMIC_ACQUIRE);
+        if (entry & BOOK_VALID) {
+            s->guess_ns += tb_now() - start;
+            return entry & UINT16_MAX;
+        }
+    }
+
+    guess = solver_best(s);
+    if (book != NULL && guess != SOLVER_NO_GUESS) {
+        __atomic_store_n(book, guess | BOOK_VALID, __ATOMIC_RELEASE);
+    }
+    s->guess_ns += tb_now() - start;
+    return guess;
+}
+
+void solver_replay(struct solver *s, uint16_t guess)
+{
+    (void) guess;
+    s->round++;
+}
+
+uint16_t solver_best(struct solver *s)
+{
+    uint32_t n = collect(s);
+
+    if (n == 0) {
+        return SOLVER_NO_GUESS;
+    }
+    if (n <= 2) {
+        /* guessing a candidate is at least as good as anything else */
+        return s->scratch->list[0];
+    }
+    return best_guess(s, n, all_codes, CODES);
+}
+
+void solver_feedback(struct solver *s, uint16_t guess, int red, int white)
+{
+    int cls = red * (SLOTS + 1) + white;
+    uint32_t n = collect(s);
+    const uint16_t *row = s->matrix != NULL ? matrix_row(s->matrix, guess) : NULL;
+    const uint16_t *list = s->scratch->list;
+    uint8_t *scores = s->scratch->scores;
+
+    if (s->round == 1) {
+        s->first_class = cls;
+    }
+    if (row == NULL) {
+        score_batch_secrets(guess, list, scores, n);
+    }
+    s->ncands = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint16_t code = list[i];
+        int c = row != NULL ? matrix_class(row, code) : score_class(scores[i]);
+        if (c != cls) {
+            s->cands[code / 64] &= ~(1ULL << (code % 64));
+        } else {
+            s->ncands++;
+        }
+    }
+}
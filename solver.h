@@ -0,0 +1,140 @@
+/**
+ * @brief mastermind solver for the client
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * The solver keeps the set of secrets that are still consistent with all
+ * responses as a bitset over the 32768 codes and prunes it after every
+ * response. The next guess is the code whose responses split the
+ * remaining candidates best according to the selected strategy; ties go
+ * to candidates (which may win right away) and then to the lowest code.
+ *
+ * Scores come from a mapped score matrix (see matrix.h) where it has the
+ * row of a guess and from the batch kernel otherwise.
+ *
+ * Guesses are rated in parallel on a thread pool if one is given. Every
+ * thread keeps its own best guess and they are merged after the loop; as
+ * ratings are totally ordered the result does not depend on the number
+ * of threads.
+ *
+ * The candidate lists and scores a guess or response is worked out with
+ * live in a scratch area that is only used during a call, so all solvers
+ * that run on the same thread can share one and a solver itself takes
+ * little more than its candidate bitset.
+ *
+ * The first guess of every strategy is computed once per process from the
+ * 52 codes that are distinct up to renaming colors, and the second guess
+ * is cached per first response, so only the first game pays for them.
+*/
+
+#ifndef MM_SOLVER_H_
+#define MM_SOLVER_H_
+
+#include <stdint.h>
+#include "score.h"
+#include "pool.h"
+#include "matrix.h"
+
+/* === Constants === */
+
+/* response classes red * (SLOTS + 1) + white */
+#define SCORE_CLASSES ((SLOTS + 1) * (SLOTS + 1))
+
+/* returned instead of a guess if no code fits all responses, which only
+   happens if a response was wrong */
+#define SOLVER_NO_GUESS (UINT16_MAX)
+
+enum strategy {
+    STRATEGY_RANDOM,    /* random codes, ignores the responses */
+    STRATEGY_MINIMAX,   /* Knuth: smallest worst case partition */
+    STRATEGY_PARTS,     /* most non-empty partitions */
+    STRATEGY_ENTROPY,   /* most expected information */
+    STRATEGIES
+};
+
+/* === Type Definitions === */
+
+/* Buffers of a solver call, see solver_init */
+struct solver_scratch {
+    uint16_t list[CODES];           /* candidates as a list */
+    uint8_t scores[CODES];          /* scores of the list */
+};
+
+struct solver {
+    uint64_t cands[CODES / 64];     /* consistent secrets */
+    uint32_t ncands;
+    enum strategy strategy;
+    int round;
+    int first_class;                /* response class of the first guess */
+    uint64_t guess_ns;              /* time spent selecting guesses */
+    uint64_t rng[4];                /* xoshiro256** state, see solver_seed */
+    struct pool *pool;              /* NULL to select on the caller only */
+    const struct matrix *matrix;    /* precomputed scores or NULL */
+    struct solver_scratch *scratch; /* may be shared, see solver_init */
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Parse the name of a strategy
+ * @param name random, minimax, parts or entropy
+ * @return The strategy or -1 if the name is unknown
+ */
+int solver_strategy(const char *name);
+
+/**
+ * @brief Start a new game
+ * @param s The solver
+ * @param strategy The strategy used to select guesses
+ * @param pool Threads used to select guesses, NULL for the caller only
+ * @param matrix Score matrix used for the guesses it has rows for, or NULL
+ * @param scratch Buffers of the calls, may be shared by all solvers that
+ * are only used by one thread at a time
+ */
+void solver_init(struct solver *s, enum strategy strategy, struct pool *pool,
+    const struct matrix *matrix, struct solver_scratch *scratch);
+
+/**
+ * @brief Seed the generator of random guesses; solver_init keeps it, so
+ * a solver that plays many games is seeded once
+ * @param s The solver
+ * @param seed The seed shared by all solvers
+ * @param stream Number of the solver or the game, for distinct guesses
+ */
+void solver_seed(struct solver *s, uint64_t seed, uint64_t stream);
+
+/**
+ * @brief Select the next guess
+ * @param s The solver
+ * @return The packed code to guess, SOLVER_NO_GUESS if the responses so
+ * far contradict each other
+ */
+uint16_t solver_guess(struct solver *s);
+
+/**
+ * @brief Take a guess that was selected before for the same responses
+ * @param s The solver
+ * @param guess The code to guess, e.g. from a cache of earlier games
+ *
+ * Guesses of all strategies but random depend on the responses only, so
+ * callers that remember them can skip solver_guess.
+ */
+void solver_replay(struct solver *s, uint16_t guess);
+
+/**
+ * @brief Search all codes for the best guess, bypassing the opening book
+ * @param s The solver
+ * @return The packed code to guess, SOLVER_NO_GUESS if no candidate is left
+ */
+uint16_t solver_best(struct solver *s);
+
+/**
+ * @brief Remove all candidates that are inconsistent with a response
+ * @param s The solver
+ * @param guess The code that was guessed
+ * @param red Number of red pins of the response
+ * @param white Number of white pins of the response
+ */
+void solver_feedback(struct solver *s, uint16_t guess, int red, int white);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * @brief token bucket rate limiter used to pace game rounds
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <time.h>
+#include "tbucket.h"
+
+/* === Implementations === */
+
+void tb_init(struct tb_rate *r, double rate, double burst)
+{
+    if (rate <= 0) {
+        r->interval = r->tolerance = 0;
+        return;
+    }
+    if (burst < 1) {
+        burst = 1;
+    }
+    r->interval = NSEC_PER_SEC / rate;
+    if (r->interval == 0) {
+        r->interval = 1;
+    }
+    r->tolerance = (burst - 1) * r->interval;
+}
+
+uint64_t tb_wait(const struct tb_rate *r, uint64_t tat, uint64_t now)
+{
+    if (r->interval == 0 || tat <= now + r->tolerance) {
+        return 0;
+    }
+    return tat - now - r->tolerance;
+}
+
+uint64_t tb_take(const struct tb_rate *r, uint64_t *tat, uint64_t now)
+{
+    uint64_t wait = tb_wait(r, *tat, now);
+
+    if (wait == 0 && r->interval != 0) {
+        /* an idle bucket does not save up more than its burst */
+        *tat = (*tat > now ? *tat : now) + r->interval;
+    }
+    return wait;
+}
+
+uint64_t tb_now(void)
+{
+    struct timespec ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
@@ -0,0 +1,61 @@
+/**
+ * @brief token bucket rate limiter used to pace game rounds
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * The bucket is kept in its virtual scheduling form (GCRA): the only state
+ * of a bucket is its theoretical arrival time (tat), so a limiter costs one
+ * 64 bit word per connection. The rate and burst are shared configuration.
+*/
+
+#ifndef MM_TBUCKET_H_
+#define MM_TBUCKET_H_
+
+#include <stdint.h>
+
+/* === Constants === */
+
+#define NSEC_PER_SEC (1000000000ULL)
+
+/* === Type Definitions === */
+
+struct tb_rate {
+    uint64_t interval;  /* nanoseconds per token, 0 means unlimited */
+    uint64_t tolerance; /* how far tat may run ahead of now (burst) */
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Configure a rate
+ * @param r The rate to configure
+ * @param rate Tokens per second, 0 disables the limit
+ * @param burst Number of tokens that may be taken at once (at least 1)
+ */
+void tb_init(struct tb_rate *r, double rate, double burst);
+
+/**
+ * @brief Take a token from a bucket
+ * @param r The rate of the bucket
+ * @param tat The state of the bucket, initialise with 0
+ * @param now Current time, see tb_now()
+ * @return 0 if a token was taken, else the nanoseconds until one is available
+ */
+uint64_t tb_take(const struct tb_rate *r, uint64_t *tat, uint64_t now);
+
+/**
+ * @brief Get the time a bucket has to wait for its next token
+ * @param r The rate of the bucket
+ * @param tat The state of the bucket
+ * @param now Current time, see tb_now()
+ * @return 0 if a token is available, else the nanoseconds to wait
+ */
+uint64_t tb_wait(const struct tb_rate *r, uint64_t tat, uint64_t now);
+
+/**
+ * @brief Get the current time of the monotonic clock
+ * @return Nanoseconds since an unspecified point
+ */
+uint64_t tb_now(void);
+
+#endif
@@ -0,0 +1,208 @@
+/*
+ * @brief hierarchical timing wheel for the timeouts of many games
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "timewheel.h"
+
+/* === Constants === */
+
+#define ARRAY_ALIGN (64)
+#define SLOT_MASK (TW_SLOTS - 1)
+
+/* === Macros === */
+
+/* Index of the sentinel of a slot */
+#define SENTINEL(tw, level, slot) \
+    ((tw)->capacity + (level) * TW_SLOTS + (slot))
+
+/* === Implementations === */
+
+/**
+ * @brief Find the first slot at or after a position that may be in use
+ * @param used The bitmap of a level
+ * @param pos The position, up to TW_SLOTS
+ * @return The slot or TW_SLOTS if there is none
+ */
+static uint32_t next_used(const uint64_t *used, uint32_t pos)
+{
+    for (uint32_t w = pos / 64; w < TW_SLOTS / 64; ++w) {
+        uint64_t bits = used[w];
+
+        if (w == pos / 64) {
+            bits &= ~0ULL << (pos % 64);
+        }
+        if (bits != 0) {
+            return w * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return TW_SLOTS;
+}
+
+/**
+ * @brief Link a timer into the slot of its deadline
+ * @param tw The wheel
+ * @param idx The timer, not linked
+ * @param when Its deadline, not before tw->now
+ */
+static void link_timer(struct timewheel *tw, uint32_t idx, uint32_t when)
+{
+    uint32_t diff = when ^ tw->now;
+    uint32_t level = diff == 0 ? 0
+        : (31 - __builtin_clz(diff)) / TW_SLOT_BITS;
+    uint32_t slot = (when >> (level * TW_SLOT_BITS)) & SLOT_MASK;
+    uint32_t head = SENTINEL(tw, level, slot);
+
+    /* at the tail, timers of a slot expire in the order they were armed */
+    tw->prev[idx] = tw->prev[head];
+    tw->next[idx] = head;
+    tw->next[tw->prev[head]] = idx;
+    tw->prev[head] = idx;
+    tw->used[level][slot / 64] |= 1ULL << (slot % 64);
+}
+
+/**
+ * @brief Move the slots that came due with tw->now down a level, called
+ * when the lowest byte of tw->now is zero
+ * @param tw The wheel
+ */
+static void cascade(struct timewheel *tw)
+{
+    int top = 1;
+
+    /* higher levels first, they may fill the slot of the next lower one */
+    while (top + 1 < TW_LEVELS
+        && (tw->now & ((1u << ((top + 1) * TW_SLOT_BITS)) - 1)) == 0) {
+        top++;
+    }
+    for (int level = top; level > 0; --level) {
+        uint32_t slot = (tw->now >> (level * TW_SLOT_BITS)) & SLOT_MASK;
+        uint32_t head = SENTINEL(tw, level, slot);
+        uint32_t idx = tw->next[head];
+
+        if (!(tw->used[level][slot / 64] & (1ULL << (slot % 64)))) {
+            continue;
+        }
+        tw->used[level][slot / 64] &= ~(1ULL << (slot % 64));
+        tw->next[head] = tw->prev[head] = head;
+        while (idx != head) {
+            uint32_t next = tw->next[idx];
+
+            link_timer(tw, idx, tw->when[idx]);
+            idx = next;
+        }
+    }
+}
+
+int tw_init(struct timewheel *tw, uint32_t capacity, uint32_t now)
+{
+    size_t entries = (size_t) capacity + TW_LEVELS * TW_SLOTS;
+    /* bytes of an array, rounded so every array starts a cache line */
+    size_t bytes = (entries * sizeof(uint32_t) + ARRAY_ALIGN - 1)
+        & ~(size_t) (ARRAY_ALIGN - 1);
+    uint8_t *mem;
+
+    (void) memset(tw, 0, sizeof(*tw));
+    if (capacity == 0 || capacity > UINT32_MAX - TW_LEVELS * TW_SLOTS) {
+        errno = EINVAL;
+        return -1;
+    }
+    tw->map_bytes = 3 * bytes;
+    mem = mmap(NULL, tw->map_bytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        return -1;
+    }
+    tw->mem = mem;
+    tw->next = (uint32_t *) mem;
+    tw->prev = (uint32_t *) (mem + bytes);
+    tw->when = (uint32_t *) (mem + 2 * bytes);
+    tw->capacity = capacity;
+    tw->now = now;
+    /* prev and when of a timer are only read while it is armed */
+    (void) memset(tw->next, 0xff, capacity * sizeof(uint32_t));
+    for (uint32_t s = 0; s < TW_LEVELS * TW_SLOTS; ++s) {
+        tw->next[capacity + s] = tw->prev[capacity + s] = capacity + s;
+    }
+    return 0;
+}
+
+void tw_destroy(struct timewheel *tw)
+{
+    if (tw->mem != NULL) {
+        (void) munmap(tw->mem, tw->map_bytes);
+    }
+    (void) memset(tw, 0, sizeof(*tw));
+}
+
+void tw_arm(struct timewheel *tw, uint32_t idx, uint32_t when)
+{
+    tw_cancel(tw, idx);
+    if ((int32_t) (when - tw->now) < 0) {
+        when = tw->now;
+    }
+    tw->when[idx] = when;
+    link_timer(tw, idx, when);
+    tw->armed++;
+}
+
+size_t tw_expire(struct timewheel *tw, uint32_t now, uint32_t *out,
+    size_t max)
+{
+    size_t n = 0;
+
+    while ((int32_t) (now - tw->now) >= 0) {
+        uint32_t slot = tw->now & SLOT_MASK;
+        uint32_t step;
+
+        if (tw->armed == 0) {
+            /* nothing to cascade either */
+            tw->now = now + 1;
+            break;
+        }
+        if (tw->used[0][slot / 64] & (1ULL << (slot % 64))) {
+            uint32_t head = SENTINEL(tw, 0, slot);
+
+            while (tw->next[head] != head) {
+                uint32_t idx = tw->next[head];
+
+                if (n == max) {
+                    return n;
+                }
+                tw->next[head] = tw->next[idx];
+                tw->prev[tw->next[idx]] = head;
+                tw->next[idx] = TW_NONE;
+                tw->armed--;
+                out[n++] = idx;
+            }
+            tw->used[0][slot / 64] &= ~(1ULL << (slot % 64));
+        }
+        /* skip the empty slots up to the next one in use, the end of the
+           round of level 0 or the tick after now, whichever comes first */
+        step = next_used(tw->used[0], slot + 1) - slot;
+        if (step > now - tw->now + 1) {
+            step = now - tw->now + 1;
+        }
+        tw->now += step;
+        if ((tw->now & SLOT_MASK) == 0) {
+            cascade(tw);
+        }
+    }
+    return n;
+}
+
+uint32_t tw_next(const struct timewheel *tw)
+{
+    uint32_t slot = tw->now & SLOT_MASK;
+
+    if (tw->armed == 0) {
+        return TW_IDLE;
+    }
+    /* past the last slot of level 0 the next cascade may bring timers */
+    return next_used(tw->used[0], slot) - slot;
+}
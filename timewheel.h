@@ -0,0 +1,124 @@
+/**
+ * @brief hierarchical timing wheel for the timeouts of many games
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Every game can have one timer, named by the game's index like in
+ * gametab.h. Time is counted in ticks of 32 bits that may wrap; deadlines
+ * have to lie less than 2^31 ticks ahead. The wheel has four levels of 256
+ * slots each, level l holds the timers whose deadline agrees with the
+ * current tick in all bytes above byte l. Arming or cancelling a timer
+ * links it into or out of a slot's list, O(1) and no allocation. Each time
+ * the low bytes of the current tick roll over to zero, the slot of the
+ * next higher level that just came due is moved down a level, so every
+ * timer is moved at most three times before it expires.
+ *
+ * The lists are doubly linked through index arrays, with one sentinel per
+ * slot behind the timers' entries. A bitmap per level marks the slots that
+ * may have timers, so empty ticks are skipped a word at a time. The wheel
+ * is not thread-safe, every worker owns its own.
+*/
+
+#ifndef MM_TIMEWHEEL_H_
+#define MM_TIMEWHEEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* === Constants === */
+
+#define TW_LEVELS (4)
+#define TW_SLOT_BITS (8)
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+#define TW_NONE (UINT32_MAX)    /* next of a timer that is not armed */
+#define TW_IDLE (UINT32_MAX)    /* tw_next() without armed timers */
+
+/* === Type Definitions === */
+
+struct timewheel {
+    uint32_t *next;     /* capacity timers, then one sentinel per slot */
+    uint32_t *prev;
+    uint32_t *when;     /* deadline of every armed timer */
+    uint64_t used[TW_LEVELS][TW_SLOTS / 64]; /* slots that may be in use */
+    uint32_t now;       /* first tick that did not expire yet */
+    uint32_t armed;
+    uint32_t capacity;
+    void *mem;
+    size_t map_bytes;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Reserve the lists of a wheel, no timer is armed
+ * @param tw The wheel
+ * @param capacity Number of timers
+ * @param now The current tick
+ * @return 0 on success, -1 with errno set on error
+ */
+int tw_init(struct timewheel *tw, uint32_t capacity, uint32_t now);
+
+/**
+ * @brief Release the lists of a wheel
+ * @param tw The wheel
+ */
+void tw_destroy(struct timewheel *tw);
+
+/**
+ * @brief Arm a timer, or move it if it is armed already
+ * @param tw The wheel
+ * @param idx The timer
+ * @param when Its deadline, a tick that passed already expires with the
+ * next call of tw_expire()
+ */
+void tw_arm(struct timewheel *tw, uint32_t idx, uint32_t when);
+
+/**
+ * @brief Expire the timers whose deadline is not after a tick, in the
+ * order of their deadlines
+ * @param tw The wheel
+ * @param now The current tick
+ * @param out Receives the expired timers, which are not armed any more
+ * @param max Room in out; the rest expires with the next call
+ * @return Number of timers in out
+ */
+size_t tw_expire(struct timewheel *tw, uint32_t now, uint32_t *out,
+    size_t max);
+
+/**
+ * @brief Get the ticks until tw_expire() may have something to do
+ * @param tw The wheel
+ * @return Ticks from tw->now, the first tick that did not expire yet; at
+ * most TW_SLOTS if timers are armed, TW_IDLE if none is
+ */
+uint32_t tw_next(const struct timewheel *tw);
+
+/**
+ * @brief Check whether a timer is armed
+ * @param tw The wheel
+ * @param idx The timer
+ * @return Nonzero if it is
+ */
+static inline int tw_armed(const struct timewheel *tw, uint32_t idx)
+{
+    return tw->next[idx] != TW_NONE;
+}
+
+/**
+ * @brief Cancel a timer, nothing happens if it is not armed
+ * @param tw The wheel
+ * @param idx The timer
+ */
+static inline void tw_cancel(struct timewheel *tw, uint32_t idx)
+{
+    uint32_t next = tw->next[idx];
+
+    if (next != TW_NONE) {
+        tw->prev[next] = tw->prev[idx];
+        tw->next[tw->prev[idx]] = next;
+        tw->next[idx] = TW_NONE;
+        tw->armed--;
+    }
+}
+
+#endif
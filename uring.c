@@ -0,0 +1,237 @@
+/*
+ * @brief minimal io_uring wrapper on top of the raw system calls
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+/* === Implementations === */
+
+int uring_init(struct uring *u, unsigned int entries)
+{
+    struct io_uring_params p;
+    struct io_uring_probe *probe;
+    size_t probe_size = sizeof(*probe) + 256 * sizeof(probe->ops[0]);
+
+    (void) memset(u, 0, sizeof(*u));
+    (void) memset(&p, 0, sizeof(p));
+    /* one thread submits and reaps, completions only run when it waits */
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN
+        | IORING_SETUP_SUBMIT_ALL;
+    u->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (u->fd < 0 && errno == EINVAL) {
+        (void) memset(&p, 0, sizeof(p));
+        u->fd = syscall(__NR_io_uring_setup, entries, &p);
+    }
+    if (u->fd < 0) {
+        return -1;
+    }
+    u->features = p.features;
+
+    u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_ring_size > u->sq_ring_size) {
+            u->sq_ring_size = u->cq_ring_size;
+        }
+        u->cq_ring_size = u->sq_ring_size;
+    }
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) {
+        u->sq_ring = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED) {
+            u->cq_ring = NULL;
+            goto fail;
+        }
+    }
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        goto fail;
+    }
+
+    u->sq_head = (unsigned int *) ((char *) u->sq_ring + p.sq_off.head);
+    u->sq_tail = (unsigned int *) ((char *) u->sq_ring + p.sq_off.tail);
+    u->sq_mask = *(unsigned int *) ((char *) u->sq_ring + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->sq_local = *u->sq_tail;
+    u->cq_head = (unsigned int *) ((char *) u->cq_ring + p.cq_off.head);
+    u->cq_tail = (unsigned int *) ((char *) u->cq_ring + p.cq_off.tail);
+    u->cq_mask = *(unsigned int *) ((char *) u->cq_ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) ((char *) u->cq_ring + p.cq_off.cqes);
+
+    /* SQEs are always submitted in order, slot i stays at index i */
+    unsigned int *array = (unsigned int *) ((char *) u->sq_ring
+        + p.sq_off.array);
+    for (unsigned int i = 0; i < p.sq_entries; ++i) {
+        array[i] = i;
+    }
+
+    if ((probe = calloc(1, probe_size)) != NULL) {
+        if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PROBE,
+                probe, 256) == 0) {
+            for (int i = 0; i < probe->ops_len; ++i) {
+                if (probe->ops[i].flags & IO_URING_OP_SUPPORTED) {
+                    u->ops[probe->ops[i].op / 8] |= 1 << (probe->ops[i].op % 8);
+                }
+            }
+        }
+        free(probe);
+    }
+    return 0;
+
+fail:
+    uring_exit(u);
+    return -1;
+}
+
+void uring_exit(struct uring *u)
+{
+    int saved = errno;
+
+    if (u->sqes != NULL) {
+        (void) munmap(u->sqes, u->sqes_size);
+    }
+    if (u->cq_ring != NULL && u->cq_ring != u->sq_ring) {
+        (void) munmap(u->cq_ring, u->cq_ring_size);
+    }
+    if (u->sq_ring != NULL) {
+        (void) munmap(u->sq_ring, u->sq_ring_size);
+    }
+    if (u->fd >= 0) {
+        (void) close(u->fd);
+    }
+    (void) memset(u, 0, sizeof(*u));
+    u->fd = -1;
+    errno = saved;
+}
+
+int uring_supports(const struct uring *u, int op)
+{
+    return op >= 0 && op < 256 && (u->ops[op / 8] & (1 << (op % 8)));
+}
+
+struct io_uring_sqe *uring_sqe(struct uring *u)
+{
+    struct io_uring_sqe *sqe;
+
+    if (u->sq_local - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE)
+            >= u->sq_entries
+        && (uring_enter(u, 0, -1) < 0
+            || u->sq_local - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE)
+                >= u->sq_entries)) {
+        return NULL;
+    }
+    sqe = &u->sqes[u->sq_local & u->sq_mask];
+    (void) memset(sqe, 0, sizeof(*sqe));
+    u->sq_local++;
+    return sqe;
+}
+
+int uring_enter(struct uring *u, unsigned int wait_nr, int timeout_ms)
+{
+    unsigned int flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    unsigned int submit;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    void *argp = NULL;
+    size_t argsz = 0;
+    long r;
+
+    __atomic_store_n(u->sq_tail, u->sq_local, __ATOMIC_RELEASE);
+    submit = u->sq_local - *u->sq_head;
+    if (wait_nr > 0 && timeout_ms >= 0
+        && (u->features & IORING_FEAT_EXT_ARG)) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+        (void) memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t) (uintptr_t) &ts;
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argsz = sizeof(arg);
+    }
+    do {
+        r = syscall(__NR_io_uring_enter, u->fd, submit, wait_nr, flags,
+            argp, argsz);
+    } while (r < 0 && errno == EINTR && wait_nr == 0);
+    if (r < 0 && (errno == ETIME || errno == EINTR || errno == EBUSY)) {
+        return 0;
+    }
+    return r < 0 ? -1 : 0;
+}
+
+int uring_bufs_init(struct uring *u, struct uring_bufs *b, uint16_t group,
+    uint32_t count, uint32_t size)
+{
+    struct io_uring_buf_reg reg;
+    size_t ring_size = count * sizeof(struct io_uring_buf);
+
+    (void) memset(b, 0, sizeof(*b));
+    b->ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b->ring == MAP_FAILED) {
+        b->ring = NULL;
+        return -1;
+    }
+    if ((b->mem = malloc((size_t) count * size)) == NULL) {
+        (void) munmap(b->ring, ring_size);
+        b->ring = NULL;
+        return -1;
+    }
+    b->count = count;
+    b->size = size;
+    b->group = group;
+
+    (void) memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) (uintptr_t) b->ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING,
+            &reg, 1) < 0) {
+        int saved = errno;
+        free(b->mem);
+        (void) munmap(b->ring, ring_size);
+        (void) memset(b, 0, sizeof(*b));
+        errno = saved;
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        uring_buf_put(b, i);
+    }
+    return 0;
+}
+
+void uring_bufs_free(struct uring *u, struct uring_bufs *b)
+{
+    struct io_uring_buf_reg reg;
+
+    if (b->ring == NULL) {
+        return;
+    }
+    (void) memset(&reg, 0, sizeof(reg));
+    reg.bgid = b->group;
+    (void) syscall(__NR_io_uring_register, u->fd, IORING_UNREGISTER_PBUF_RING,
+        &reg, 1);
+    free(b->mem);
+    (void) munmap(b->ring, b->count * sizeof(struct io_uring_buf));
+    (void) memset(b, 0, sizeof(*b));
+}
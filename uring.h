@@ -0,0 +1,163 @@
+/**
+ * @brief minimal io_uring wrapper on top of the raw system calls
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * Maps the submission and completion rings of one io_uring instance and
+ * a ring of provided buffers for multishot receives. The instance is
+ * meant to be used by a single thread: SQEs are collected with
+ * uring_sqe() and handed to the kernel together by the next
+ * uring_enter(), which also waits for completions.
+*/
+
+#ifndef MM_URING_H_
+#define MM_URING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/* === Type Definitions === */
+
+struct uring {
+    int fd;
+    unsigned int features;          /* IORING_FEAT_* */
+    uint8_t ops[256 / 8];           /* bitset of the supported opcodes */
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int sq_local;          /* tail of the SQEs not submitted yet */
+    struct io_uring_sqe *sqes;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;                  /* == sq_ring with IORING_FEAT_SINGLE_MMAP */
+    size_t cq_ring_size;
+    size_t sqes_size;
+};
+
+/* Buffers the kernel picks from for IOSQE_BUFFER_SELECT receives */
+struct uring_bufs {
+    struct io_uring_buf_ring *ring;
+    uint8_t *mem;                   /* count buffers of size bytes */
+    uint32_t count;                 /* power of two */
+    uint32_t size;
+    uint16_t group;
+    uint16_t tail;
+};
+
+/* === Prototypes === */
+
+/**
+ * @brief Create an io_uring instance and map its rings
+ * @param u The ring to set up
+ * @param entries Number of SQEs, the completion ring gets twice as many
+ * @return 0 on success, -1 with errno set if io_uring is not available
+ */
+int uring_init(struct uring *u, unsigned int entries);
+
+/**
+ * @brief Unmap the rings and close the instance
+ * @param u The ring
+ */
+void uring_exit(struct uring *u);
+
+/**
+ * @brief Check whether the kernel supports an opcode
+ * @param u The ring
+ * @param op An IORING_OP_* opcode
+ * @return Nonzero if it is supported
+ */
+int uring_supports(const struct uring *u, int op);
+
+/**
+ * @brief Get a cleared SQE, submitting the queued ones if the ring is full
+ * @param u The ring
+ * @return The SQE, NULL if the ring stays full
+ */
+struct io_uring_sqe *uring_sqe(struct uring *u);
+
+/**
+ * @brief Submit all queued SQEs and wait for completions
+ * @param u The ring
+ * @param wait_nr Number of completions to wait for, 0 to only submit
+ * @param timeout_ms Give up waiting after this many ms, -1 for no limit
+ * @return 0 on success or timeout, -1 with errno set on error
+ */
+int uring_enter(struct uring *u, unsigned int wait_nr, int timeout_ms);
+
+/**
+ * @brief Get the next completion
+ * @param u The ring
+ * @return The CQE or NULL if there is none, release it with uring_seen()
+ */
+static inline struct io_uring_cqe *uring_cqe(struct uring *u)
+{
+    unsigned int head = *u->cq_head;
+
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &u->cqes[head & u->cq_mask];
+}
+
+/**
+ * @brief Hand the completion returned by uring_cqe() back to the kernel
+ * @param u The ring
+ */
+static inline void uring_seen(struct uring *u)
+{
+    __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Register a ring of provided buffers
+ * @param u The ring
+ * @param b The buffers to set up
+ * @param group Buffer group id used in sqe->buf_group
+ * @param count Number of buffers, a power of two
+ * @param size Bytes per buffer
+ * @return 0 on success, -1 with errno set on error
+ */
+int uring_bufs_init(struct uring *u, struct uring_bufs *b, uint16_t group,
+    uint32_t count, uint32_t size);
+
+/**
+ * @brief Unregister and free provided buffers
+ * @param u The ring
+ * @param b The buffers
+ */
+void uring_bufs_free(struct uring *u, struct uring_bufs *b);
+
+/**
+ * @brief Get the data of a provided buffer
+ * @param b The buffers
+ * @param id Buffer id from the CQE flags (flags >> IORING_CQE_BUFFER_SHIFT)
+ * @return The buffer
+ */
+static inline uint8_t *uring_buf(const struct uring_bufs *b, uint16_t id)
+{
+    return &b->mem[(size_t) id * b->size];
+}
+
+/**
+ * @brief Give a buffer back to the kernel once its data was consumed
+ * @param b The buffers
+ * @param id Buffer id
+ */
+static inline void uring_buf_put(struct uring_bufs *b, uint16_t id)
+{
+    struct io_uring_buf *buf = &b->ring->bufs[b->tail & (b->count - 1)];
+
+    buf->addr = (uint64_t) (uintptr_t) uring_buf(b, id);
+    buf->len = b->size;
+    buf->bid = id;
+    b->tail++;
+    __atomic_store_n(&b->ring->tail, b->tail, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,323 @@
+/*
+ * @brief offline verifier of the server's replay logs
+ * @author Paul Pröll, 1525669
+ * @date 2016-10-08
+ *
+ * verify [-q] [-t threads] segment-file...
+ *
+ * Maps every segment of a replay log (see replay.h) and answers every
+ * logged request again with the server's game logic (game.h). Records are
+ * scored in batches with the SIMD kernels of score.h, so verifying keeps
+ * up with reading the files; the blocks of a segment are spread over all
+ * threads. Every record whose logged response differs from the answer is
+ * a mismatch; the first ones are printed. Segments that were not closed
+ * are read to their preallocated end, records with round 0 were never
+ * written and are skipped.
+ *
+ * Exits with EXIT_MISMATCH if there were mismatches.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tbucket.h"
+#include "pool.h"
+#include "game.h"
+#include "replay.h"
+#include "args.h"
+
+/* === Constants === */
+
+#define EXIT_MISMATCH (2)
+#define BATCH (1024)            /* records scored at once */
+#define BLOCK (64 * BATCH)      /* records a thread takes at once */
+#define REPORT_MAX (10)         /* mismatches printed */
+
+/* === Type Definitions === */
+
+struct verify_opts {
+    long int threads;
+    int quiet;
+};
+
+/* A mapped segment */
+struct segment {
+    const char *path;
+    const struct replay_header *hdr;
+    const struct replay_rec *recs;
+    uint64_t count;             /* records to look at */
+    size_t size;
+};
+
+/* Per thread counters */
+struct verify_thread {
+    uint64_t records;
+    uint64_t unused;
+    uint64_t mismatches;
+} __attribute__((aligned(64)));
+
+struct verify_ctx {
+    const struct verify_opts *options;
+    const struct segment *seg;
+    struct verify_thread *threads;
+};
+
+/* === Global Variables === */
+
+/* Name of the program */
+static const char *progname = "verify"; /* default name */
+
+/* Mismatches printed so far, over all threads */
+static unsigned int reported = 0;
+
+/* === Implementations === */
+
+/**
+ * @brief terminate program on program error
+ * @param exitcode exit code
+ * @param fmt format string
+ */
+static void bail_out(int exitcode, const char *fmt, ...)
+{
+    va_list ap;
+
+    (void) fprintf(stderr, "%s: ", progname);
+    if (fmt != NULL) {
+        va_start(ap, fmt);
+        (void) vfprintf(stderr, fmt, ap);
+        va_end(ap);
+    }
+    if (errno != 0) {
+        (void) fprintf(stderr, ": %s", strerror(errno));
+    }
+    (void) fprintf(stderr, "\n");
+    exit(exitcode);
+}
+
+/**
+ * @brief Map a segment file and check its header
+ * @param seg Receives the segment
+ * @param path The file
+ */
+static void open_segment(struct segment *seg, const char *path)
+{
+    struct stat st;
+    int fd;
+    void *base;
+
+    seg->path = path;
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        bail_out(EXIT_FAILURE, "opening %s", path);
+    }
+    seg->size = st.st_size;
+    if (seg->size < sizeof(struct replay_header)) {
+        errno = 0;
+        bail_out(EXIT_FAILURE, "%s: not a replay segment", path);
+    }
+    base = mmap(NULL, seg->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        bail_out(EXIT_FAILURE, "mapping %s", path);
+    }
+    (void) close(fd);
+    /* read ahead, the blocks are taken roughly in order */
+    (void) madvise(base, seg->size, MADV_SEQUENTIAL);
+    (void) madvise(base, seg->size, MADV_WILLNEED);
+
+    seg->hdr = base;
+    seg->recs = (const struct replay_rec *) (seg->hdr + 1);
+    if (memcmp(seg->hdr->magic, REPLAY_MAGIC, sizeof(seg->hdr->magic)) != 0
+        || seg->hdr->rec_bytes != sizeof(struct replay_rec)) {
+        errno = 0;
+        bail_out(EXIT_FAILURE, "%s: not a replay segment", path);
+    }
+    seg->count = (seg->size - sizeof(struct replay_header))
+        / sizeof(struct replay_rec);
+    if (seg->hdr->records > 0) {
+        if (seg->hdr->records > seg->count) {
+            errno = 0;
+            bail_out(EXIT_FAILURE, "%s: truncated, %llu of %llu records",
+                path, (unsigned long long) seg->count,
+                (unsigned long long) seg->hdr->records);
+        }
+        seg->count = seg->hdr->records;
+    }
+}
+
+/**
+ * @brief Unmap a segment
+ * @param seg The segment
+ */
+static void close_segment(struct segment *seg)
+{
+    (void) munmap((void *) seg->hdr, seg->size);
+}
+
+/**
+ * @brief Print a mismatch unless enough were printed
+ * @param ctx The verification
+ * @param pos Index of the record
+ * @param expected The answer of the game logic
+ */
+static void report(const struct verify_ctx *ctx, uint64_t pos,
+    uint8_t expected)
+{
+    const struct replay_rec *rec = &ctx->seg->recs[pos];
+
+    if (ctx->options->quiet
+        || __atomic_fetch_add(&reported, 1, __ATOMIC_RELAXED) >= REPORT_MAX) {
+        return;
+    }
+    (void) printf("%s: record %llu: connection %u, game id %u, round %u, "
+        "request 0x%04x, secret 0x%04x: logged 0x%02x, expected 0x%02x\n",
+        ctx->seg->path, (unsigned long long) pos, (unsigned) rec->conn,
+        (unsigned) rec->id, (unsigned) rec->round, (unsigned) rec->request,
+        (unsigned) rec->secret, (unsigned) rec->response, (unsigned) expected);
+}
+
+/**
+ * @brief Verify a block of records, called by the pool
+ * @param arg The verification
+ * @param tid The calling thread
+ * @param begin First block
+ * @param end End of the blocks
+ */
+static void verify_blocks(void *arg, int tid, uint32_t begin, uint32_t end)
+{
+    const struct verify_ctx *ctx = arg;
+    struct verify_thread *t = &ctx->threads[tid];
+    uint16_t secrets[BATCH], reqs[BATCH];
+    uint8_t rounds[BATCH], resps[BATCH];
+    uint64_t first = (uint64_t) begin * BLOCK;
+    uint64_t last = (uint64_t) end * BLOCK;
+
+    if (last > ctx->seg->count) {
+        last = ctx->seg->count;
+    }
+    for (uint64_t pos = first; pos < last; pos += BATCH) {
+        const struct replay_rec *recs = &ctx->seg->recs[pos];
+        size_t n = last - pos < BATCH ? last - pos : BATCH;
+
+        /* the scoring kernels want the fields in arrays of their own */
+        for (size_t i = 0; i < n; ++i) {
+            secrets[i] = recs[i].secret;
+            reqs[i] = recs[i].request;
+            rounds[i] = recs[i].round;
+        }
+        game_answer_pairs(secrets, reqs, rounds, resps, n);
+        for (size_t i = 0; i < n; ++i) {
+            if (rounds[i] == 0) {
+                t->unused++;
+            } else if (resps[i] != recs[i].response || rounds[i] > MAX_TRIES) {
+                t->mismatches++;
+                report(ctx, pos + i, resps[i]);
+            }
+        }
+        t->records += n;
+    }
+}
+
+/**
+ * @brief Parse command line options
+ * @param argc The argument counter
+ * @param argv The argument vector
+ * @param options Struct where parsed arguments are stored
+ */
+static void parse_args(int argc, char **argv, struct verify_opts *options)
+{
+    int c;
+
+    if (argc > 0) {
+        progname = argv[0];
+    }
+    options->threads = sysconf(_SC_NPROCESSORS_ONLN);
+    options->quiet = 0;
+    if (options->threads < 1 || options->threads > POOL_MAX_THREADS) {
+        options->threads = 1;
+    }
+    while ((c = getopt(argc, argv, "qt:")) != -1) {
+        switch (c) {
+        case 'q':
+            options->quiet = 1;
+            break;
+        case 't':
+            options->threads = parse_number(optarg, "-t", 1,
+                POOL_MAX_THREADS, bail_out);
+            break;
+        default:
+            goto usage;
+        }
+    }
+    if (optind == argc) {
+usage:
+        errno = 0;
+        bail_out(EXIT_FAILURE, "Usage: %s [-q] [-t threads] segment-file...",
+            progname);
+    }
+}
+
+/**
+ * @brief Program entry point
+ * @param argc The argument counter
+ * @param argv The argument vector
+ * @return EXIT_SUCCESS if all records match, EXIT_MISMATCH if some do not,
+ * EXIT_FAILURE in case of an error
+ */
+int main(int argc, char *argv[])
+{
+    struct verify_opts options;
+    struct verify_ctx ctx;
+    struct pool pool;
+    uint64_t records = 0, unused = 0, mismatches = 0, bytes = 0, start, ns;
+
+    parse_args(argc, argv, &options);
+    if (posix_memalign((void **) &ctx.threads, 64,
+            options.threads * sizeof(*ctx.threads)) != 0) {
+        bail_out(EXIT_FAILURE, "allocating thread state");
+    }
+    (void) memset(ctx.threads, 0, options.threads * sizeof(*ctx.threads));
+    ctx.options = &options;
+    if (pool_init(&pool, options.threads) < 0) {
+        bail_out(EXIT_FAILURE, "starting threads");
+    }
+
+    start = tb_now();
+    for (int i = optind; i < argc; ++i) {
+        struct segment seg;
+        uint64_t blocks;
+
+        open_segment(&seg, argv[i]);
+        blocks = (seg.count + BLOCK - 1) / BLOCK;
+        if (blocks > UINT32_MAX) {
+            errno = 0;
+            bail_out(EXIT_FAILURE, "%s: too many records", argv[i]);
+        }
+        ctx.seg = &seg;
+        pool_run(&pool, blocks, 1, verify_blocks, &ctx);
+        bytes += seg.size;
+        close_segment(&seg);
+    }
+    ns = tb_now() - start;
+    pool_destroy(&pool);
+
+    for (long int t = 0; t < options.threads; ++t) {
+        records += ctx.threads[t].records;
+        unused += ctx.threads[t].unused;
+        mismatches += ctx.threads[t].mismatches;
+    }
+    (void) printf("%llu rounds in %d segments, %llu mismatches, "
+        "%llu unused records\n", (unsigned long long) (records - unused),
+        argc - optind, (unsigned long long) mismatches,
+        (unsigned long long) unused);
+    (void) printf("%.1f MiB in %.3f s on %ld threads, %.2f GB/s\n",
+        bytes / 1048576.0, ns / 1e9, options.threads,
+        ns > 0 ? bytes / (double) ns : 0.0);
+    free(ctx.threads);
+    return mismatches > 0 ? EXIT_MISMATCH : EXIT_SUCCESS;
+}